@@ -0,0 +1,593 @@
+#include "buildid.h"
+#include "util.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <elf.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#define BUILD_ID_INDEX_VERSION 2
+#define BUILD_ID_INDEX_GROUP "index"
+#define BUILD_ID_GROUP "build-id"
+#define EXECUTABLE_GROUP "executable"
+#define PACKAGE_GROUP_PREFIX "package "
+#define DPKG_LIST_SUFFIX ".list"
+#define DEBUG_FILE_SUFFIX ".debug"
+//PT_NOTE段一般只有几十字节，超过这个大小的不读取
+#define ELF_NOTES_MAX (64 * 1024)
+
+/*索引的结构：
+* [build-id]中每个键为build-id，值为"软件包;调试文件路径"；
+* [executable]中每个键为build-id，值为"软件包;可执行文件或库的路径"；
+* [package 包名]记录调试包和对应的二进制包的dpkg文件列表的修改时间，
+* 以及这个包提供的build-id，用来增量更新。*/
+
+G_LOCK_DEFINE_STATIC(buildid_index);
+//常驻内存的索引，索引文件被替换后重新加载
+static GKeyFile *g_index = NULL;
+static ino_t g_index_ino = 0;
+static struct timespec g_index_mtime = {0};
+
+//只有调试包才会安装DEBUG_BUILD_ID_PATH下的文件，name可能带有":架构"
+static bool is_debug_package(const char *name) {
+    _cleanup_free_ char *base = strdup(name);
+    char *colon;
+
+    if (!base)
+        return false;
+    colon = strchr(base, ':');
+    if (colon)
+        *colon = '\0';
+    return str_endsWith(base, "-dbgsym") || str_endsWith(base, "-dbg");
+}
+
+//build-id是小写的十六进制字符串，目录名占前两位，所以至少有3位
+static char *normalize_build_id(const char *build_id) {
+    size_t len = strlen(build_id);
+    char *id;
+
+    if (len < 3)
+        return NULL;
+
+    id = strdup(build_id);
+    if (!id)
+        return NULL;
+    for (size_t i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char)id[i])) {
+            free(id);
+            return NULL;
+        }
+        id[i] = tolower((unsigned char)id[i]);
+    }
+    return id;
+}
+
+//从"DEBUG_BUILD_ID_PATH/ab/cdef....debug"中取出build-id
+static char *build_id_from_path(const char *path) {
+    const char *rest;
+    size_t len;
+    char *id;
+
+    if (strncmp(path, DEBUG_BUILD_ID_PATH "/", strlen(DEBUG_BUILD_ID_PATH "/")) != 0)
+        return NULL;
+    if (!str_endsWith(path, DEBUG_FILE_SUFFIX))
+        return NULL;
+
+    rest = path + strlen(DEBUG_BUILD_ID_PATH "/");
+    len = strlen(rest) - strlen(DEBUG_FILE_SUFFIX);
+    if (len < 4 || rest[2] != '/' || memchr(rest + 3, '/', len - 3))
+        return NULL;
+
+    id = malloc(len);
+    if (!id)
+        return NULL;
+    memcpy(id, rest, 2);
+    memcpy(id + 2, rest + 3, len - 3);
+    id[len - 1] = '\0';
+
+    for (size_t i = 0; id[i]; i++) {
+        if (!isxdigit((unsigned char)id[i]) || isupper((unsigned char)id[i])) {
+            free(id);
+            return NULL;
+        }
+    }
+    return id;
+}
+
+static char *hex_encode(const unsigned char *data, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    char *s = malloc(len * 2 + 1);
+
+    if (!s)
+        return NULL;
+    for (size_t i = 0; i < len; i++) {
+        s[i * 2] = hex[data[i] >> 4];
+        s[i * 2 + 1] = hex[data[i] & 0xf];
+    }
+    s[len * 2] = '\0';
+    return s;
+}
+
+/*在一个PT_NOTE段的内容中查找NT_GNU_BUILD_ID：
+*
+* data：段的内容；
+* align：段的对齐方式，4或8。
+* 函数返回值：
+*
+* 找到：返回十六进制的build-id，需要调用者释放；
+* 没有找到：返回 NULL。*/
+char *buildid_find_note(const void *data, size_t size, size_t align) {
+    const unsigned char *notes = data;
+    size_t off = 0;
+
+    while (off + sizeof(Elf64_Nhdr) <= size) {
+        const Elf64_Nhdr *nhdr = (const Elf64_Nhdr *)(notes + off);
+        size_t name_off = off + sizeof(Elf64_Nhdr);
+        size_t desc_off = name_off + ((nhdr->n_namesz + align - 1) & ~(align - 1));
+        size_t next = desc_off + ((nhdr->n_descsz + align - 1) & ~(align - 1));
+
+        if (desc_off > size || nhdr->n_descsz > size - desc_off)
+            break;
+        if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == sizeof(ELF_NOTE_GNU) &&
+            memcmp(notes + name_off, ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU)) == 0 && nhdr->n_descsz > 0)
+            return hex_encode(notes + desc_off, nhdr->n_descsz);
+        off = next;
+    }
+    return NULL;
+}
+
+static char *read_build_id_note(int fd, uint64_t offset, uint64_t size, uint64_t p_align) {
+    unsigned char *notes;
+    char *id = NULL;
+
+    if (size == 0 || size > ELF_NOTES_MAX)
+        return NULL;
+    notes = malloc(size);
+    if (!notes)
+        return NULL;
+    if (pread(fd, notes, size, offset) == (ssize_t)size)
+        id = buildid_find_note(notes, size, p_align == 8 ? 8 : 4);
+    free(notes);
+    return id;
+}
+
+/*从ELF文件的程序头中读取build-id，只支持与本机字节序相同的文件：
+*
+* fd：打开的ELF文件；
+* build_id：十六进制的build-id，需要调用者释放。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 不是ELF文件或没有build-id：返回 -ENOENT。*/
+int buildid_read_elf_fd(int fd, char **build_id) {
+    unsigned char ident[EI_NIDENT];
+    char *id = NULL;
+
+    assert(build_id);
+
+    if (pread(fd, ident, EI_NIDENT, 0) != EI_NIDENT || memcmp(ident, ELFMAG, SELFMAG) != 0)
+        return -ENOENT;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    if (ident[EI_DATA] != ELFDATA2LSB)
+        return -ENOENT;
+#else
+    if (ident[EI_DATA] != ELFDATA2MSB)
+        return -ENOENT;
+#endif
+
+    if (ident[EI_CLASS] == ELFCLASS64) {
+        Elf64_Ehdr ehdr;
+        Elf64_Phdr phdr;
+
+        if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) || ehdr.e_phentsize != sizeof(phdr))
+            return -ENOENT;
+        for (unsigned i = 0; i < ehdr.e_phnum && !id; i++) {
+            if (pread(fd, &phdr, sizeof(phdr), ehdr.e_phoff + (uint64_t)i * sizeof(phdr)) != sizeof(phdr))
+                return -ENOENT;
+            if (phdr.p_type == PT_NOTE)
+                id = read_build_id_note(fd, phdr.p_offset, phdr.p_filesz, phdr.p_align);
+        }
+    } else if (ident[EI_CLASS] == ELFCLASS32) {
+        Elf32_Ehdr ehdr;
+        Elf32_Phdr phdr;
+
+        if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) || ehdr.e_phentsize != sizeof(phdr))
+            return -ENOENT;
+        for (unsigned i = 0; i < ehdr.e_phnum && !id; i++) {
+            if (pread(fd, &phdr, sizeof(phdr), ehdr.e_phoff + (uint64_t)i * sizeof(phdr)) != sizeof(phdr))
+                return -ENOENT;
+            if (phdr.p_type == PT_NOTE)
+                id = read_build_id_note(fd, phdr.p_offset, phdr.p_filesz, phdr.p_align);
+        }
+    }
+
+    if (!id)
+        return -ENOENT;
+    *build_id = id;
+    return OK;
+}
+
+/*路径可能来自core的NT_FILE，以root身份打开时不能阻塞在FIFO或设备上，
+* 所以用O_NONBLOCK打开，只读取普通文件*/
+int buildid_read_elf(const char *path, char **build_id) {
+    struct stat st;
+    int fd, r;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+        return -errno;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -ENOENT;
+    }
+    r = buildid_read_elf_fd(fd, build_id);
+    close(fd);
+    return r;
+}
+
+//调试包对应的二进制包的文件列表："foo-dbgsym:amd64" -> "foo:amd64.list"
+static bool binary_list_path(const char *package, char *path, size_t size) {
+    const char *colon = strchr(package, ':');
+    size_t len = colon ? (size_t)(colon - package) : strlen(package);
+    const char *arch = colon ? colon : "";
+
+    if (len > strlen("-dbgsym") && strncmp(package + len - strlen("-dbgsym"), "-dbgsym", strlen("-dbgsym")) == 0)
+        len -= strlen("-dbgsym");
+    else if (len > strlen("-dbg") && strncmp(package + len - strlen("-dbg"), "-dbg", strlen("-dbg")) == 0)
+        len -= strlen("-dbg");
+    else
+        return false;
+
+    snprintf(path, size, "%s/%.*s%s%s", DPKG_INFO_PATH, (int)len, package, arch, DPKG_LIST_SUFFIX);
+    return true;
+}
+
+static void remove_keys_of_package(GKeyFile *keyfile, const char *group, const char *key,
+                                   const char *index_group, const char *package) {
+    gchar **ids = NULL;
+
+    ids = g_key_file_get_string_list(keyfile, group, key, NULL, NULL);
+    for (gchar **id = ids; id && *id; id++) {
+        gchar **value = NULL;
+        gsize n = 0;
+
+        value = g_key_file_get_string_list(keyfile, index_group, *id, &n, NULL);
+        if (value && n == 2 && strcmp(value[0], package) == 0)
+            (void) g_key_file_remove_key(keyfile, index_group, *id, NULL);
+        g_strfreev(value);
+    }
+    g_strfreev(ids);
+}
+
+//删除一个包在索引中的记录，其它包提供的同一个build-id不受影响
+static void index_remove_package(GKeyFile *keyfile, const char *group, const char *package) {
+    gchar *binary = g_key_file_get_string(keyfile, group, "binary", NULL);
+
+    remove_keys_of_package(keyfile, group, "build-ids", BUILD_ID_GROUP, package);
+    if (binary)
+        remove_keys_of_package(keyfile, group, "executables", EXECUTABLE_GROUP, binary);
+    g_free(binary);
+    (void) g_key_file_remove_group(keyfile, group, NULL);
+}
+
+/*读取二进制包的文件列表，为调试包中有调试文件的ELF文件建立build-id到文件的索引：
+*
+* ids：调试包提供的build-id；
+* 函数返回值：
+*
+* 索引到的build-id，需要调用者释放。*/
+static GPtrArray *index_executables(GKeyFile *keyfile, const char *list_path, const char *binary, GHashTable *ids) {
+    GPtrArray *found = g_ptr_array_new_with_free_func(free);
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n;
+    FILE *fp;
+
+    fp = fopen(list_path, "r");
+    if (!fp)
+        return found;
+
+    while ((n = getline(&line, &len, fp)) != -1 && found->len < g_hash_table_size(ids)) {
+        const char *value[2] = { binary, line };
+        char *id = NULL;
+        struct stat st;
+
+        if (n > 0 && line[n - 1] == '\n')
+            line[n - 1] = '\0';
+        //符号链接指向的文件会在列表中单独出现
+        if (lstat(line, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(Elf32_Ehdr))
+            continue;
+        if (!(st.st_mode & S_IXUSR) && !strstr(line, ".so"))
+            continue;
+        if (buildid_read_elf(line, &id) < 0)
+            continue;
+        if (!g_hash_table_contains(ids, id)) {
+            free(id);
+            continue;
+        }
+
+        g_key_file_set_string_list(keyfile, EXECUTABLE_GROUP, id, value, 2);
+        g_ptr_array_add(found, id);
+    }
+    free(line);
+    fclose(fp);
+    return found;
+}
+
+/*读取一个包的dpkg文件列表，把其中的调试文件加入索引：
+*
+* list_path：DPKG_INFO_PATH下的.list文件；
+* st：list_path的状态，修改时间用于下次判断是否需要重新读取；
+* binary_path：对应的二进制包的.list文件，没有时为NULL；
+* binary_st：binary_path的状态。*/
+static void index_add_package(GKeyFile *keyfile, const char *group, const char *package,
+                              const char *list_path, const struct stat *st,
+                              const char *binary_path, const struct stat *binary_st) {
+    GPtrArray *ids = g_ptr_array_new_with_free_func(free);
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n;
+    FILE *fp;
+
+    fp = fopen(list_path, "r");
+    if (fp) {
+        while ((n = getline(&line, &len, fp)) != -1) {
+            const char *value[2] = { package, line };
+            char *id;
+
+            if (n > 0 && line[n - 1] == '\n')
+                line[n - 1] = '\0';
+            id = build_id_from_path(line);
+            if (!id)
+                continue;
+
+            g_key_file_set_string_list(keyfile, BUILD_ID_GROUP, id, value, 2);
+            g_ptr_array_add(ids, id);
+        }
+        free(line);
+        fclose(fp);
+    }
+
+    g_key_file_set_int64(keyfile, group, "mtime", st->st_mtim.tv_sec);
+    g_key_file_set_int64(keyfile, group, "mtime-nsec", st->st_mtim.tv_nsec);
+    g_key_file_set_string_list(keyfile, group, "build-ids", (const gchar * const *)ids->pdata, ids->len);
+
+    if (binary_path && ids->len > 0) {
+        _cleanup_free_ char *binary = strndup(Basename(binary_path),
+                                              strlen(Basename(binary_path)) - strlen(DPKG_LIST_SUFFIX));
+        GHashTable *set = g_hash_table_new(g_str_hash, g_str_equal);
+        GPtrArray *executables;
+
+        for (unsigned i = 0; i < ids->len; i++)
+            g_hash_table_add(set, g_ptr_array_index(ids, i));
+        executables = index_executables(keyfile, binary_path, binary, set);
+
+        g_key_file_set_string(keyfile, group, "binary", binary);
+        g_key_file_set_int64(keyfile, group, "binary-mtime", binary_st->st_mtim.tv_sec);
+        g_key_file_set_int64(keyfile, group, "binary-mtime-nsec", binary_st->st_mtim.tv_nsec);
+        g_key_file_set_string_list(keyfile, group, "executables",
+                                   (const gchar * const *)executables->pdata, executables->len);
+        g_ptr_array_unref(executables);
+        g_hash_table_destroy(set);
+    }
+    g_ptr_array_unref(ids);
+}
+
+//调试包和二进制包的文件列表都没有变化
+static bool package_unchanged(GKeyFile *keyfile, const char *group, const struct stat *st,
+                              const struct stat *binary_st) {
+    if (!g_key_file_has_group(keyfile, group))
+        return false;
+    if (g_key_file_get_int64(keyfile, group, "mtime", NULL) != st->st_mtim.tv_sec ||
+        g_key_file_get_int64(keyfile, group, "mtime-nsec", NULL) != st->st_mtim.tv_nsec)
+        return false;
+    if (!binary_st)
+        return !g_key_file_has_key(keyfile, group, "binary", NULL);
+    return g_key_file_get_int64(keyfile, group, "binary-mtime", NULL) == binary_st->st_mtim.tv_sec &&
+           g_key_file_get_int64(keyfile, group, "binary-mtime-nsec", NULL) == binary_st->st_mtim.tv_nsec;
+}
+
+/*根据dpkg的文件列表更新build-id索引，只重新读取修改时间变化了的调试包，
+* 并删除已经卸载的包。索引文件通过临时文件和rename整体替换：
+*
+* rebuild：丢弃已有的索引，重新读取所有调试包。
+* 函数返回值：
+*
+* 索引有变化：返回 1；
+* 没有变化：返回 0；
+* 失败：返回 ERR_RET。*/
+int buildid_index_update(bool rebuild) {
+    GKeyFile *keyfile = g_key_file_new();
+    GHashTable *seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    gchar **groups = NULL;
+    char path[PATH_MAX] = {0};
+    struct dirent *pdirent;
+    bool changed = false;
+    int r = OK;
+    DIR *pdir;
+
+    if (rebuild ||
+        !g_key_file_load_from_file(keyfile, BUILD_ID_INDEX_PATH, G_KEY_FILE_NONE, NULL) ||
+        g_key_file_get_integer(keyfile, BUILD_ID_INDEX_GROUP, "version", NULL) != BUILD_ID_INDEX_VERSION) {
+        g_key_file_free(keyfile);
+        keyfile = g_key_file_new();
+        g_key_file_set_integer(keyfile, BUILD_ID_INDEX_GROUP, "version", BUILD_ID_INDEX_VERSION);
+        changed = true;
+    }
+
+    pdir = opendir(DPKG_INFO_PATH);
+    if (!pdir) {
+        r = ERROR;
+        fprintf(stderr, "Error: Failed to open dir %s, err: %m\n", DPKG_INFO_PATH);
+        goto out;
+    }
+
+    for (pdirent = readdir(pdir); pdirent != NULL; pdirent = readdir(pdir)) {
+        _cleanup_free_ char *package = NULL;
+        char binary_path[PATH_MAX] = {0};
+        struct stat st, binary_st;
+        bool has_binary;
+        char *group;
+
+        if (!str_endsWith(pdirent->d_name, DPKG_LIST_SUFFIX))
+            continue;
+        package = strndup(pdirent->d_name, strlen(pdirent->d_name) - strlen(DPKG_LIST_SUFFIX));
+        if (!package || !is_debug_package(package))
+            continue;
+
+        snprintf(path, PATH_MAX, "%s/%s", DPKG_INFO_PATH, pdirent->d_name);
+        if (stat(path, &st) < 0)
+            continue;
+
+        has_binary = binary_list_path(package, binary_path, PATH_MAX) && stat(binary_path, &binary_st) == 0;
+
+        group = g_strconcat(PACKAGE_GROUP_PREFIX, package, NULL);
+        g_hash_table_add(seen, group);
+        if (package_unchanged(keyfile, group, &st, has_binary ? &binary_st : NULL))
+            continue;
+
+        index_remove_package(keyfile, group, package);
+        index_add_package(keyfile, group, package, path, &st,
+                          has_binary ? binary_path : NULL, has_binary ? &binary_st : NULL);
+        changed = true;
+    }
+    closedir(pdir);
+
+    //已经卸载的包
+    groups = g_key_file_get_groups(keyfile, NULL);
+    for (gchar **group = groups; group && *group; group++) {
+        if (!g_str_has_prefix(*group, PACKAGE_GROUP_PREFIX))
+            continue;
+        if (g_hash_table_contains(seen, *group))
+            continue;
+        index_remove_package(keyfile, *group, *group + strlen(PACKAGE_GROUP_PREFIX));
+        changed = true;
+    }
+
+    //g_key_file_save_to_file先写临时文件再rename，正在查询的进程不会读到一半的索引
+    if (changed && !g_key_file_save_to_file(keyfile, BUILD_ID_INDEX_PATH, NULL)) {
+        r = ERROR;
+        fprintf(stderr, N_("Error: file %s,failed:%m\n"), BUILD_ID_INDEX_PATH);
+        goto out;
+    }
+    r = changed ? 1 : 0;
+
+out:
+    g_strfreev(groups);
+    g_hash_table_destroy(seen);
+    g_key_file_free(keyfile);
+    return r;
+}
+
+//索引文件不存在或被替换时重新加载，需要持有buildid_index锁
+static void index_reload_locked() {
+    GKeyFile *keyfile;
+    struct stat st;
+
+    if (stat(BUILD_ID_INDEX_PATH, &st) < 0) {
+        if (g_index)
+            g_key_file_free(g_index);
+        g_index = NULL;
+        return;
+    }
+    if (g_index && st.st_ino == g_index_ino &&
+        st.st_mtim.tv_sec == g_index_mtime.tv_sec && st.st_mtim.tv_nsec == g_index_mtime.tv_nsec)
+        return;
+
+    keyfile = g_key_file_new();
+    if (!g_key_file_load_from_file(keyfile, BUILD_ID_INDEX_PATH, G_KEY_FILE_NONE, NULL) ||
+        g_key_file_get_integer(keyfile, BUILD_ID_INDEX_GROUP, "version", NULL) != BUILD_ID_INDEX_VERSION) {
+        g_key_file_free(keyfile);
+        return;
+    }
+
+    if (g_index)
+        g_key_file_free(g_index);
+    g_index = keyfile;
+    g_index_ino = st.st_ino;
+    g_index_mtime = st.st_mtim;
+}
+
+static int lookup_index(const char *index_group, const char *id, char **path, char **package) {
+    gchar **value = NULL;
+    gsize n = 0;
+    int r = -ENOENT;
+
+    G_LOCK(buildid_index);
+    index_reload_locked();
+    if (g_index)
+        value = g_key_file_get_string_list(g_index, index_group, id, &n, NULL);
+    G_UNLOCK(buildid_index);
+
+    if (value && n == 2) {
+        *package = strdup(value[0]);
+        *path = strdup(value[1]);
+        r = OK;
+    }
+    g_strfreev(value);
+    return r;
+}
+
+//不在索引中的文件，返回的软件包为空字符串
+static int lookup_file(const char *file, char **path, char **package) {
+    if (access(file, F_OK) < 0)
+        return -ENOENT;
+
+    *path = strdup(file);
+    *package = strdup("");
+    return OK;
+}
+
+static int lookup(const char *build_id, bool executable, char **path, char **package) {
+    _cleanup_free_ char *id = NULL;
+    char file[PATH_MAX] = {0};
+    int r;
+
+    assert(build_id && path && package);
+
+    id = normalize_build_id(build_id);
+    if (!id)
+        return -EINVAL;
+
+    *path = *package = NULL;
+    r = lookup_index(executable ? EXECUTABLE_GROUP : BUILD_ID_GROUP, id, path, package);
+    if (r == -ENOENT) {
+        //DEBUG_BUILD_ID_PATH/ab/cdef指向可执行文件，ab/cdef.debug为调试文件
+        snprintf(file, PATH_MAX, "%s/%.2s/%s%s", DEBUG_BUILD_ID_PATH, id, id + 2,
+                 executable ? "" : DEBUG_FILE_SUFFIX);
+        r = lookup_file(file, path, package);
+    }
+    if (r == OK && (!*path || !*package)) {
+        free(*path);
+        free(*package);
+        *path = *package = NULL;
+        return -ENOMEM;
+    }
+    return r;
+}
+
+/*查找build-id对应的调试文件。先查索引，索引中没有时再检查
+* DEBUG_BUILD_ID_PATH下是否有不是由dpkg安装的文件，都不需要遍历目录：
+*
+* build_id：十六进制的build-id；
+* path：调试文件路径，需要调用者释放；
+* package：提供调试文件的软件包，不是由dpkg安装时为空字符串，需要调用者释放。
+* 函数返回值：
+*
+* 成功：返回 0；
+* build-id无效：返回 -EINVAL；
+* 没有找到：返回 -ENOENT。*/
+int buildid_lookup(const char *build_id, char **path, char **package) {
+    return lookup(build_id, false, path, package);
+}
+
+/*查找build-id对应的可执行文件或库，参数和返回值与buildid_lookup相同。
+* 只有安装了调试包的二进制包才在索引中*/
+int buildid_lookup_executable(const char *build_id, char **path, char **package) {
+    return lookup(build_id, true, path, package);
+}
@@ -0,0 +1,18 @@
+#ifndef BUILDID_H_included
+#define BUILDID_H_included 1
+#include <stdbool.h>
+#include <stddef.h>
+#include "common.h"
+
+#define DPKG_INFO_PATH "/var/lib/dpkg/info"
+#define DEBUG_BUILD_ID_PATH "/usr/lib/debug/.build-id"
+//build-id到调试文件的索引，按软件包增量更新
+#define BUILD_ID_INDEX_PATH "/var/cache/deepin-debug-config/build-id.index"
+
+int buildid_index_update(bool rebuild);
+int buildid_lookup(const char *build_id, char **path, char **package);
+int buildid_lookup_executable(const char *build_id, char **path, char **package);
+int buildid_read_elf(const char *path, char **build_id);
+int buildid_read_elf_fd(int fd, char **build_id);
+char *buildid_find_note(const void *data, size_t size, size_t align);
+#endif
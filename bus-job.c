@@ -0,0 +1,737 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "bus-service.h"
+#include "metrics.h"
+
+static const char* const job_type_table[] = {
+        [JOB_SET_DEBUG] = "SetDebug",
+        [JOB_INSTALL_DBG] = "InstallDbg",
+        [JOB_SET_COREDUMP] = "SetCoredump",
+        [JOB_REFRESH_SOURCES] = "RefreshDebugSources",
+        [JOB_INSTALL_CORE_DBG] = "InstallDbgForCore",
+        [JOB_ESTIMATE_DBG] = "EstimateDbg",
+};
+
+static const JobLaneType job_lane_table[] = {
+        [JOB_SET_DEBUG] = JOB_LANE_CONFIG,
+        [JOB_INSTALL_DBG] = JOB_LANE_PACKAGE,
+        [JOB_SET_COREDUMP] = JOB_LANE_CONFIG,
+        [JOB_REFRESH_SOURCES] = JOB_LANE_PACKAGE,
+        [JOB_INSTALL_CORE_DBG] = JOB_LANE_PACKAGE,
+        [JOB_ESTIMATE_DBG] = JOB_LANE_QUERY,
+};
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+static const char* const job_state_table[] = {
+        [JOB_WAITING] = "waiting",
+        [JOB_RUNNING] = "running",
+        [JOB_DONE] = "done",
+};
+
+const char *job_type_to_string(JobType t) {
+        return job_type_table[t];
+}
+
+static void job_item_unref(void *t_pointer) {
+        JobItem *item = t_pointer;
+        if (!item) return;
+
+        if (!g_atomic_int_dec_and_test(&item->ref))
+                return;
+
+        free(item->name);
+        free(item->level);
+        free(item);
+}
+
+static JobItem *job_item_ref(JobItem *item) {
+        g_atomic_int_inc(&item->ref);
+        return item;
+}
+
+static guint job_item_hash(gconstpointer p) {
+        const JobItem *item = p;
+        return g_str_hash(item->name) ^ item->type;
+}
+
+static gboolean job_item_equal(gconstpointer a, gconstpointer b) {
+        const JobItem *x = a, *y = b;
+        return x->type == y->type && strcmp(x->name, y->name) == 0;
+}
+
+/*工作线程开始执行一个模块前调用，把它从pending_items中移除，之后的请求不会再合并到它上面：
+*
+* 函数返回值：
+* 需要执行：返回 true；
+* 已经由之前的任务执行过，或者已经被之后的请求取代：返回 false。*/
+static bool job_item_start(Context *c, JobItem *item) {
+        bool run;
+
+        g_mutex_lock(&c->jobs_lock);
+        run = item->state == JOB_WAITING && !item->superseded;
+        if (run) {
+                item->state = JOB_RUNNING;
+                if (g_hash_table_lookup(c->pending_items, item) == item)
+                        g_hash_table_remove(c->pending_items, item);
+        }
+        g_mutex_unlock(&c->jobs_lock);
+
+        return run;
+}
+
+static void job_item_finish(Context *c, JobItem *item) {
+        g_mutex_lock(&c->jobs_lock);
+        item->state = JOB_DONE;
+        g_mutex_unlock(&c->jobs_lock);
+}
+
+static void job_notify(Context *c) {
+        uint64_t one = 1;
+
+        if (write(c->notify_fd, &one, sizeof(one)) < 0)
+                fprintf(stderr, "Failed to notify bus thread: %m\n");
+}
+
+static void job_set_progress(Job *j, JobState state, const char *current_module, bool item_done) {
+        Context *c = j->context;
+
+        g_mutex_lock(&c->jobs_lock);
+        j->state = state;
+        j->current_module = current_module;
+        if (item_done)
+                j->n_done++;
+        j->dirty = true;
+        g_mutex_unlock(&c->jobs_lock);
+
+        job_notify(c);
+}
+
+/* 在工作线程中执行，不能访问sd_bus。
+ * 共享的JobItem只会由排在最前面的任务执行，后面的任务直接使用它的结果：
+ * 同一类型的任务都在同一个单线程的队列中按顺序执行，轮到后面的任务时结果已经写好了 */
+static void job_run_set_debug(Job *j) {
+        Context *c = j->context;
+        bool changed = false;
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+
+                job_set_progress(j, JOB_RUNNING, item->name, false);
+                if (job_item_start(c, item)) {
+                        item->result = config_module_set_debug_level_by_module_name(item->name, item->level);
+                        config_module_get_property_reboot(item->name, &item->reboot);
+                        job_item_finish(c, item);
+                        changed = true;
+                }
+                job_set_progress(j, JOB_RUNNING, item->name, true);
+        }
+        if (changed)
+                config_module_check_log();
+}
+
+/* 任务中所有还没有执行过的模块一起解析，在一次apt事务中安装 */
+static void job_run_install_dbg(Job *j) {
+        Context *c = j->context;
+        GPtrArray *started = g_ptr_array_new();
+        char **names = NULL;
+        int *results = NULL;
+
+        job_set_progress(j, JOB_RUNNING, NULL, false);
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+
+                if (job_item_start(c, item))
+                        g_ptr_array_add(started, item);
+        }
+
+        names = g_new0(char *, started->len + 1);
+        results = g_new0(int, started->len + 1);
+        for (unsigned i = 0; i < started->len; i++)
+                names[i] = ((JobItem *) g_ptr_array_index(started, i))->name;
+
+        (void) config_modules_install_dbgpkgs_list(names, started->len, results);
+
+        for (unsigned i = 0; i < started->len; i++) {
+                JobItem *item = g_ptr_array_index(started, i);
+
+                item->result = results[i];
+                job_item_finish(c, item);
+        }
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+                job_set_progress(j, JOB_RUNNING, item->name, true);
+        }
+
+        g_free(names);
+        g_free(results);
+        g_ptr_array_unref(started);
+}
+
+static void job_run_set_coredump(Job *j) {
+        Context *c = j->context;
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+
+                job_set_progress(j, JOB_RUNNING, item->name, false);
+                if (job_item_start(c, item)) {
+                        item->result = config_system_coredump(strcmp(item->level, "on") == 0);
+                        job_item_finish(c, item);
+                }
+                job_set_progress(j, JOB_RUNNING, item->name, true);
+        }
+}
+
+/* 与InstallDbg在同一个队列中执行，不会和安装同时运行apt */
+static void job_run_refresh_sources(Job *j) {
+        Context *c = j->context;
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+
+                job_set_progress(j, JOB_RUNNING, item->name, false);
+                if (job_item_start(c, item)) {
+                        item->result = config_refresh_dbg_sources(item->level != NULL);
+                        job_item_finish(c, item);
+                }
+                job_set_progress(j, JOB_RUNNING, item->name, true);
+        }
+}
+
+/* 每一项是DEFAULT_CORE_PATH下的一个core文件名 */
+static void job_run_install_core_dbg(Job *j) {
+        Context *c = j->context;
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+
+                job_set_progress(j, JOB_RUNNING, item->name, false);
+                if (job_item_start(c, item)) {
+                        item->result = config_core_install_dbgpkgs(item->name);
+                        job_item_finish(c, item);
+                }
+                job_set_progress(j, JOB_RUNNING, item->name, true);
+        }
+}
+
+/* 所有模块一起估算，结果只属于这个任务，所以估算的任务不与其它任务合并 */
+static void job_run_estimate_dbg(Job *j) {
+        Context *c = j->context;
+        char **names;
+        int r;
+
+        job_set_progress(j, JOB_RUNNING, NULL, false);
+
+        names = g_new0(char *, j->items->len + 1);
+        for (unsigned i = 0; i < j->items->len; i++)
+                names[i] = ((JobItem *) g_ptr_array_index(j->items, i))->name;
+
+        r = config_modules_estimate_dbgpkgs(names, j->items->len, &j->estimate);
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+
+                item->result = r;
+                job_item_finish(c, item);
+                job_set_progress(j, JOB_RUNNING, item->name, true);
+        }
+        g_free(names);
+}
+
+/*按队列的设置调整当前工作线程的CPU和IO优先级，线程启动的子进程（apt等）也会继承。
+* 每个队列使用独占的线程，所以每个线程只需要设置一次。*/
+static void job_lane_setup_thread(JobLane *lane) {
+        static __thread bool configured = false;
+        pid_t tid;
+
+        if (configured)
+                return;
+        configured = true;
+
+        tid = (pid_t) syscall(SYS_gettid);
+
+        if (lane->nice != 0 && setpriority(PRIO_PROCESS, tid, lane->nice) < 0)
+                fprintf(stderr, "Failed to set nice of worker: %m\n");
+
+        if (lane->idle_io &&
+            syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0)
+                fprintf(stderr, "Failed to set io priority of worker: %m\n");
+}
+
+static void job_run(gpointer data, gpointer user_data) {
+        Job *j = data;
+        JobLane *lane = user_data;
+        Context *c = j->context;
+        int result = OK;
+
+        job_lane_setup_thread(lane);
+
+        switch (j->type) {
+        case JOB_SET_DEBUG:
+                job_run_set_debug(j);
+                break;
+        case JOB_INSTALL_DBG:
+                job_run_install_dbg(j);
+                break;
+        case JOB_SET_COREDUMP:
+                job_run_set_coredump(j);
+                break;
+        case JOB_REFRESH_SOURCES:
+                job_run_refresh_sources(j);
+                break;
+        case JOB_INSTALL_CORE_DBG:
+                job_run_install_core_dbg(j);
+                break;
+        case JOB_ESTIMATE_DBG:
+                job_run_estimate_dbg(j);
+                break;
+        }
+
+        /* 被取代的模块不计入结果，全部被取代时整个任务的结果为 -ECANCELED */
+        g_mutex_lock(&c->jobs_lock);
+        result = j->items->len > 0 ? -ECANCELED : OK;
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+
+                if (item->superseded)
+                        continue;
+                if (result == OK || result == -ECANCELED)
+                        result = item->result;
+        }
+        j->result = result;
+        g_mutex_unlock(&c->jobs_lock);
+
+        job_set_progress(j, JOB_DONE, NULL, false);
+        g_async_queue_push(c->finished_jobs, j);
+        job_notify(c);
+}
+
+static int property_job_id(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        Job *j = userdata;
+        return sd_bus_message_append(reply, "u", j->id);
+}
+
+static int property_job_type(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        Job *j = userdata;
+        return sd_bus_message_append(reply, "s", job_type_to_string(j->type));
+}
+
+static int property_job_state(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        Job *j = userdata;
+        JobState state;
+
+        g_mutex_lock(&j->context->jobs_lock);
+        state = j->state;
+        g_mutex_unlock(&j->context->jobs_lock);
+
+        return sd_bus_message_append(reply, "s", job_state_table[state]);
+}
+
+static int property_job_progress(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        Job *j = userdata;
+        double progress;
+
+        g_mutex_lock(&j->context->jobs_lock);
+        progress = j->items->len ? (double)j->n_done / j->items->len : 1.0;
+        g_mutex_unlock(&j->context->jobs_lock);
+
+        return sd_bus_message_append(reply, "d", progress);
+}
+
+static int property_job_current_module(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        Job *j = userdata;
+        int r;
+
+        g_mutex_lock(&j->context->jobs_lock);
+        r = sd_bus_message_append(reply, "s", j->current_module ? j->current_module : "");
+        g_mutex_unlock(&j->context->jobs_lock);
+
+        return r;
+}
+
+static const sd_bus_vtable job_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Id", "u", property_job_id, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("JobType", "s", property_job_type, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("State", "s", property_job_state, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Progress", "d", property_job_progress, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("CurrentModule", "s", property_job_current_module, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_VTABLE_END
+};
+
+Job *job_new(Context *c, JobType type) {
+        Job *j;
+
+        assert(c);
+
+        j = malloc(sizeof(Job));
+        if (!j)
+                return NULL;
+        memset(j, 0, sizeof(Job));
+
+        j->context = c;
+        j->type = type;
+        j->state = JOB_WAITING;
+        j->start_usec = metrics_now_usec();
+        j->items = g_ptr_array_new_with_free_func(job_item_unref);
+        return j;
+}
+
+int job_add_item(Job *j, const char *name, const char *level) {
+        JobItem *item;
+
+        assert(j && name);
+
+        item = malloc(sizeof(JobItem));
+        if (!item)
+                return -ENOMEM;
+        memset(item, 0, sizeof(JobItem));
+
+        item->ref = 1;
+        item->type = j->type;
+        item->state = JOB_WAITING;
+        item->name = strdup(name);
+        item->level = level ? strdup(level) : NULL;
+        if (!item->name || (level && !item->level)) {
+                job_item_unref(item);
+                return -ENOMEM;
+        }
+        g_ptr_array_add(j->items, item);
+        return 0;
+}
+
+void job_free(Job *j) {
+        if (!j)
+                return;
+
+        if (j->id > 0)
+                g_hash_table_remove(j->context->jobs, GUINT_TO_POINTER(j->id));
+        sd_bus_slot_unref(j->slot);
+        sd_bus_message_unref(j->message);
+        g_ptr_array_unref(j->items);
+        g_free(j->path);
+        free(j);
+}
+
+static bool job_has_item(GPtrArray *items, JobItem *item) {
+        for (unsigned i = 0; i < items->len; i++)
+                if (g_ptr_array_index(items, i) == item)
+                        return true;
+        return false;
+}
+
+/* 设置等级的请求必须按顺序执行，合并到更早的JobItem上会让它越过中间的任务 */
+static bool job_type_is_ordered(JobType type) {
+        return type == JOB_SET_DEBUG || type == JOB_SET_COREDUMP;
+}
+
+/*设置等级的请求只有在等级相同、并且是同一队列中紧挨着的上一个任务时才能合并：
+* 中间没有别的设置，执行顺序不变，上一个任务报告的结果也仍然是它请求的等级。
+* 队列中的上一个任务按队列记录，其它队列的任务不影响合并*/
+static bool job_item_can_merge(JobLane *lane, JobItem *pending, JobItem *item) {
+        if (!job_type_is_ordered(item->type))
+                return true;
+        return pending->last_job_id == lane->last_job_id && g_strcmp0(pending->level, item->level) == 0;
+}
+
+/*把任务中的模块与还未开始执行的同类请求合并，同一模块只执行一次。
+* 安装调试包等请求总是可以合并；设置等级的请求见job_item_can_merge，
+* 不能合并时旧的JobItem被标记为取代，不再执行，最后的请求生效，新的JobItem
+* 登记在pending_items中。被取代的JobItem保存在superseded中，入队失败时恢复。
+* 调用者持有jobs_lock。
+*
+* 函数返回值：
+* 无*/
+static void job_coalesce_items_locked(Job *j, GPtrArray *superseded) {
+        Context *c = j->context;
+        JobLane *lane = &c->lanes[job_lane_table[j->type]];
+        GPtrArray *items;
+
+        if (j->type == JOB_ESTIMATE_DBG)
+                return;
+
+        items = g_ptr_array_new_full(j->items->len, job_item_unref);
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+                JobItem *pending;
+
+                pending = g_hash_table_lookup(c->pending_items, item);
+                if (!pending || !job_item_can_merge(lane, pending, item)) {
+                        if (pending) {
+                                pending->superseded = true;
+                                g_ptr_array_add(superseded, job_item_ref(pending));
+                        }
+                        item->last_job_id = j->id;
+                        g_hash_table_add(c->pending_items, job_item_ref(item));
+                        g_ptr_array_add(items, job_item_ref(item));
+                        continue;
+                }
+                pending->last_job_id = j->id;
+
+                /* 后来的请求覆盖还未执行的等级 */
+                if (item->level && (!pending->level || strcmp(pending->level, item->level) != 0)) {
+                        free(pending->level);
+                        pending->level = item->level;
+                        item->level = NULL;
+                }
+                if (!job_has_item(items, pending))
+                        g_ptr_array_add(items, job_item_ref(pending));
+        }
+
+        g_ptr_array_unref(j->items);
+        j->items = items;
+}
+
+/* 入队失败时撤销job_coalesce_items_locked的修改，被这个任务取代的JobItem重新登记 */
+static void job_forget_items_locked(Job *j, GPtrArray *superseded) {
+        Context *c = j->context;
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+                if (item->state == JOB_WAITING && g_hash_table_lookup(c->pending_items, item) == item)
+                        g_hash_table_remove(c->pending_items, item);
+        }
+        for (unsigned i = 0; i < superseded->len; i++) {
+                JobItem *item = g_ptr_array_index(superseded, i);
+
+                item->superseded = false;
+                if (!g_hash_table_contains(c->pending_items, item))
+                        g_hash_table_add(c->pending_items, job_item_ref(item));
+        }
+}
+
+/*把任务导出到bus上并交给工作线程执行：
+*
+* 函数返回值：
+* 成功：返回 0，任务的对象路径保存在j->path；
+* 失败：返回负的错误码，调用者负责释放j。*/
+int job_enqueue(Job *j, sd_bus_error *error) {
+        Context *c = j->context;
+        JobLane *lane = &c->lanes[job_lane_table[j->type]];
+        GPtrArray *superseded;
+        GError *gerror = NULL;
+        int r;
+
+        if (g_thread_pool_unprocessed(lane->pool) >= lane->max_waiting)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_LIMITS_EXCEEDED,
+                                         "Too many pending %s requests, try again later", job_type_to_string(j->type));
+
+        j->path = g_strdup_printf(DEBUG_CONFIG_JOB_PATH "/%u", c->last_job_id + 1);
+
+        r = sd_bus_add_object_vtable(c->bus, &j->slot, j->path, DEBUG_CONFIG_JOB_INTERFACE, job_vtable, j);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Failed to export job: %s", strerror(-r));
+        j->id = ++c->last_job_id;
+        g_hash_table_insert(c->jobs, GUINT_TO_POINTER(j->id), j);
+
+        superseded = g_ptr_array_new_with_free_func(job_item_unref);
+        g_mutex_lock(&c->jobs_lock);
+        job_coalesce_items_locked(j, superseded);
+        g_mutex_unlock(&c->jobs_lock);
+
+        if (!g_thread_pool_push(lane->pool, j, &gerror)) {
+                g_mutex_lock(&c->jobs_lock);
+                job_forget_items_locked(j, superseded);
+                g_mutex_unlock(&c->jobs_lock);
+                g_ptr_array_unref(superseded);
+                r = sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Failed to start job: %s", gerror->message);
+                g_error_free(gerror);
+                return r;
+        }
+
+        g_ptr_array_unref(superseded);
+        lane->last_job_id = j->id;
+
+        (void) sd_bus_emit_object_added(c->bus, j->path);
+        (void) sd_bus_emit_signal(c->bus, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_DBUS_INTERFACE,
+                                  "JobNew", "uos", j->id, j->path, job_type_to_string(j->type));
+        return 0;
+}
+
+static int job_emit_removed(Job *j) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        Context *c = j->context;
+        int r;
+
+        r = sd_bus_message_new_signal(c->bus, &m, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_DBUS_INTERFACE, "JobRemoved");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(m, "uoss", j->id, j->path, job_type_to_string(j->type),
+                                  j->result == OK ? "done" : j->result == -ECANCELED ? "superseded" : "failed");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(m, 'a', "{ss}");
+        if (r < 0)
+                return r;
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+                const char *res = item->superseded ? "superseded" :
+                                  item->result != OK ? "fail" : (item->reboot ? "reboot" : "success");
+
+                r = sd_bus_message_append(m, "{ss}", item->name, res);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(c->bus, m, NULL);
+}
+
+static void job_emit_changed(gpointer key, gpointer value, gpointer user_data) {
+        Job *j = value;
+        bool dirty;
+
+        g_mutex_lock(&j->context->jobs_lock);
+        dirty = j->dirty;
+        j->dirty = false;
+        g_mutex_unlock(&j->context->jobs_lock);
+
+        if (dirty)
+                (void) sd_bus_emit_properties_changed(j->context->bus, j->path, DEBUG_CONFIG_JOB_INTERFACE,
+                                                      "State", "Progress", "CurrentModule", NULL);
+}
+
+/*在bus线程中处理工作线程发来的通知：发送进度变化，为执行完的任务收尾。
+*
+* 函数返回值：
+* 处理了至少一个已完成的任务：返回 1；
+* 否则返回 0。*/
+int job_manager_dispatch(Context *c) {
+        uint64_t value;
+        Job *j;
+        int r = 0;
+
+        if (read(c->notify_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+                fprintf(stderr, "Failed to read job notification: %m\n");
+
+        g_hash_table_foreach(c->jobs, job_emit_changed, NULL);
+
+        while ((j = g_async_queue_try_pop(c->finished_jobs))) {
+                metrics_observe_since(METRICS_METHOD, job_type_to_string(j->type), j->start_usec, j->result < 0);
+                context_job_finished(c, j);
+                job_emit_removed(j);
+                (void) sd_bus_emit_object_removed(c->bus, j->path);
+                job_free(j);
+                r = 1;
+        }
+        if (r > 0) {
+                metrics_dump(c);
+                module_objects_reload_if_pending(c);
+        }
+        return r;
+}
+
+static int on_job_notify(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        job_manager_dispatch(userdata);
+        return 0;
+}
+
+int job_manager_init(Context *c) {
+        GError *gerror = NULL;
+        int r;
+
+        assert(c);
+        assert(c->event);
+
+        c->notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (c->notify_fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(c->event, &c->notify_source, c->notify_fd, EPOLLIN, on_job_notify, c);
+        if (r < 0)
+                return r;
+
+        g_mutex_init(&c->jobs_lock);
+        c->jobs = g_hash_table_new(g_direct_hash, g_direct_equal);
+        c->finished_jobs = g_async_queue_new();
+        c->pending_items = g_hash_table_new_full(job_item_hash, job_item_equal, job_item_unref, NULL);
+
+        c->lanes[JOB_LANE_CONFIG] = (JobLane) {
+                .type = JOB_LANE_CONFIG,
+                .max_waiting = JOB_LANE_CONFIG_MAX_WAITING,
+        };
+        c->lanes[JOB_LANE_PACKAGE] = (JobLane) {
+                .type = JOB_LANE_PACKAGE,
+                .max_waiting = JOB_LANE_PACKAGE_MAX_WAITING,
+                .nice = JOB_LANE_PACKAGE_NICE,
+                .idle_io = true,
+        };
+        c->lanes[JOB_LANE_QUERY] = (JobLane) {
+                .type = JOB_LANE_QUERY,
+                .max_waiting = JOB_LANE_QUERY_MAX_WAITING,
+                .nice = JOB_LANE_PACKAGE_NICE,
+                .idle_io = true,
+        };
+
+        /* 模块配置库不支持并发修改同一个配置文件，所以每个队列只有一个线程，任务按顺序逐个执行。
+         * 线程是独占的，不会和其它队列共用，这样各自设置的优先级不会互相影响 */
+        for (int i = 0; i < _JOB_LANE_MAX; i++) {
+                c->lanes[i].pool = g_thread_pool_new(job_run, &c->lanes[i], 1, TRUE, &gerror);
+                if (!c->lanes[i].pool) {
+                        fprintf(stderr, "Failed to create worker pool: %s\n", gerror->message);
+                        g_error_free(gerror);
+                        return -ENOMEM;
+                }
+        }
+        return 0;
+}
+
+void job_manager_done(Context *c) {
+        GHashTableIter iter;
+        Job *j;
+
+        assert(c);
+
+        /* 丢弃还未开始的任务，等待正在执行的任务结束 */
+        for (int i = 0; i < _JOB_LANE_MAX; i++) {
+                if (c->lanes[i].pool)
+                        g_thread_pool_free(c->lanes[i].pool, TRUE, TRUE);
+                c->lanes[i].pool = NULL;
+        }
+
+        if (c->pending_items) {
+                g_hash_table_destroy(c->pending_items);
+                c->pending_items = NULL;
+        }
+
+        if (c->finished_jobs) {
+                g_async_queue_unref(c->finished_jobs);
+                c->finished_jobs = NULL;
+        }
+
+        if (c->jobs) {
+                g_hash_table_iter_init(&iter, c->jobs);
+                while (g_hash_table_iter_next(&iter, NULL, (void **)&j)) {
+                        g_hash_table_iter_steal(&iter);
+                        j->id = 0;
+                        job_free(j);
+                }
+                g_hash_table_destroy(c->jobs);
+                c->jobs = NULL;
+        }
+
+        c->notify_source = sd_event_source_unref(c->notify_source);
+        if (c->notify_fd >= 0)
+                close(c->notify_fd);
+        c->notify_fd = -1;
+}
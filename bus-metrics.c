@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+
+#include "bus-service.h"
+#include "metrics.h"
+
+typedef struct HistogramReply {
+        sd_bus_message *reply;
+        int r;
+} HistogramReply;
+
+static void append_histogram(const metrics_histogram *h, void *userdata) {
+        HistogramReply *hr = userdata;
+        int r;
+
+        if (hr->r < 0)
+                return;
+
+        r = sd_bus_message_open_container(hr->reply, 'r', "sstttat");
+        if (r < 0)
+                goto fail;
+
+        r = sd_bus_message_append(hr->reply, "sstt", metrics_family_to_string(h->family), h->label, h->count, h->errors);
+        if (r < 0)
+                goto fail;
+
+        r = sd_bus_message_append(hr->reply, "t", h->sum_usec);
+        if (r < 0)
+                goto fail;
+
+        r = sd_bus_message_append_array(hr->reply, 't', h->buckets, sizeof(h->buckets));
+        if (r < 0)
+                goto fail;
+
+        r = sd_bus_message_close_container(hr->reply);
+        if (r < 0)
+                goto fail;
+        return;
+fail:
+        hr->r = r;
+}
+
+/* 返回所有直方图：(类别, 名称, 次数, 失败次数, 总耗时(微秒), 各个桶的次数) */
+static int method_get_histograms(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        HistogramReply hr = { NULL, 0 };
+        int r;
+
+        r = sd_bus_message_new_method_return(m, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sstttat)");
+        if (r < 0)
+                return r;
+
+        hr.reply = reply;
+        metrics_foreach(append_histogram, &hr);
+        if (hr.r < 0)
+                return hr.r;
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int property_bucket_bounds(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        uint64_t bounds[METRICS_BUCKETS];
+
+        for (int i = 0; i < METRICS_BUCKETS; i++)
+                bounds[i] = metrics_bucket_bound_usec(i);
+
+        return sd_bus_message_append_array(reply, 't', bounds, sizeof(bounds));
+}
+
+static const sd_bus_vtable metrics_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("GetHistograms", NULL, "a(sstttat)", method_get_histograms, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_PROPERTY("BucketBounds", "at", property_bucket_bounds, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_VTABLE_END
+};
+
+/* 把统计数据写到Prometheus textfile，失败不影响服务 */
+void metrics_dump(Context *c) {
+        (void) metrics_write_textfile(METRICS_TEXTFILE_PATH);
+}
+
+int metrics_objects_init(Context *c) {
+        assert(c);
+
+        return sd_bus_add_object_vtable(c->bus, NULL, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_METRICS_INTERFACE, metrics_vtable, c);
+}
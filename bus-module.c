@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <sys/inotify.h>
+
+#include "bus-service.h"
+
+/* 安装或升级软件包时会连续修改多个描述文件，等目录安静一段时间后再重新加载 */
+#define REGISTRY_RELOAD_DELAY_USEC (USEC_PER_SEC / 2)
+
+typedef struct PropertyReply {
+        sd_bus_message *reply;
+        const char *property;
+        int r;
+} PropertyReply;
+
+static void append_module_property(const module_state *state, void *userdata) {
+        PropertyReply *pr = userdata;
+
+        if (strcmp(pr->property, "Level") == 0)
+                pr->r = sd_bus_message_append(pr->reply, "s", state->level ? state->level : "");
+        else if (strcmp(pr->property, "Group") == 0)
+                pr->r = sd_bus_message_append(pr->reply, "s", state->type ? state->type : "");
+        else if (strcmp(pr->property, "NeedsReboot") == 0)
+                pr->r = sd_bus_message_append(pr->reply, "b", state->reboot != 0);
+        else if (strcmp(pr->property, "LastChanged") == 0)
+                pr->r = sd_bus_message_append(pr->reply, "t", state->last_changed);
+        else
+                pr->r = -EINVAL;
+}
+
+static int property_module_name(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        return sd_bus_message_append(reply, "s", (const char *)userdata);
+}
+
+static int property_module(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        const char *name = userdata;
+        PropertyReply pr = { reply, property, 0 };
+        int r;
+
+        r = config_module_get_state(name, append_module_property, &pr);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "error get module %s,ret=%d", name, r);
+        return pr.r;
+}
+
+static const sd_bus_vtable module_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Name", "s", property_module_name, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("Level", "s", property_module, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Group", "s", property_module, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("NeedsReboot", "b", property_module, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("LastChanged", "t", property_module, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_VTABLE_END
+};
+
+/* 模块名中可能包含'.'、'-'等不能出现在对象路径中的字符，所以用sd_bus_path_encode转义 */
+static int module_object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
+        _cleanup_free_ char *name = NULL;
+        const char *module;
+        int r;
+
+        r = sd_bus_path_decode(path, DEBUG_CONFIG_MODULES_PATH, &name);
+        if (r <= 0)
+                return r;
+
+        module = config_module_lookup_name(name);
+        if (!module)
+                return 0;
+
+        *found = (void *)module;
+        return 1;
+}
+
+static int module_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
+        _cleanup_strv_free_ char **names = NULL;
+        char **l = NULL;
+        unsigned n = 0;
+        int r;
+
+        names = get_module_names();
+        if (!names) {
+                *nodes = NULL;
+                return 0;
+        }
+
+        for (char **name = names; *name; name++)
+                n++;
+
+        l = malloc(sizeof(char *) * (n + 1));
+        if (!l)
+                return -ENOMEM;
+        memset(l, 0, sizeof(char *) * (n + 1));
+
+        for (unsigned i = 0; i < n; i++) {
+                r = sd_bus_path_encode(DEBUG_CONFIG_MODULES_PATH, names[i], &l[i]);
+                if (r < 0) {
+                        strv_free(l);
+                        return r;
+                }
+        }
+
+        *nodes = l;
+        return 1;
+}
+
+static void emit_module_changed(const module_state *state, void *userdata) {
+        Context *c = userdata;
+        _cleanup_free_ char *path = NULL;
+
+        if (sd_bus_path_encode(DEBUG_CONFIG_MODULES_PATH, state->name, &path) < 0)
+                return;
+
+        (void) sd_bus_emit_properties_changed(c->bus, path, DEBUG_CONFIG_MODULE_INTERFACE, "Level", "LastChanged", NULL);
+}
+
+/* 为上次通知之后调试等级发生过变化的模块发送PropertiesChanged */
+int module_objects_emit_changes(Context *c) {
+        uint64_t generation = 0;
+        int r;
+
+        assert(c);
+
+        r = config_modules_foreach_state(c->emitted_generation, emit_module_changed, c, &generation);
+        if (r < 0)
+                return r;
+
+        c->emitted_generation = generation;
+        return 0;
+}
+
+int module_objects_init(Context *c) {
+        int r;
+
+        assert(c);
+
+        r = sd_bus_add_object_manager(c->bus, NULL, DEBUG_CONFIG_DBUS_PATH);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_add_fallback_vtable(c->bus, NULL, DEBUG_CONFIG_MODULES_PATH, DEBUG_CONFIG_MODULE_INTERFACE, module_vtable, module_object_find, c);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_add_node_enumerator(c->bus, NULL, DEBUG_CONFIG_MODULES_PATH, module_node_enumerator, c);
+        if (r < 0)
+                return r;
+
+        /* 启动时的状态不需要通知，只通知之后的变化 */
+        return config_modules_get_generation(&c->emitted_generation);
+}
+
+static GHashTable *module_name_set(void) {
+        GHashTable *set;
+        char **names;
+
+        set = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+        names = get_module_names();
+        for (char **name = names; name && *name; name++)
+                g_hash_table_add(set, *name);
+        /* 字符串已经交给set管理，只释放数组 */
+        free(names);
+        return set;
+}
+
+static void emit_modules_diff(Context *c, GHashTable *from, GHashTable *to, bool added) {
+        GHashTableIter iter;
+        const char *name;
+
+        g_hash_table_iter_init(&iter, to);
+        while (g_hash_table_iter_next(&iter, (void **)&name, NULL)) {
+                _cleanup_free_ char *path = NULL;
+
+                if (g_hash_table_contains(from, name))
+                        continue;
+                if (sd_bus_path_encode(DEBUG_CONFIG_MODULES_PATH, name, &path) < 0)
+                        continue;
+
+                if (added)
+                        (void) sd_bus_emit_interfaces_added(c->bus, path, DEBUG_CONFIG_MODULE_INTERFACE, NULL);
+                else
+                        (void) sd_bus_emit_interfaces_removed(c->bus, path, DEBUG_CONFIG_MODULE_INTERFACE, NULL);
+        }
+}
+
+/*重新加载模块描述目录，并为增加和删除的模块发送InterfacesAdded/InterfacesRemoved。
+* 工作线程会读取模块配置，所以只在没有任务时重新加载，否则等任务结束后再试：
+*
+* 函数返回值：
+* 已重新加载：返回 1；
+* 推迟：返回 0；
+* 失败：返回负的错误码。*/
+static int module_objects_reload(Context *c) {
+        GHashTable *before, *after;
+        int r;
+
+        if (g_hash_table_size(c->jobs) > 0) {
+                c->registry_reload_pending = true;
+                return 0;
+        }
+        c->registry_reload_pending = false;
+
+        before = module_name_set();
+        r = reload_module_cfgs(MODULES_DEBUG_CONFIG_PATH);
+        if (r < 0) {
+                g_hash_table_destroy(before);
+                fprintf(stderr, "Failed to reload %s: %d\n", MODULES_DEBUG_CONFIG_PATH, r);
+                return r;
+        }
+        after = module_name_set();
+
+        emit_modules_diff(c, after, before, false);
+        emit_modules_diff(c, before, after, true);
+
+        g_hash_table_destroy(before);
+        g_hash_table_destroy(after);
+        return 1;
+}
+
+static int on_registry_reload(sd_event_source *s, uint64_t usec, void *userdata) {
+        (void) module_objects_reload(userdata);
+        return 0;
+}
+
+static int on_registry_changed(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Context *c = userdata;
+        uint64_t now;
+        int r;
+
+        r = sd_event_now(c->event, CLOCK_MONOTONIC, &now);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_time(c->registry_reload_source, now + REGISTRY_RELOAD_DELAY_USEC);
+        if (r < 0)
+                return r;
+
+        return sd_event_source_set_enabled(c->registry_reload_source, SD_EVENT_ONESHOT);
+}
+
+/* 任务都结束后，执行之前被推迟的重新加载 */
+void module_objects_reload_if_pending(Context *c) {
+        if (c->registry_reload_pending)
+                (void) module_objects_reload(c);
+}
+
+int module_objects_watch(Context *c) {
+        int r;
+
+        assert(c);
+
+        r = sd_event_add_time(c->event, &c->registry_reload_source, CLOCK_MONOTONIC, UINT64_MAX, 0, on_registry_reload, c);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_enabled(c->registry_reload_source, SD_EVENT_OFF);
+        if (r < 0)
+                return r;
+
+        return sd_event_add_inotify(c->event, &c->registry_watch_source, MODULES_DEBUG_CONFIG_PATH,
+                                    IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB,
+                                    on_registry_changed, c);
+}
+
+static int on_levels_changed(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Context *c = userdata;
+        _cleanup_free_ char *name = g_path_get_basename(MODULES_DEBUG_LEVELS_PATH);
+
+        if (!(event->mask & IN_Q_OVERFLOW) && (event->len == 0 || strcmp(event->name, name) != 0))
+                return 0;
+
+        (void) module_objects_emit_changes(c);
+        return 0;
+}
+
+/*命令行在本进程中修改调试等级时（服务不可用或设置了DEEPIN_DEBUG_CONFIG_NO_BUS），
+* 只会写调试等级文件。监视文件所在的目录，文件被替换或删除后发送PropertiesChanged：
+*
+* 函数返回值：
+* 成功：返回 0；
+* 失败：返回负的错误码。*/
+int module_objects_watch_levels(Context *c) {
+        _cleanup_free_ char *dir = g_path_get_dirname(MODULES_DEBUG_LEVELS_PATH);
+
+        assert(c);
+
+        /* 文件是写到临时文件后rename过来的，目录要先存在才能监视 */
+        if (g_mkdir_with_parents(dir, 0755) < 0)
+                return -errno;
+
+        return sd_event_add_inotify(c->event, &c->levels_watch_source, dir,
+                                    IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE,
+                                    on_levels_changed, c);
+}
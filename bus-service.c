@@ -3,24 +3,24 @@
 #include <errno.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <signal.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-#include <systemd/sd-bus.h>
-#include <systemd/sd-event.h>
-#include <systemd/sd-daemon.h>
+#include "bus-service.h"
+#include "metrics.h"
+#include "buildid.h"
 
-#include "util.h"
-#include "module_configure.h"
-
-typedef uint64_t usec_t;
 typedef bool (*check_idle_t)(void *userdata);
 
-#define NO_EXIT_TIMEOUT UINT64_MAX
-
-#define DEBUG_CONFIG_DBUS_NAME  "org.deepin.DebugConfig"
-#define DEBUG_CONFIG_DBUS_INTERFACE  "org.deepin.DebugConfig"
-#define DEBUG_CONFIG_DBUS_PATH  "/org/deepin/DebugConfig"
+/* 等待用户在polkit对话框中完成认证的最长时间 */
+#define POLKIT_AUTH_TIMEOUT_USEC (120ULL * USEC_PER_SEC)
+/* 授权缓存的有效期，不超过polkit临时授权默认的5分钟，临时授权被提前撤销时
+ * polkit发出的Changed信号会清空缓存 */
+#define POLKIT_AUTH_CACHE_USEC (60ULL * USEC_PER_SEC)
 
 #define STAT_FILE "/proc/self/stat"
 // #define ACTION_ID "com.deepin.daemon.accounts.user-administration"
@@ -34,16 +34,18 @@ typedef bool (*check_idle_t)(void *userdata);
                 _ptr_;                          \
         })
 
-typedef struct Context {
-        sd_bus *bus;
-        char *debug_level;
-} Context;
-
 typedef struct MethodResult {
         char *method_name;
         char *method_res;
 } MethodResult;
 
+usec_t now_usec(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (usec_t)ts.tv_sec * USEC_PER_SEC + (usec_t)ts.tv_nsec / 1000;
+}
+
 //d-bus safe
 void print_sd_bus_error(const sd_bus_error *error) {
     if (error) {
@@ -90,22 +92,92 @@ uint64_t get_process_starttime() {
 }
 
 
-int interactive_permission_check(sd_bus *bus, const char *action, const char **details, const char *caller) {  // pid_t mpid, uid_t muid, uint64_t mtime
+typedef int (*authorized_method_t)(sd_bus_message *m, Context *c, sd_bus_error *error);
+
+/* 等待polkit应答时被挂起的方法调用 */
+typedef struct PendingAuth {
+        Context *context;
+        sd_bus_message *message;
+        sd_bus_slot *slot;
+        const char *action;
+        authorized_method_t handler;
+        uint64_t start_usec;
+} PendingAuth;
+
+/* 授权缓存：sender -> (action -> 过期时间)，只缓存polkit保留了临时授权的结果 */
+static bool auth_cache_lookup(Context *c, const char *sender, const char *action) {
+        GHashTable *actions;
+        usec_t *until;
+
+        actions = g_hash_table_lookup(c->auth_cache, sender);
+        if (!actions)
+                return false;
+
+        until = g_hash_table_lookup(actions, action);
+        if (!until)
+                return false;
+
+        if (*until > now_usec())
+                return true;
+
+        g_hash_table_remove(actions, action);
+        return false;
+}
+
+static void auth_cache_add(Context *c, const char *sender, const char *action, usec_t until_usec) {
+        GHashTable *actions;
+        usec_t *until;
+
+        actions = g_hash_table_lookup(c->auth_cache, sender);
+        if (!actions) {
+                actions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+                g_hash_table_insert(c->auth_cache, g_strdup(sender), actions);
+        }
+
+        until = g_new(usec_t, 1);
+        *until = until_usec;
+        g_hash_table_replace(actions, g_strdup(action), until);
+}
+
+/* 临时授权被撤销或授权规则变化时polkit会发出Changed信号，清空整个缓存 */
+static int match_polkit_changed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        Context *c = userdata;
+
+        g_hash_table_remove_all(c->auth_cache);
+        return 0;
+}
+
+/* 调用者从bus上断开后，它的unique name不会再被复用，删除对应的缓存 */
+static int match_name_owner_changed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        Context *c = userdata;
+        const char *name, *old_owner, *new_owner;
+        int r;
+
+        r = sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner);
+        if (r < 0)
+                return 0;
+
+        if (isempty(new_owner) && !isempty(old_owner))
+                g_hash_table_remove(c->auth_cache, old_owner);
+        return 0;
+}
+
+static void pending_auth_free(PendingAuth *p) {
+        if (!p)
+                return;
+
+        if (p->context)
+                g_hash_table_remove(p->context->pending_auths, p);
+        sd_bus_slot_unref(p->slot);
+        sd_bus_message_unref(p->message);
+        free(p);
+}
+
+static int new_check_authorization(sd_bus *bus, sd_bus_message **ret, const char *action, const char *caller) {  // pid_t mpid, uid_t muid, uint64_t mtime
     sd_bus_message *request = NULL;
-    sd_bus_message *reply = NULL;
-    sd_bus_error error = SD_BUS_ERROR_NULL;
-    int challenge ;
-    int authorized ;
     int r;
 
-//     const char *unique_name;
-//     uint64_t start_time_uint64 = mtime;
-//     pid_t pid = mpid;
-//     uid_t uid = muid;
-//     int32_t uid_as_int32 = (int32_t)uid;
-//     uint32_t pid_as_uint32 = (uint32_t)pid;
-
-    assert(action);
+    assert(action && ret);
 
     r = sd_bus_message_new_method_call(bus,
                                         &request,
@@ -117,47 +189,48 @@ int interactive_permission_check(sd_bus *bus, const char *action, const char **d
         return r;
     }
 
-//     r = sd_bus_get_unique_name(bus, &unique_name);
-//     if (r < 0) {
-//         fprintf(stderr, "Failed to get unique name: %s\n", strerror(-r));
-//         return EXIT_FAILURE;
-//     }
-    // Append parameters to the method call
-//     r = sd_bus_message_append(request,
-//                               "(sa{sv})s",
-//                               "unix-process", 3, "pid", "u", pid_as_uint32,"start-time", "t", start_time_uint64, "uid", "i", uid_as_int32,
-//                               action);
-
     r = sd_bus_message_append(request,
                               "(sa{sv})s",
                               "system-bus-name", 1, "name", "s", caller,
                               action);
-
-    if (r < 0) {
-        return r;
-    }
+    if (r < 0)
+        goto fail;
 
     r = sd_bus_message_append(request, "a{ss}", NULL);
     if (r < 0)
-        return r;
+        goto fail;
 
     // Set up interactive authentication.
     r = sd_bus_message_append(request, "us", 1, NULL);
-    if (r < 0) {
-        return r;
-    }
+    if (r < 0)
+        goto fail;
 
-    // Send the request and wait for the reply
-    r = sd_bus_call(bus, request, NO_EXIT_TIMEOUT, &error, &reply);
-    if (r < 0) {
-        print_sd_bus_error(&error);
-        if (sd_bus_error_has_name(&error, SD_BUS_ERROR_SERVICE_UNKNOWN)) {
-            sd_bus_error_free(&error);
+    *ret = request;
+    return 0;
+fail:
+    sd_bus_message_unref(request);
+    return r;
+}
+
+/* 解析CheckAuthorization的应答，返回0表示已授权，1表示未授权，小于0表示出错。
+ * polkit为该调用者保留了临时授权（auth_admin_keep）时，temporary_id为临时授权的id，
+ * 在reply释放前有效。*/
+static int parse_check_authorization_reply(sd_bus_message *reply, const char **temporary_id) {
+    const sd_bus_error *e;
+    const char *key, *value;
+    int challenge ;
+    int authorized ;
+    int r;
+
+    *temporary_id = NULL;
+
+    if (sd_bus_message_is_method_error(reply, NULL)) {
+        e = sd_bus_message_get_error(reply);
+        print_sd_bus_error(e);
+        if (sd_bus_error_has_name(e, SD_BUS_ERROR_SERVICE_UNKNOWN))
             return -EACCES;  // PolicyKit service not available, access denied
-        }
-        return r;
+        return -sd_bus_message_get_errno(reply) ?: -EACCES;
     }
-//     usleep(100 * 1000);//休眠0.1秒
 
     // Read the reply
     r = sd_bus_message_enter_container(reply, 'r', "bba{ss}");
@@ -165,37 +238,161 @@ int interactive_permission_check(sd_bus *bus, const char *action, const char **d
         return r;
     }
 
-
     r = sd_bus_message_read(reply, "bb", &authorized, &challenge);
     if (r < 0) {
         return r;
     }
 
-    if (authorized) {
-        sd_bus_message_unref(reply);
-        return 0;  // Authorized
+    r = sd_bus_message_enter_container(reply, 'a', "{ss}");
+    if (r < 0)
+        return r;
+    while ((r = sd_bus_message_read(reply, "{ss}", &key, &value)) > 0) {
+        if (strcmp(key, "polkit.temporary_authorization_id") == 0)
+            *temporary_id = value;
     }
+    if (r < 0)
+        return r;
 
-    if (challenge) {
+    if (authorized)
+        return 0;  // Authorized
+
+    if (challenge)
         printf("Authorization challenge required. Please respond to the challenge.\n");
-        // Handle interactive challenge
-        // This part is highly application-specific.
-    }
 
-    sd_bus_message_unref(reply);
-    return 1;  // Not authorized but a challenge is required
+    return 1;  // Not authorized
 }
 
+static int check_authorization_reply_handler(sd_bus_message *reply, void *userdata, sd_bus_error *ret_error) {
+        PendingAuth *p = userdata;
+        sd_bus_error error = SD_BUS_ERROR_NULL;
+        const char *temporary_id = NULL;
+        int r;
+
+        assert(p);
+
+        r = parse_check_authorization_reply(reply, &temporary_id);
+        metrics_observe_since(METRICS_POLKIT, p->action, p->start_usec, r < 0);
+        if (r == 0 && temporary_id)
+                auth_cache_add(p->context, sd_bus_message_get_sender(p->message), p->action,
+                               now_usec() + POLKIT_AUTH_CACHE_USEC);
+        if (r < 0)
+                sd_bus_error_setf(&error, SD_BUS_ERROR_FAILED, "Authorization failed: %s", strerror(-r));
+        else if (r > 0)
+                sd_bus_error_setf(&error, SD_BUS_ERROR_FAILED, "Authorization challenge required.");
+        else
+                r = p->handler(p->message, p->context, &error);
+
+        /* 与sd-bus处理方法调用返回值的方式保持一致 */
+        if (sd_bus_error_is_set(&error))
+                sd_bus_reply_method_error(p->message, &error);
+        else if (r < 0)
+                sd_bus_reply_method_errno(p->message, r, NULL);
+
+        sd_bus_error_free(&error);
+        pending_auth_free(p);
+        return 0;
+}
+
+/*异步向polkit请求授权，授权通过后在应答回调里执行handler。
+* 等待用户输入密码期间，bus上的其它请求仍然可以被处理。
+*
+* 函数返回值：
+* 成功挂起：返回 1，方法调用由回调函数应答；
+* 失败：返回负的错误码。*/
+static int verify_polkit_async(Context *c, sd_bus_message *m, const char *action, authorized_method_t handler, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *request = NULL;
+        PendingAuth *p = NULL;
+        const char *sender;
+        int r;
+
+        assert(c && m && action && handler);
+
+        /* Get the caller's sender */
+        sender = sd_bus_message_get_sender(m);
+        if (!sender)
+                return -EBADMSG;
+
+        /* 同一个调用者在临时授权有效期内不需要再询问polkit */
+        if (auth_cache_lookup(c, sender, action)) {
+                metrics_observe(METRICS_AUTH_CACHE, action, 0, false);
+                return handler(m, c, error);
+        }
+
+        r = new_check_authorization(c->bus, &request, action, sender);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Authorization failed: %s", strerror(-r));
+
+        p = malloc(sizeof(PendingAuth));
+        if (!p)
+                return -ENOMEM;
+        memset(p, 0, sizeof(PendingAuth));
+        p->action = action;
+        p->handler = handler;
+        p->start_usec = metrics_now_usec();
+        p->message = sd_bus_message_ref(m);
+
+        r = sd_bus_call_async(c->bus, &p->slot, request, check_authorization_reply_handler, p, POLKIT_AUTH_TIMEOUT_USEC);
+        if (r < 0) {
+                pending_auth_free(p);
+                return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Authorization failed: %s", strerror(-r));
+        }
+
+        p->context = c;
+        g_hash_table_add(c->pending_auths, p);
+        return 1;
+}
 
 static void context_clear(Context *c) {
         assert(c);
+        job_manager_done(c);
+        metrics_dump(c);
+        if (c->pending_auths) {
+                GHashTableIter iter;
+                PendingAuth *p;
+
+                g_hash_table_iter_init(&iter, c->pending_auths);
+                while (g_hash_table_iter_next(&iter, (void **)&p, NULL)) {
+                        g_hash_table_iter_remove(&iter);
+                        p->context = NULL;
+                        pending_auth_free(p);
+                }
+                g_hash_table_destroy(c->pending_auths);
+        }
+        if (c->auth_cache)
+                g_hash_table_destroy(c->auth_cache);
         free(c->debug_level);
         sd_bus_flush_close_unref(c->bus);
+        sd_event_source_unref(c->idle_source);
+        sd_event_source_unref(c->post_source);
+        sd_event_source_unref(c->registry_watch_source);
+        sd_event_source_unref(c->registry_reload_source);
+        sd_event_source_unref(c->levels_watch_source);
+        sd_event_unref(c->event);
         deinit_module_cfgs();
 }
 
 static int context_read_data(Context *c) {
-        return init_module_cfgs(MODULES_DEBUG_CONFIG_PATH);
+        int r;
+
+        r = init_module_cfgs(MODULES_DEBUG_CONFIG_PATH);
+        if (r < 0)
+                return r;
+
+        c->any_debug_enabled = config_module_any_debug_enabled();
+        return 0;
+}
+
+static int emit_any_debug_enabled_changed(Context *c) {
+        bool enabled;
+
+        assert(c);
+
+        enabled = config_module_any_debug_enabled();
+        if (enabled == c->any_debug_enabled)
+                return 0;
+
+        c->any_debug_enabled = enabled;
+        return sd_bus_emit_properties_changed(c->bus, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_DBUS_INTERFACE, "AnyDebugEnabled", NULL);
 }
 
 static int send_method_finish_signal(sd_bus *bus, void *userdata) {
@@ -222,75 +419,174 @@ static int send_method_finish_signal(sd_bus *bus, void *userdata) {
         return sd_bus_send(bus, m, NULL);
 }
 
-static int method_set_debug(sd_bus_message *m, void *userdata, sd_bus_error *error) {
-        int r,reboot = 0,ret = 0;
-        Context *c = userdata;
-        MethodResult mr = {"SetDebug",NULL};
-        const char *sender;
+static int set_debug_authorized(sd_bus_message *m, Context *c, sd_bus_error *error) {
+        Job *j = NULL;
         const char *name, *level;
+        int r;
 
-        /* Get the caller's sender */
-        sender = sd_bus_message_get_sender(m);
-        if (!sender)
-                return -EBADMSG;
-
-        // Perform authorization check
-        r = interactive_permission_check(c->bus, ACTION_ID, NULL, sender);
-        if (r < 0) {
-                sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Authorization failed: %s", strerror(-r));
-                return r;
-        } else if (r > 0) {
-                sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Authorization challenge required.");
-                return r;
-        }
-
+        j = job_new(c, JOB_SET_DEBUG);
+        if (!j)
+                return -ENOMEM;
 
         /* Read the parameters */
         r = sd_bus_message_enter_container(m, 'a', "(ss)");
         if (r < 0)
-                return r;
+                goto fail;
 
         for (;;) {
 
                 r = sd_bus_message_read(m, "(ss)", &name, &level);
                 if (r < 0) {
                         sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid arg");
-                        break;
+                        goto fail;
                 }
                 if (r == 0)
                         break;
 
-                r = config_module_set_debug_level_by_module_name(name,level);
-                if (r < 0) {
-                        sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "error,ret=%d",r);
-                        ret = r;
+                r = job_add_item(j, name, level);
+                if (r < 0)
+                        goto fail;
+                /* all已经包含了所有模块，忽略之后的参数 */
+                if (strcmp(name,"all")==0) break;
+        }
+        sd_bus_message_exit_container(m);
+
+        r = job_enqueue(j, error);
+        if (r < 0)
+                goto fail;
+
+        return sd_bus_reply_method_return(m, "o", j->path);
+fail:
+        job_free(j);
+        return r;
+}
+
+/* 配置方案展开为一个SetDebug任务，已经是目标等级的模块不加入任务。
+ * 和本进程中的config_batch_apply一样，有未知模块时整个方案都不执行；
+ * 所有模块都已经是目标等级时不创建任务，返回"/" */
+static int set_profile_authorized(sd_bus_message *m, Context *c, sd_bus_error *error) {
+        config_batch_op *ops = NULL;
+        int ops_num = 0, changed = 0;
+        const char *name;
+        Job *j = NULL;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &name);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid arg");
+
+        r = config_profile_build_batch(name, &ops, &ops_num);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "No profile %s", name);
+
+        for (int i = 0; i < ops_num; i++) {
+                if (ops[i].unchanged)
+                        continue;
+                if (strcmp(ops[i].target, "all") != 0 && !config_module_lookup_name(ops[i].target)) {
+                        r = sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Unknown module %s in profile %s",
+                                              ops[i].target, name);
+                        goto fail;
                 }
-                if (strcmp(name,"all")==0 && r >= 0) {
+                changed++;
+        }
+
+        if (changed == 0) {
+                config_batch_free(ops, ops_num);
+                return sd_bus_reply_method_return(m, "o", "/");
+        }
+
+        j = job_new(c, JOB_SET_DEBUG);
+        if (!j) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        for (int i = 0; i < ops_num; i++) {
+                if (ops[i].unchanged)
+                        continue;
+                r = job_add_item(j, ops[i].target, ops[i].level);
+                if (r < 0)
+                        goto fail;
+        }
+
+        r = job_enqueue(j, error);
+        if (r < 0)
+                goto fail;
+
+        config_batch_free(ops, ops_num);
+        return sd_bus_reply_method_return(m, "o", j->path);
+fail:
+        config_batch_free(ops, ops_num);
+        job_free(j);
+        return r;
+}
+
+/* EstimateDbg的结果在任务结束后回复 */
+static void reply_estimate_dbg(Job *j) {
+        const dbgsym_estimate *est = &j->estimate;
+
+        if (j->result == -ENOENT)
+                (void) sd_bus_reply_method_errorf(j->message, SD_BUS_ERROR_INVALID_ARGS, "Package is not installed");
+        else if (j->result < 0)
+                (void) sd_bus_reply_method_errorf(j->message, SD_BUS_ERROR_FAILED, "Failed to estimate dbg packages, ret=%d", j->result);
+        else
+                (void) sd_bus_reply_method_return(j->message, "uutttb", (uint32_t) est->packages, (uint32_t) est->missing,
+                                                  est->download_size, est->installed_size, est->available_size,
+                                                  (int) est->enough_space);
+}
+
+/* 在bus线程中调用，工作线程已经不再访问j */
+void context_job_finished(Context *c, Job *j) {
+        MethodResult mr = {"SetDebug",NULL};
+        int reboot = 0;
+
+        if (j->type == JOB_SET_COREDUMP) {
+                emit_any_debug_enabled_changed(c);
+                if (j->result == -ECANCELED)
+                        (void) sd_bus_reply_method_errorf(j->message, SD_BUS_ERROR_FAILED, "Superseded by a later request");
+                else if (j->result < 0)
+                        (void) sd_bus_reply_method_errorf(j->message, SD_BUS_ERROR_FAILED, "error,ret=%d", j->result);
+                else
+                        (void) sd_bus_reply_method_return(j->message, NULL);
+                return;
+        }
+
+        if (j->type == JOB_ESTIMATE_DBG) {
+                reply_estimate_dbg(j);
+                return;
+        }
+
+        if (j->type != JOB_SET_DEBUG)
+                return;
+
+        for (unsigned i = 0; i < j->items->len; i++) {
+                JobItem *item = g_ptr_array_index(j->items, i);
+
+                /* 被取代的模块没有执行，等级以之后的任务为准 */
+                if (item->superseded)
+                        continue;
+                if (strcmp(item->name,"all")==0 && item->result >= 0 &&
+                    (!c->debug_level || strcmp(c->debug_level, item->level) != 0)) {
                         free(c->debug_level);
-                        c->debug_level = strdup(level);
-                        if (!c->debug_level) {
-                                sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Memory allocation failed");
-                                return -ENOMEM;
-                        }
+                        c->debug_level = strdup(item->level);
+                        (void) sd_bus_emit_properties_changed(c->bus, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_DBUS_INTERFACE, "AllDebugLevel", NULL);
                 }
-                if (reboot == 0)
-                        config_module_get_property_reboot(name,&reboot);
-                if (name && strcmp(name,"all")==0) break;
+                if (item->result >= 0 && item->reboot)
+                        reboot = 1;
         }
-        sd_bus_message_exit_container(m);
 
-        config_module_check_log();
+        emit_any_debug_enabled_changed(c);
+        (void) module_objects_emit_changes(c);
 
-        if (ret < 0)
+        if (j->result == -ECANCELED)
+                mr.method_res = "superseded";
+        else if (j->result < 0)
                 mr.method_res = "fail";
-        else {
-                if (reboot)
-                        mr.method_res = "reboot";
-                else
-                        mr.method_res = "success";
-                sd_bus_reply_method_return(m, NULL);
-        }
-        return send_method_finish_signal(c->bus,&mr);
+        else if (reboot)
+                mr.method_res = "reboot";
+        else
+                mr.method_res = "success";
+        send_method_finish_signal(c->bus,&mr);
 }
 
 #if 0
@@ -301,85 +597,178 @@ static int method_get_name_pair(sd_bus_message *m, void *userdata, sd_bus_error
 }
 #endif
 
-static int method_install_dbg(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+static int install_dbg_authorized(sd_bus_message *m, Context *c, sd_bus_error *error) {
+        Job *j = NULL;
         int r;
 
-        const char *sender;
-        Context *c = userdata;
-
-        /* Get the caller's sender */
-        sender = sd_bus_message_get_sender(m);
-        if (!sender)
-                return -EBADMSG;
-
-        // Perform authorization check
-        r = interactive_permission_check(c->bus, ACTION_ID, NULL, sender);
-        if (r < 0) {
-                sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Authorization failed: %s", strerror(-r));
-                return r;
-        } else if (r > 0) {
-                sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Authorization challenge required.");
-                return r;
-        }
-
         if (!check_can_install_dbg())
                 return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "cann't install dbg");
 
+        j = job_new(c, JOB_INSTALL_DBG);
+        if (!j)
+                return -ENOMEM;
+
         r = sd_bus_message_enter_container(m, 'a', "s");
         if (r < 0)
-                return r;
+                goto fail;
 
         for (;;) {
                 const char *name;
 
                 r = sd_bus_message_read(m, "s", &name);
-                if (r < 0)
-                        return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid arg");
+                if (r < 0) {
+                        sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid arg");
+                        goto fail;
+                }
                 if (r == 0)
                         break;
 
-                r = config_module_install_dbgpkgs_internal(name);
+                r = job_add_item(j, name, NULL);
                 if (r < 0)
-                        return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "error,ret=%d",r);
+                        goto fail;
         }
         sd_bus_message_exit_container(m);
-        return sd_bus_reply_method_return(m, NULL);
+
+        r = job_enqueue(j, error);
+        if (r < 0)
+                goto fail;
+
+        return sd_bus_reply_method_return(m, "o", j->path);
+fail:
+        job_free(j);
+        return r;
 }
 
-static int method_set_coredump(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+/* 在后台更新调试包源的列表，合并重复的请求，任务的JobRemoved信号通知结果 */
+static int refresh_sources_authorized(sd_bus_message *m, Context *c, sd_bus_error *error) {
+        Job *j = NULL;
         int r;
-        int b;
+        int force;
 
-        const char *sender;
-        Context *c = userdata;
+        r = sd_bus_message_read(m, "b", &force);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid arg");
 
-        /* Get the caller's sender */
-        sender = sd_bus_message_get_sender(m);
-        if (!sender)
-                return -EBADMSG;
+        if (!check_can_install_dbg())
+                return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "cann't install dbg");
 
-        // Perform authorization check
-        r = interactive_permission_check(c->bus, ACTION_ID, NULL, sender);
-        if (r < 0) {
-                sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Authorization failed: %s", strerror(-r));
-                return r;
-        } else if (r > 0) {
-                sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "Authorization challenge required.");
-                return r;
-        }
+        j = job_new(c, JOB_REFRESH_SOURCES);
+        if (!j)
+                return -ENOMEM;
+
+        r = job_add_item(j, "dbg-sources", force ? "force" : NULL);
+        if (r < 0)
+                goto fail;
+
+        r = job_enqueue(j, error);
+        if (r < 0)
+                goto fail;
+
+        return sd_bus_reply_method_return(m, "o", j->path);
+fail:
+        job_free(j);
+        return r;
+}
+
+/* 只接受DEFAULT_CORE_PATH下的文件名，不允许调用者让服务读取任意路径的文件 */
+static int install_core_dbg_authorized(sd_bus_message *m, Context *c, sd_bus_error *error) {
+        Job *j = NULL;
+        const char *core;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &core);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid arg");
+
+        if (isempty(core) || strchr(core, '/') || strcmp(core, ".") == 0 || strcmp(core, "..") == 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid core file name: %s", core);
+
+        if (!check_can_install_dbg())
+                return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "cann't install dbg");
+
+        j = job_new(c, JOB_INSTALL_CORE_DBG);
+        if (!j)
+                return -ENOMEM;
+
+        r = job_add_item(j, core, NULL);
+        if (r < 0)
+                goto fail;
+
+        r = job_enqueue(j, error);
+        if (r < 0)
+                goto fail;
+
+        return sd_bus_reply_method_return(m, "o", j->path);
+fail:
+        job_free(j);
+        return r;
+}
+
+/* 执行脚本可能较慢，放到配置队列中执行，任务结束后再回复 */
+static int set_coredump_authorized(sd_bus_message *m, Context *c, sd_bus_error *error) {
+        Job *j = NULL;
+        int r;
+        int b;
 
         r = sd_bus_message_read(m, "b", &b);
         if (r < 0)
                 return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid arg");
 
-        r = config_system_coredump(b);
+        j = job_new(c, JOB_SET_COREDUMP);
+        if (!j)
+                return -ENOMEM;
+
+        r = job_add_item(j, "coredump", b ? "on" : "off");
         if (r < 0)
-                return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "error,ret=%d",r);
+                goto fail;
 
-        return sd_bus_reply_method_return(m, NULL);
+        j->message = sd_bus_message_ref(m);
+
+        r = job_enqueue(j, error);
+        if (r < 0)
+                goto fail;
+
+        return 1;
+fail:
+        job_free(j);
+        return r;
 }
 
-static int method_get_state(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+static int method_set_debug(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return verify_polkit_async(userdata, m, ACTION_ID, set_debug_authorized, error);
+}
+
+static int method_set_profile(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return verify_polkit_async(userdata, m, ACTION_ID, set_profile_authorized, error);
+}
+
+static int method_install_dbg(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return verify_polkit_async(userdata, m, ACTION_ID, install_dbg_authorized, error);
+}
+
+static int method_refresh_debug_sources(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return verify_polkit_async(userdata, m, ACTION_ID, refresh_sources_authorized, error);
+}
+
+static int method_install_dbg_for_core(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return verify_polkit_async(userdata, m, ACTION_ID, install_core_dbg_authorized, error);
+}
+
+static int method_set_coredump(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return verify_polkit_async(userdata, m, ACTION_ID, set_coredump_authorized, error);
+}
+
+/* 同步方法在bus线程中完成，统计处理函数本身的耗时 */
+static int timed_method(const char *name, sd_bus_message_handler_t handler, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        uint64_t start_usec = metrics_now_usec();
+        int r;
+
+        r = handler(m, userdata, error);
+        metrics_observe_since(METRICS_METHOD, name, start_usec, r < 0 || sd_bus_error_is_set(error));
+        return r;
+}
+
+static int get_state(sd_bus_message *m, void *userdata, sd_bus_error *error) {
         Context *c = userdata;
         int r;
         char *debug_level = NULL;
@@ -426,25 +815,182 @@ static int method_get_state(sd_bus_message *m, void *userdata, sd_bus_error *err
         return sd_bus_send(NULL, reply, NULL);
 }
 
+typedef struct StateReply {
+        sd_bus_message *reply;
+        int r;
+} StateReply;
+
+static void append_module_state(const module_state *state, void *userdata) {
+        StateReply *sr = userdata;
+
+        if (sr->r < 0)
+                return;
+
+        sr->r = sd_bus_message_append(sr->reply, "{sa{sv}}", state->name, 4,
+                                      "Level", "s", state->level ? state->level : "",
+                                      "Group", "s", state->type ? state->type : "",
+                                      "NeedsReboot", "b", state->reboot != 0,
+                                      "LastChanged", "t", state->last_changed);
+}
+
+/* 一次返回所有模块的状态，since不为0时只返回该代数之后发生变化的模块 */
+static int method_get_state(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return timed_method("GetState", get_state, m, userdata, error);
+}
+
+static int get_all_states(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        StateReply sr = {};
+        uint64_t since = 0, generation = 0;
+        int r;
+
+        r = sd_bus_message_read(m, "t", &since);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(m, &reply);
+        if (r < 0)
+                return r;
+
+        /* 代数要在遍历时才能确定，所以放在数组之后返回 */
+        r = sd_bus_message_open_container(reply, 'a', "{sa{sv}}");
+        if (r < 0)
+                return r;
+
+        sr.reply = reply;
+        r = config_modules_foreach_state(since, append_module_state, &sr, &generation);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_FAILED, "error get states,ret=%d", r);
+        if (sr.r < 0)
+                return sr.r;
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "t", generation);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+/* 只查询常驻内存的索引和一次stat，不需要授权 */
+static int lookup_build_id(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_free_ char *path = NULL;
+        _cleanup_free_ char *package = NULL;
+        const char *build_id;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &build_id);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid arg");
+
+        r = buildid_lookup(build_id, &path, &package);
+        if (r == -EINVAL)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid build-id %s", build_id);
+        if (r == -ENOENT)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_FILE_NOT_FOUND, "No debug file for build-id %s", build_id);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, "ss", path, package);
+}
+
+static int method_lookup_build_id(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return timed_method("LookupBuildId", lookup_build_id, m, userdata, error);
+}
+
+/* 只读取已有的软件包列表，不更新调试包源，所以不需要授权。要解析ELF依赖和软件包列表，
+ * 放到查询队列中执行，任务结束后回复：调试包数目、没有调试包的数目、下载大小、
+ * 安装后占用的空间、可用空间，以及空间是否足够 */
+static int method_estimate_dbg(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_strv_free_ char **modules = NULL;
+        Context *c = userdata;
+        Job *j = NULL;
+        int r;
+
+        r = sd_bus_message_read_strv(m, &modules);
+        if (r < 0)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Invalid arg");
+        if (!modules || !modules[0])
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "No package specified");
+
+        j = job_new(c, JOB_ESTIMATE_DBG);
+        if (!j)
+                return -ENOMEM;
+
+        for (char **name = modules; *name; name++) {
+                r = job_add_item(j, *name, NULL);
+                if (r < 0)
+                        goto fail;
+        }
+
+        j->message = sd_bus_message_ref(m);
+
+        r = job_enqueue(j, error);
+        if (r < 0)
+                goto fail;
+
+        return 1;
+fail:
+        job_free(j);
+        return r;
+}
+
+static int method_get_all_states(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return timed_method("GetAllStates", get_all_states, m, userdata, error);
+}
+
 static int property_debug_level(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
         Context *c = userdata;
         return sd_bus_message_append(reply, "s", c->debug_level ? c->debug_level : "");
 }
 
+static int property_any_debug_enabled(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        return sd_bus_message_append(reply, "b", config_module_any_debug_enabled());
+}
+
 /* The vtable of our little object, implements the net.poettering.Calculator interface */
 static const sd_bus_vtable debug_config_vtable[] = {
         SD_BUS_VTABLE_START(0),
-        SD_BUS_METHOD("SetDebug", "a(ss)", NULL, method_set_debug, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("SetDebug", "a(ss)", "o", method_set_debug, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("SetProfile", "s", "o", method_set_profile, SD_BUS_VTABLE_UNPRIVILEGED),
         //SD_BUS_METHOD("GetNamePair", NULL, "a(ss)", method_get_name_pair,   SD_BUS_VTABLE_UNPRIVILEGED),
-        SD_BUS_METHOD("InstallDbg", "as", NULL, method_install_dbg,   SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("InstallDbg", "as", "o", method_install_dbg,   SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("RefreshDebugSources", "b", "o", method_refresh_debug_sources,   SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("InstallDbgForCore", "s", "o", method_install_dbg_for_core,      SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("SetCoredump", "b", NULL, method_set_coredump,   SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("GetState", "as", "as", method_get_state,   SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("GetAllStates", "t", "a{sa{sv}}t", method_get_all_states,   SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("LookupBuildId", "s", "ss", method_lookup_build_id,   SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("EstimateDbg", "as", "uutttb", method_estimate_dbg,  SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_PROPERTY("AllDebugLevel", "s", property_debug_level, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("AnyDebugEnabled", "b", property_any_debug_enabled, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
 
         SD_BUS_SIGNAL("MethodFinished", "ss", 0),
+        SD_BUS_SIGNAL("JobNew", "uos", 0),
+        SD_BUS_SIGNAL("JobRemoved", "uossa{ss}", 0),
         SD_BUS_VTABLE_END
 };
 
+static int on_name_acquired(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        Context *c = userdata;
+        const sd_bus_error *e;
+        uint64_t startup_usec;
+
+        e = sd_bus_message_get_error(m);
+        if (e) {
+                fprintf(stderr, "Failed to request name: %s\n", e->message);
+                return sd_event_exit(c->event, -sd_bus_message_get_errno(m));
+        }
+
+        startup_usec = metrics_now_usec() - c->start_usec;
+        metrics_observe(METRICS_STARTUP, "service", startup_usec, false);
+        fprintf(stdout, "Startup finished in %llu us\n", (unsigned long long)startup_usec);
+        return 0;
+}
+
 static int connect_bus(Context *c) {
         int r;
 
@@ -457,13 +1003,58 @@ static int connect_bus(Context *c) {
                 return r;
         }
 
+        r = sd_bus_attach_event(c->bus, c->event, SD_EVENT_PRIORITY_NORMAL);
+        if (r < 0) {
+                fprintf(stderr, "Failed to attach bus to event loop: %s\n", strerror(-r));
+                return r;
+        }
+
+        /* 与dbus断开后退出事件循环 */
+        r = sd_bus_set_exit_on_disconnect(c->bus, true);
+        if (r < 0)
+                return r;
+
         r = sd_bus_add_object_vtable(c->bus, NULL, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_DBUS_INTERFACE, debug_config_vtable, c);
         if (r < 0) {
                 fprintf(stderr, "Failed to add_object_vtable: %s\n", strerror(-r));
                 return r;
         }
 
-        r = sd_bus_request_name_async(c->bus, NULL, DEBUG_CONFIG_DBUS_NAME, 0, NULL, NULL);
+        r = module_objects_init(c);
+        if (r < 0) {
+                fprintf(stderr, "Failed to add module objects: %s\n", strerror(-r));
+                return r;
+        }
+
+        r = metrics_objects_init(c);
+        if (r < 0) {
+                fprintf(stderr, "Failed to add metrics object: %s\n", strerror(-r));
+                return r;
+        }
+
+        r = sd_bus_match_signal(c->bus, NULL,
+                                "org.freedesktop.DBus",
+                                "/org/freedesktop/DBus",
+                                "org.freedesktop.DBus",
+                                "NameOwnerChanged",
+                                match_name_owner_changed, c);
+        if (r < 0) {
+                fprintf(stderr, "Failed to add NameOwnerChanged match: %s\n", strerror(-r));
+                return r;
+        }
+
+        r = sd_bus_match_signal(c->bus, NULL,
+                                "org.freedesktop.PolicyKit1",
+                                "/org/freedesktop/PolicyKit1/Authority",
+                                "org.freedesktop.PolicyKit1.Authority",
+                                "Changed",
+                                match_polkit_changed, c);
+        if (r < 0) {
+                fprintf(stderr, "Failed to add polkit Changed match: %s\n", strerror(-r));
+                return r;
+        }
+
+        r = sd_bus_request_name_async(c->bus, NULL, DEBUG_CONFIG_DBUS_NAME, 0, on_name_acquired, c);
         //r = sd_bus_request_name(c->bus, DEBUG_CONFIG_DBUS_NAME, 0);
         if (r < 0) {
                 fprintf(stderr, "Failed to request_name_async: %s\n", strerror(-r));
@@ -473,11 +1064,124 @@ static int connect_bus(Context *c) {
         return 0;
 }
 
+static bool context_is_idle(Context *c) {
+        return g_hash_table_size(c->jobs) == 0 && g_hash_table_size(c->pending_auths) == 0;
+}
+
+/* 释放name之前发给我们的请求都已经处理完，之后的请求由dbus排队并重新激活服务 */
+static int on_name_released(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        Context *c = userdata;
+
+        return sd_event_exit(c->event, 0);
+}
+
+static int on_idle_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
+        Context *c = userdata;
+        int r;
+
+        /* 还有任务或授权没有完成，on_post会重新设置定时器 */
+        if (!context_is_idle(c))
+                return 0;
+
+        /* 通知systemd我们要退出了，之后的激活请求会排队，而不是认为服务仍在运行 */
+        (void) sd_notify(false, "STOPPING=1");
+        c->exiting = true;
+
+        r = sd_bus_release_name_async(c->bus, NULL, DEBUG_CONFIG_DBUS_NAME, on_name_released, c);
+        if (r < 0) {
+                fprintf(stderr, "Failed to release name: %s\n", strerror(-r));
+                return sd_event_exit(c->event, r);
+        }
+        return 0;
+}
+
+/* 每处理完一批事件后推迟空闲定时器 */
+static int on_post(sd_event_source *s, void *userdata) {
+        Context *c = userdata;
+        uint64_t now;
+        int r;
+
+        if (c->exiting)
+                return 0;
+
+        r = sd_event_now(c->event, CLOCK_MONOTONIC, &now);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_time(c->idle_source, now + c->idle_timeout);
+        if (r < 0)
+                return r;
+
+        return sd_event_source_set_enabled(c->idle_source, SD_EVENT_ONESHOT);
+}
+
+static int setup_idle_exit(Context *c) {
+        uint64_t now;
+        int r;
+
+        if (c->idle_timeout == NO_EXIT_TIMEOUT)
+                return 0;
+
+        r = sd_event_now(c->event, CLOCK_MONOTONIC, &now);
+        if (r < 0)
+                return r;
+
+        r = sd_event_add_time(c->event, &c->idle_source, CLOCK_MONOTONIC, now + c->idle_timeout, 0, on_idle_timeout, c);
+        if (r < 0)
+                return r;
+
+        return sd_event_add_post(c->event, &c->post_source, on_post, c);
+}
+
+/* 收到SIGTERM/SIGINT时退出事件循环，context_clear会等待正在执行的任务结束 */
+static int on_signal(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
+        Context *c = userdata;
+
+        c->exiting = true;
+        return sd_event_exit(c->event, 0);
+}
+
+static int setup_signals(Context *c) {
+        sigset_t mask;
+        int r;
+
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGTERM);
+        sigaddset(&mask, SIGINT);
+        if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+                return -errno;
+
+        r = sd_event_add_signal(c->event, NULL, SIGTERM, on_signal, c);
+        if (r < 0)
+                return r;
+
+        return sd_event_add_signal(c->event, NULL, SIGINT, on_signal, c);
+}
+
+static usec_t parse_idle_timeout(void) {
+        const char *e;
+        char *end = NULL;
+        unsigned long long v;
+
+        e = getenv(IDLE_TIMEOUT_ENV);
+        if (isempty(e))
+                return DEFAULT_IDLE_TIMEOUT_USEC;
+
+        errno = 0;
+        v = strtoull(e, &end, 10);
+        if (errno != 0 || !end || *end != '\0') {
+                fprintf(stderr, "Invalid %s=%s, using default\n", IDLE_TIMEOUT_ENV, e);
+                return DEFAULT_IDLE_TIMEOUT_USEC;
+        }
+
+        return v == 0 ? NO_EXIT_TIMEOUT : (usec_t) v * USEC_PER_SEC;
+}
+
 int main(int argc, char *argv[]) {
-        _cleanup_(context_clear) Context context = {};
+        _cleanup_(context_clear) Context context = { .notify_fd = -1 };
         int r;
-        bool exiting = false;
 
+        context.start_usec = metrics_now_usec();
         umask(0022);
 
         if (argc != 1) {
@@ -485,66 +1189,65 @@ int main(int argc, char *argv[]) {
                 return -EINVAL;
         }
 
-        r = connect_bus(&context);
+        context.idle_timeout = parse_idle_timeout();
+        context.pending_auths = g_hash_table_new(g_direct_hash, g_direct_equal);
+        context.auth_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_hash_table_destroy);
+
+        r = sd_event_default(&context.event);
         if (r < 0) {
-                fprintf(stderr, "Failed to connect_bus: %s\n", strerror(-r));
+                fprintf(stderr, "Failed to allocate event loop: %s\n", strerror(-r));
                 return -EINVAL;
         }
 
+        /* 必须在创建工作线程之前屏蔽信号，信号只通过事件循环处理 */
+        r = setup_signals(&context);
+        if (r < 0) {
+                fprintf(stderr, "Failed to set up signal handling: %s\n", strerror(-r));
+                return -EINVAL;
+        }
+
+        (void) sd_event_set_watchdog(context.event, true);
+
+        r = job_manager_init(&context);
+        if (r < 0) {
+                fprintf(stderr, "Failed to init job manager: %s\n", strerror(-r));
+                return -EINVAL;
+        }
+
+        /* 模块对象在connect_bus中注册，注册前必须已经加载模块配置 */
         r = context_read_data(&context);
         if (r < 0) {
                 fprintf(stderr, "Failed to context_read_data: %s\n", strerror(-r));
                 return -EINVAL;
         }
 
-        for (;;) {
-                /* Process requests */
-                r = sd_bus_process(context.bus, NULL);
-                if (r < 0) {
-                        fprintf(stderr, "Failed to process bus: %s\n", strerror(-r));
-                        break;
-                }
-                if (r > 0) /* we processed a request, try to process another one, right-away */
-                        continue;
+        r = connect_bus(&context);
+        if (r < 0) {
+                fprintf(stderr, "Failed to connect_bus: %s\n", strerror(-r));
+                return -EINVAL;
+        }
 
-                if (exiting)
-                        break;
+        r = module_objects_watch(&context);
+        if (r < 0)
+                /* 不影响正常使用，只是不能自动发现新的模块 */
+                fprintf(stderr, "Failed to watch %s: %s\n", MODULES_DEBUG_CONFIG_PATH, strerror(-r));
 
-                /* Wait for the next request to process */
-                r = sd_bus_wait(context.bus, NO_EXIT_TIMEOUT);
+        r = module_objects_watch_levels(&context);
+        if (r < 0)
+                /* 只影响命令行在本进程中修改等级时的通知 */
+                fprintf(stderr, "Failed to watch %s: %s\n", MODULES_DEBUG_LEVELS_PATH, strerror(-r));
 
-                if (r < 0) {
-                        fprintf(stderr, "Failed to wait on bus: %s\n", strerror(-r));
-                        break;
-                }
-                if (r == 0) {
-                        r = sd_bus_try_close(context.bus);
-                        if (r == -EBUSY)
-                                continue;
-
-                        /* Fallback for dbus1 connections: we
-                         * unregister the name and wait for the
-                         * response to come through for it */
-                        if (r == -EOPNOTSUPP) {
-
-                                /* Inform the service manager that we
-                                 * are going down, so that it will
-                                 * queue all further start requests,
-                                 * instead of assuming we are already
-                                 * running. */
-                                sd_notify(false, "STOPPING=1");
-
-                                r = sd_bus_release_name_async(context.bus, NULL, DEBUG_CONFIG_DBUS_NAME, NULL, NULL);
-                                if (r < 0)
-                                        break;
-
-                                exiting = true;
-                                continue;
-                        }
-                        break;
-                }
+        r = setup_idle_exit(&context);
+        if (r < 0) {
+                fprintf(stderr, "Failed to set up idle exit: %s\n", strerror(-r));
+                return -EINVAL;
+        }
+
+        r = sd_event_loop(context.event);
+        if (r < 0) {
+                fprintf(stderr, "Failed to run event loop: %s\n", strerror(-r));
+                return -EINVAL;
         }
 
         return 0;
 }
-
@@ -0,0 +1,157 @@
+#ifndef BUS_SERVICE_H_included
+#define BUS_SERVICE_H_included 1
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+#include <systemd/sd-daemon.h>
+
+#include <glib.h>
+
+#include "util.h"
+#include "module_configure.h"
+
+typedef uint64_t usec_t;
+
+#define NO_EXIT_TIMEOUT UINT64_MAX
+#define USEC_PER_SEC 1000000ULL
+
+/* 空闲多久后退出，下次调用时由dbus重新激活；可以通过环境变量修改，0表示不退出 */
+#define DEFAULT_IDLE_TIMEOUT_USEC (60 * USEC_PER_SEC)
+#define IDLE_TIMEOUT_ENV "DEBUG_CONFIG_IDLE_TIMEOUT_SEC"
+
+/* 修改配置和安装调试包分别在两个执行队列中进行，互不等待；
+ * 查询只读内存中的缓存，直接在bus线程中完成；
+ * 需要读取软件包列表的查询不需要授权，放在单独的队列中，不会占满安装调试包的队列 */
+typedef enum JobLaneType {
+        JOB_LANE_CONFIG,    /* SetDebug、SetCoredump，执行很快 */
+        JOB_LANE_PACKAGE,   /* InstallDbg、RefreshDebugSources，可能要下载几分钟，以较低的CPU和IO优先级运行 */
+        JOB_LANE_QUERY,     /* EstimateDbg，只读，以较低的CPU和IO优先级运行 */
+        _JOB_LANE_MAX,
+} JobLaneType;
+
+/* 每个队列中最多允许排队的任务数，超过后新的请求直接返回错误 */
+#define JOB_LANE_CONFIG_MAX_WAITING  32
+#define JOB_LANE_PACKAGE_MAX_WAITING  8
+#define JOB_LANE_QUERY_MAX_WAITING  8
+#define JOB_LANE_PACKAGE_NICE  10
+
+typedef struct JobLane {
+        JobLaneType type;
+        GThreadPool *pool;
+        unsigned max_waiting;
+        int nice;
+        bool idle_io;
+        uint32_t last_job_id;   /* 最后一个进入这个队列的任务，只在bus线程中访问 */
+} JobLane;
+
+typedef struct Context {
+        sd_bus *bus;
+        sd_event *event;
+        sd_event_source *idle_source;
+        sd_event_source *post_source;
+        usec_t idle_timeout;
+        bool exiting;
+        uint64_t start_usec;        /* 进程启动的时间(CLOCK_MONOTONIC)，用于统计启动耗时 */
+
+        char *debug_level;
+        bool any_debug_enabled;
+        GHashTable *pending_auths;
+        GHashTable *auth_cache;
+
+        /* 在工作线程中执行的任务 */
+        JobLane lanes[_JOB_LANE_MAX];
+        GHashTable *jobs;           /* id -> Job */
+        GAsyncQueue *finished_jobs; /* 工作线程执行完的任务，由bus线程收尾 */
+        GMutex jobs_lock;           /* 保护Job中会被工作线程修改的字段 */
+        int notify_fd;              /* eventfd，工作线程用它唤醒bus线程 */
+        sd_event_source *notify_source;
+        uint32_t last_job_id;
+        GHashTable *pending_items;  /* 还未开始执行的JobItem，由jobs_lock保护 */
+
+        /* 已经发送过PropertiesChanged的调试等级缓存版本号 */
+        uint64_t emitted_generation;
+
+        /* 监视模块描述目录的变化 */
+        sd_event_source *registry_watch_source;
+        sd_event_source *registry_reload_source;
+        bool registry_reload_pending;
+
+        /* 监视调试等级文件，命令行在本进程中的修改也能发出通知 */
+        sd_event_source *levels_watch_source;
+} Context;
+
+typedef enum JobType {
+        JOB_SET_DEBUG,
+        JOB_INSTALL_DBG,
+        JOB_SET_COREDUMP,
+        JOB_REFRESH_SOURCES,
+        JOB_INSTALL_CORE_DBG,
+        JOB_ESTIMATE_DBG,
+} JobType;
+
+typedef enum JobState {
+        JOB_WAITING,
+        JOB_RUNNING,
+        JOB_DONE,
+} JobState;
+
+/* 任务中的一个模块。还未开始执行的JobItem登记在Context.pending_items中，
+ * 之后对同一模块的请求会合并到这个JobItem上，由多个任务共享执行结果 */
+typedef struct JobItem {
+        int ref;
+        JobType type;
+        JobState state;     /* 由jobs_lock保护 */
+        char *name;
+        char *level;    /* JOB_SET_DEBUG、JOB_SET_COREDUMP使用；JOB_REFRESH_SOURCES为"force"或NULL */
+        int result;
+        int reboot;
+        uint32_t last_job_id;   /* 最后一个合并到这个JobItem上的任务，由jobs_lock保护 */
+        bool superseded;        /* 还未执行时被之后的请求取代，不再执行，由jobs_lock保护 */
+} JobItem;
+
+/* 一个SetDebug或InstallDbg调用对应的任务，通过DEBUG_CONFIG_JOB_PATH/<id>导出到bus上 */
+typedef struct Job {
+        Context *context;
+        uint32_t id;
+        char *path;
+        JobType type;
+        sd_bus_slot *slot;
+        sd_bus_message *message;    /* 需要在任务结束后才回复的方法调用，可以为NULL */
+        uint64_t start_usec;        /* 创建任务的时间(CLOCK_MONOTONIC)，用于统计方法耗时 */
+        GPtrArray *items;   /* JobItem */
+
+        /* 以下字段由jobs_lock保护 */
+        JobState state;
+        unsigned n_done;
+        const char *current_module;
+        bool dirty;
+        int result;
+        dbgsym_estimate estimate;   /* JOB_ESTIMATE_DBG的结果 */
+} Job;
+
+usec_t now_usec(void);
+void print_sd_bus_error(const sd_bus_error *error);
+
+int job_manager_init(Context *c);
+void job_manager_done(Context *c);
+Job *job_new(Context *c, JobType type);
+int job_add_item(Job *j, const char *name, const char *level);
+int job_enqueue(Job *j, sd_bus_error *error);
+void job_free(Job *j);
+int job_manager_dispatch(Context *c);
+const char *job_type_to_string(JobType t);
+
+int module_objects_init(Context *c);
+int module_objects_emit_changes(Context *c);
+int module_objects_watch(Context *c);
+int module_objects_watch_levels(Context *c);
+void module_objects_reload_if_pending(Context *c);
+
+int metrics_objects_init(Context *c);
+void metrics_dump(Context *c);
+
+/* 由bus-service.c实现，在bus线程中为执行完的任务做收尾工作 */
+void context_job_finished(Context *c, Job *j);
+#endif
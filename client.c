@@ -0,0 +1,544 @@
+#include "client.h"
+#include "common.h"
+#include "util.h"
+#include <string.h>
+#include <stdint.h>
+
+#include <systemd/sd-bus.h>
+
+//修改配置的方法可能要等待polkit授权，使用较长的超时时间
+#define CLIENT_METHOD_TIMEOUT_USEC (300ULL * 1000000ULL)
+
+//等待一个任务结束
+typedef struct job_wait
+{
+    char *sender;       // 服务的unique name，只接受它发出的信号
+    char *path;         // 任务的对象路径
+    const char *level;  // SetDebug设置的等级，用于打印结果
+    const char *profile;// SetProfile的配置方案名，用于打印结果
+    bool done;
+    bool service_gone;
+    int result;
+} job_wait;
+
+bool client_enabled() {
+    const char *e = getenv(CLIENT_NO_BUS_ENV);
+    return !(e && strcmp(e, "1") == 0);
+}
+
+//这些错误说明请求还没有被服务处理，可以安全地改为在本进程中执行
+static bool is_unavailable_error(const sd_bus_error *error) {
+    return sd_bus_error_has_name(error, SD_BUS_ERROR_SERVICE_UNKNOWN) ||
+           sd_bus_error_has_name(error, SD_BUS_ERROR_NAME_HAS_NO_OWNER) ||
+           sd_bus_error_has_name(error, SD_BUS_ERROR_UNKNOWN_OBJECT) ||
+           sd_bus_error_has_name(error, SD_BUS_ERROR_UNKNOWN_INTERFACE) ||
+           sd_bus_error_has_name(error, SD_BUS_ERROR_UNKNOWN_METHOD);
+}
+
+static int client_open(sd_bus **bus) {
+    if (!client_enabled())
+        return CLIENT_UNAVAILABLE;
+
+    //没有system bus，例如在chroot或者系统启动早期
+    if (sd_bus_open_system(bus) < 0)
+        return CLIENT_UNAVAILABLE;
+
+    return OK;
+}
+
+static int client_call_failed(const sd_bus_error *error, int r) {
+    if (is_unavailable_error(error))
+        return CLIENT_UNAVAILABLE;
+
+    fprintf(stderr, N_("Error: %s\n"), sd_bus_error_is_set(error) ? error->message : strerror(-r));
+    return r;
+}
+
+static int on_job_removed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    job_wait *w = userdata;
+    const char *sender, *path, *type, *result, *name, *res;
+    uint32_t id;
+    int r;
+
+    sender = sd_bus_message_get_sender(m);
+    if (!w->path || !sender || strcmp(sender, w->sender) != 0)
+        return 0;
+
+    r = sd_bus_message_read(m, "uoss", &id, &path, &type, &result);
+    if (r < 0 || strcmp(path, w->path) != 0)
+        return 0;
+
+    r = sd_bus_message_enter_container(m, 'a', "{ss}");
+    if (r < 0)
+        return 0;
+
+    while ((r = sd_bus_message_read(m, "{ss}", &name, &res)) > 0) {
+        const char *status = strcmp(res, "fail") == 0 ? "fail" : strcmp(res, "superseded") == 0 ? "superseded" : "ok";
+
+        if (w->level)
+            fprintf(stdout, "set %s debug level to %s %s\n", name, w->level, status);
+        else if (w->profile)
+            fprintf(stdout, "set %s debug level by profile %s %s\n", name, w->profile, status);
+        else if (strcmp(res, "fail") == 0)
+            fprintf(stderr, N_("Error: Failed to install dbg packages for %s\n"), name);
+
+        if (strcmp(res, "reboot") == 0)
+            fprintf(stdout, N_("Reboot is required for %s to take effect.\n"), name);
+    }
+
+    //被之后的请求取代时，最终的等级由那个请求决定
+    if (strcmp(result, "superseded") == 0)
+        w->result = -ECANCELED;
+    else
+        w->result = strcmp(result, "done") == 0 ? OK : -EIO;
+    w->done = true;
+    return 0;
+}
+
+static int on_service_gone(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    job_wait *w = userdata;
+    const char *name, *old_owner, *new_owner;
+
+    if (sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner) < 0)
+        return 0;
+
+    if (w->sender && strcmp(old_owner, w->sender) == 0 && isempty(new_owner))
+        w->service_gone = true;
+    return 0;
+}
+
+//在调用方法之前订阅信号，避免错过任务结束的信号
+static int job_wait_subscribe(sd_bus *bus, job_wait *w) {
+    int r;
+
+    r = sd_bus_match_signal(bus, NULL, NULL, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_DBUS_INTERFACE,
+                            "JobRemoved", on_job_removed, w);
+    if (r < 0)
+        return r;
+
+    return sd_bus_add_match(bus, NULL,
+                            "type='signal',"
+                            "sender='org.freedesktop.DBus',"
+                            "path='/org/freedesktop/DBus',"
+                            "interface='org.freedesktop.DBus',"
+                            "member='NameOwnerChanged',"
+                            "arg0='" DEBUG_CONFIG_DBUS_NAME "'",
+                            on_service_gone, w);
+}
+
+static int job_wait_run(sd_bus *bus, job_wait *w, sd_bus_message *reply) {
+    const char *path;
+    int r;
+
+    r = sd_bus_message_read(reply, "o", &path);
+    if (r < 0)
+        return r;
+    //服务没有创建任务，没有需要等待的
+    if (strcmp(path, "/") == 0)
+        return OK;
+
+    if (!sd_bus_message_get_sender(reply))
+        return -EINVAL;
+
+    w->sender = strdup(sd_bus_message_get_sender(reply));
+    w->path = strdup(path);
+    if (!w->sender || !w->path)
+        return -ENOMEM;
+
+    while (!w->done) {
+        r = sd_bus_process(bus, NULL);
+        if (r < 0)
+            return r;
+        if (w->service_gone) {
+            fprintf(stderr, N_("Error: The service exited before the operation finished.\n"));
+            return -ECONNRESET;
+        }
+        if (r > 0)
+            continue;
+
+        r = sd_bus_wait(bus, UINT64_MAX);
+        if (r < 0)
+            return r;
+    }
+    return w->result;
+}
+
+static void job_wait_clear(job_wait *w) {
+    free(w->sender);
+    free(w->path);
+}
+
+/*通过服务查询一个模块或模块类型的调试等级：
+*
+* module：模块名或模块类型；
+* level：保存查询结果，需要调用者free。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 服务不可用：返回 CLIENT_UNAVAILABLE；
+* 失败：返回 ERR_RET。*/
+int client_get_debug_level(const char *module, char **level) {
+    _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+    _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+    _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+    const char *s;
+    int r;
+
+    assert(module && level);
+
+    r = client_open(&bus);
+    if (r != OK)
+        return r;
+
+    r = sd_bus_call_method(bus, DEBUG_CONFIG_DBUS_NAME, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_DBUS_INTERFACE,
+                           "GetState", &error, &reply, "as", 1, module);
+    if (r < 0)
+        return client_call_failed(&error, r);
+
+    r = sd_bus_message_read(reply, "as", 1, &s);
+    if (r < 0)
+        return r;
+
+    *level = strdup(s);
+    return *level ? OK : -ENOMEM;
+}
+
+/*通过服务获取所有模块名：
+*
+* names：保存模块名的数组，以NULL结尾，需要调用者用strv_free释放。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 服务不可用：返回 CLIENT_UNAVAILABLE；
+* 失败：返回 ERR_RET。*/
+int client_get_module_names(char ***names) {
+    _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+    _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+    _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+    char **l = NULL;
+    size_t n = 0;
+    int r;
+
+    assert(names);
+
+    r = client_open(&bus);
+    if (r != OK)
+        return r;
+
+    r = sd_bus_call_method(bus, DEBUG_CONFIG_DBUS_NAME, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_DBUS_INTERFACE,
+                           "GetAllStates", &error, &reply, "t", (uint64_t) 0);
+    if (r < 0)
+        return client_call_failed(&error, r);
+
+    r = sd_bus_message_enter_container(reply, 'a', "{sa{sv}}");
+    if (r < 0)
+        return r;
+
+    while ((r = sd_bus_message_enter_container(reply, 'e', "sa{sv}")) > 0) {
+        const char *name;
+        char **t;
+
+        r = sd_bus_message_read(reply, "s", &name);
+        if (r < 0)
+            goto fail;
+        r = sd_bus_message_skip(reply, "a{sv}");
+        if (r < 0)
+            goto fail;
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+            goto fail;
+
+        t = realloc(l, sizeof(char *) * (n + 2));
+        if (!t) {
+            r = -ENOMEM;
+            goto fail;
+        }
+        l = t;
+        l[n] = strdup(name);
+        l[n + 1] = NULL;
+        if (!l[n]) {
+            r = -ENOMEM;
+            goto fail;
+        }
+        n++;
+    }
+    if (r < 0)
+        goto fail;
+
+    if (!l) {
+        l = calloc(1, sizeof(char *));
+        if (!l)
+            return -ENOMEM;
+    }
+    *names = l;
+    return OK;
+fail:
+    strv_free(l);
+    return r;
+}
+
+/*通过服务设置一个或多个模块的调试等级，等待任务结束后返回：
+*
+* module_names：模块名，多个模块名用","分隔；
+* level：调试等级。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 服务不可用：返回 CLIENT_UNAVAILABLE；
+* 失败：返回 ERR_RET。*/
+int client_set_debug_level(const char *module_names, const char *level) {
+    _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+    _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+    _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+    _cleanup_strv_free_ char **modules = NULL;
+    job_wait w = { .level = level };
+    int count = 0, r;
+
+    assert(module_names && level);
+
+    modules = parseString(module_names, ",", &count);
+    if (count <= 0 || !modules) {
+        fprintf(stderr, N_("Error: Invalid module_name: %s\n"), module_names);
+        return ERROR;
+    }
+
+    r = client_open(&bus);
+    if (r != OK)
+        return r;
+
+    r = job_wait_subscribe(bus, &w);
+    if (r < 0)
+        return CLIENT_UNAVAILABLE;
+
+    r = sd_bus_message_new_method_call(bus, &m, DEBUG_CONFIG_DBUS_NAME, DEBUG_CONFIG_DBUS_PATH,
+                                       DEBUG_CONFIG_DBUS_INTERFACE, "SetDebug");
+    if (r < 0)
+        return r;
+
+    r = sd_bus_message_open_container(m, 'a', "(ss)");
+    if (r < 0)
+        return r;
+    for (int i = 0; i < count; i++) {
+        r = sd_bus_message_append(m, "(ss)", modules[i], level);
+        if (r < 0)
+            return r;
+    }
+    r = sd_bus_message_close_container(m);
+    if (r < 0)
+        return r;
+
+    r = sd_bus_call(bus, m, CLIENT_METHOD_TIMEOUT_USEC, &error, &reply);
+    if (r < 0)
+        return client_call_failed(&error, r);
+
+    r = job_wait_run(bus, &w, reply);
+    job_wait_clear(&w);
+    return r;
+}
+
+/*通过服务应用一个配置方案，等待任务结束后返回：
+*
+* profile：配置方案名。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 服务不可用：返回 CLIENT_UNAVAILABLE；
+* 失败：返回 ERR_RET。*/
+int client_set_profile(const char *profile) {
+    _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+    _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+    _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+    job_wait w = { .profile = profile };
+    int r;
+
+    assert(profile);
+
+    r = client_open(&bus);
+    if (r != OK)
+        return r;
+
+    r = job_wait_subscribe(bus, &w);
+    if (r < 0)
+        return CLIENT_UNAVAILABLE;
+
+    r = sd_bus_message_new_method_call(bus, &m, DEBUG_CONFIG_DBUS_NAME, DEBUG_CONFIG_DBUS_PATH,
+                                       DEBUG_CONFIG_DBUS_INTERFACE, "SetProfile");
+    if (r < 0)
+        return r;
+
+    r = sd_bus_message_append(m, "s", profile);
+    if (r < 0)
+        return r;
+
+    r = sd_bus_call(bus, m, CLIENT_METHOD_TIMEOUT_USEC, &error, &reply);
+    if (r < 0)
+        return client_call_failed(&error, r);
+
+    r = job_wait_run(bus, &w, reply);
+    job_wait_clear(&w);
+    return r;
+}
+
+int client_set_coredump(bool open_coredump) {
+    _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+    _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+    _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+    int r;
+
+    r = client_open(&bus);
+    if (r != OK)
+        return r;
+
+    r = sd_bus_message_new_method_call(bus, &m, DEBUG_CONFIG_DBUS_NAME, DEBUG_CONFIG_DBUS_PATH,
+                                       DEBUG_CONFIG_DBUS_INTERFACE, "SetCoredump");
+    if (r < 0)
+        return r;
+
+    r = sd_bus_message_append(m, "b", open_coredump);
+    if (r < 0)
+        return r;
+
+    r = sd_bus_call(bus, m, CLIENT_METHOD_TIMEOUT_USEC, &error, NULL);
+    if (r < 0)
+        return client_call_failed(&error, r);
+
+    return OK;
+}
+
+/*通过服务安装一个或多个模块的调试包，等待安装结束后返回：
+*
+* module_names：模块名，多个模块名用","分隔。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 服务不可用：返回 CLIENT_UNAVAILABLE；
+* 失败：返回 ERR_RET。*/
+int client_install_dbgpkgs(const char *module_names) {
+    _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+    _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+    _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+    _cleanup_strv_free_ char **modules = NULL;
+    job_wait w = {};
+    int count = 0, r;
+
+    assert(module_names);
+
+    modules = parseString(module_names, ",", &count);
+    if (count <= 0 || !modules) {
+        fprintf(stderr, N_("Error: Invalid module_name: %s\n"), module_names);
+        return ERROR;
+    }
+
+    r = client_open(&bus);
+    if (r != OK)
+        return r;
+
+    r = job_wait_subscribe(bus, &w);
+    if (r < 0)
+        return CLIENT_UNAVAILABLE;
+
+    r = sd_bus_message_new_method_call(bus, &m, DEBUG_CONFIG_DBUS_NAME, DEBUG_CONFIG_DBUS_PATH,
+                                       DEBUG_CONFIG_DBUS_INTERFACE, "InstallDbg");
+    if (r < 0)
+        return r;
+
+    r = sd_bus_message_append_strv(m, modules);
+    if (r < 0)
+        return r;
+
+    r = sd_bus_call(bus, m, CLIENT_METHOD_TIMEOUT_USEC, &error, &reply);
+    if (r < 0)
+        return client_call_failed(&error, r);
+
+    r = job_wait_run(bus, &w, reply);
+    job_wait_clear(&w);
+    return r;
+}
+
+/*通过服务为一个core安装调试包，等待安装结束后返回：
+*
+* core_name：DEFAULT_CORE_PATH下的core文件名，服务不接受其它路径。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 服务不可用：返回 CLIENT_UNAVAILABLE；
+* 失败：返回 ERR_RET。*/
+int client_install_core_dbgpkgs(const char *core_name) {
+    _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+    _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+    _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+    job_wait w = {};
+    int r;
+
+    assert(core_name);
+
+    r = client_open(&bus);
+    if (r != OK)
+        return r;
+
+    r = job_wait_subscribe(bus, &w);
+    if (r < 0)
+        return CLIENT_UNAVAILABLE;
+
+    r = sd_bus_call_method(bus, DEBUG_CONFIG_DBUS_NAME, DEBUG_CONFIG_DBUS_PATH, DEBUG_CONFIG_DBUS_INTERFACE,
+                           "InstallDbgForCore", &error, &reply, "s", core_name);
+    if (r < 0)
+        return client_call_failed(&error, r);
+
+    r = job_wait_run(bus, &w, reply);
+    job_wait_clear(&w);
+    return r;
+}
+
+/*通过服务估算安装调试包需要的空间：
+*
+* module_names：模块名，多个模块名用","分隔；
+* est：保存结果。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 服务不可用：返回 CLIENT_UNAVAILABLE；
+* 失败：返回 ERR_RET。*/
+int client_estimate_dbgpkgs(const char *module_names, dbgsym_estimate *est) {
+    _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+    _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+    _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+    _cleanup_strv_free_ char **modules = NULL;
+    uint32_t packages, missing;
+    int count = 0, enough, r;
+
+    assert(module_names && est);
+
+    modules = parseString(module_names, ",", &count);
+    if (count <= 0 || !modules) {
+        fprintf(stderr, N_("Error: Invalid module_name: %s\n"), module_names);
+        return ERROR;
+    }
+
+    r = client_open(&bus);
+    if (r != OK)
+        return r;
+
+    r = sd_bus_message_new_method_call(bus, &m, DEBUG_CONFIG_DBUS_NAME, DEBUG_CONFIG_DBUS_PATH,
+                                       DEBUG_CONFIG_DBUS_INTERFACE, "EstimateDbg");
+    if (r < 0)
+        return r;
+
+    r = sd_bus_message_append_strv(m, modules);
+    if (r < 0)
+        return r;
+
+    r = sd_bus_call(bus, m, CLIENT_METHOD_TIMEOUT_USEC, &error, &reply);
+    if (r < 0)
+        return client_call_failed(&error, r);
+
+    r = sd_bus_message_read(reply, "uutttb", &packages, &missing, &est->download_size,
+                            &est->installed_size, &est->available_size, &enough);
+    if (r < 0)
+        return r;
+
+    est->packages = packages;
+    est->missing = missing;
+    est->enough_space = enough;
+    return OK;
+}
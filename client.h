@@ -0,0 +1,21 @@
+#ifndef CLIENT_H_included
+#define CLIENT_H_included 1
+#include <stdbool.h>
+#include "dbgsym.h"
+
+//服务不可用（没有system bus或者服务没有安装），调用者应该在本进程中直接执行
+#define CLIENT_UNAVAILABLE 1
+
+//设置环境变量DEEPIN_DEBUG_CONFIG_NO_BUS=1时不访问服务，直接在本进程中执行
+#define CLIENT_NO_BUS_ENV "DEEPIN_DEBUG_CONFIG_NO_BUS"
+
+bool client_enabled();
+int client_get_debug_level(const char *module, char **level);
+int client_get_module_names(char ***names);
+int client_set_debug_level(const char *module_names, const char *level);
+int client_set_profile(const char *profile);
+int client_set_coredump(bool open_coredump);
+int client_install_dbgpkgs(const char *module_names);
+int client_install_core_dbgpkgs(const char *core_name);
+int client_estimate_dbgpkgs(const char *module_names, dbgsym_estimate *est);
+#endif
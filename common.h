@@ -4,12 +4,12 @@
 #define PACKAGE "deepin-debug-config"
 #define LOCALEDIR "/usr/share/locale/"
 
-#define INSTALL_DBGPKG_SHELL_PATH "/usr/share/deepin-debug-config/shell/installdbg.sh"
-#define CONFIG_COREDUMP_SHELL_PATH "/usr/share/deepin-debug-config/shell/setting_coredump.sh"
 #define CONFIG_SHELL_PATH "/usr/share/deepin-debug-config/shell"
 #define MODULES_DEBUG_CONFIG_PATH "/usr/share/deepin-debug-config/deepin-debug-config.d"
 #define MODULES_DEBUG_LEVELS_PATH "/var/lib/deepin-debug-config/deepin-debug-levels.cfg"
 #define DEFAULT_CORE_PATH "/var/lib/systemd/coredump/"
+#define REGISTRY_CACHE_PATH "/var/cache/deepin-debug-config/registry.cache"
+#define METRICS_TEXTFILE_PATH "/var/lib/deepin-debug-config/deepin_debug_config.prom"
 
 #define CONFIG_SHELL_IN_CODE_PATH "out/deepin-debug-config/shell"
 #define MD5_DIGEST_LENGTH 16
@@ -21,6 +21,17 @@
 #define JOURNAL_LOG_ON_INSTALLED "/etc/systemd/journald.conf.d/00-on-deepin-config-debug.conf"
 #define JOURNAL_LOG_OFF_INSTALLED "/etc/systemd/journald.conf.d/00-off-deepin-config-debug.conf"
 #define JOURNAL_LOG_PATH "/etc/systemd/journald.conf.d/"
+
+/*服务在system bus上的名字和对象，命令行工具也通过它们访问服务*/
+#define DEBUG_CONFIG_DBUS_NAME "org.deepin.DebugConfig"
+#define DEBUG_CONFIG_DBUS_INTERFACE "org.deepin.DebugConfig"
+#define DEBUG_CONFIG_DBUS_PATH "/org/deepin/DebugConfig"
+#define DEBUG_CONFIG_JOB_INTERFACE "org.deepin.DebugConfig.Job"
+#define DEBUG_CONFIG_JOB_PATH "/org/deepin/DebugConfig/job"
+#define DEBUG_CONFIG_MODULE_INTERFACE "org.deepin.DebugConfig.Module"
+#define DEBUG_CONFIG_MODULES_PATH "/org/deepin/DebugConfig/modules"
+#define DEBUG_CONFIG_METRICS_INTERFACE "org.deepin.DebugConfig.Metrics"
+
 #define OK      0
 #define ERROR   errno?-errno:-1
 #endif
@@ -0,0 +1,201 @@
+#include "coredump.h"
+#include "dbgsym.h"
+#include "util.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+//打开时显式写Storage=external，覆盖旧版本脚本留在coredump.conf中的Storage=none
+#define COREDUMP_DROPIN_ON "[Coredump]\nStorage=external\n"
+//ProcessSizeMax=0让systemd-coredump不再读取和处理core
+#define COREDUMP_DROPIN_OFF "[Coredump]\nStorage=none\nProcessSizeMax=0\n"
+
+//systemd-coredump没有安装时安装与systemd同版本的包
+static int ensure_coredump_package() {
+    char *version, *args;
+    int r;
+
+    version = dpkg_installed_version(COREDUMP_PACKAGE);
+    if (version) {
+        free(version);
+        return OK;
+    }
+
+    version = dpkg_installed_version("systemd");
+    if (!version) {
+        fprintf(stderr, "Cannot find package_version for systemd\n");
+        return ERROR;
+    }
+    args = g_strdup_printf("install -y %s=%s", COREDUMP_PACKAGE, version);
+    r = start_process(APT_GET_PATH, args, NULL);
+    g_free(args);
+    free(version);
+    return r == 0 ? OK : ERROR;
+}
+
+//内容没有变化时返回true，不重复写文件
+static bool file_has_content(const char *path, const char *content) {
+    gchar *old = NULL;
+    bool same;
+
+    if (!g_file_get_contents(path, &old, NULL, NULL))
+        return false;
+    same = strcmp(old, content) == 0;
+    g_free(old);
+    return same;
+}
+
+//先写同目录下的临时文件再rename，systemd-coredump不会读到写了一半的配置
+static int write_file_atomic(const char *path, const char *content) {
+    char tmp[PATH_MAX] = {0};
+    size_t len = strlen(content);
+    int fd, r = OK;
+
+    snprintf(tmp, PATH_MAX, "%s.XXXXXX", path);
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        r = -errno;
+        fprintf(stderr, "Failed to create %s: %m\n", tmp);
+        return r;
+    }
+    fchmod(fd, 0644);
+
+    errno = 0;
+    if (write(fd, content, len) != (ssize_t)len || fsync(fd) < 0)
+        r = errno ? -errno : -EIO;
+    close(fd);
+
+    if (r == OK && rename(tmp, path) < 0)
+        r = -errno;
+    if (r != OK) {
+        fprintf(stderr, "Failed to write %s: %s\n", path, strerror(-r));
+        unlink(tmp);
+    }
+    return r;
+}
+
+static int write_dropin(bool enable) {
+    const char *content = enable ? COREDUMP_DROPIN_ON : COREDUMP_DROPIN_OFF;
+
+    if (file_has_content(COREDUMP_DROPIN_PATH, content)) {
+        fprintf(stdout, enable ? "Coredump are already enabled.\n" : "Coredump are already disabled.\n");
+        return OK;
+    }
+    if (mkdir(COREDUMP_DROPIN_DIR, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create %s: %m\n", COREDUMP_DROPIN_DIR);
+        return ERROR;
+    }
+    if (write_file_atomic(COREDUMP_DROPIN_PATH, content) < 0)
+        return ERROR;
+    fprintf(stdout, enable ? "Coredump are enabled.\n" : "Coredump are disabled.\n");
+    return OK;
+}
+
+//key为sysctl.d格式，如kernel.core_pattern，对应/proc/sys/kernel/core_pattern
+static int write_sysctl(const char *key, const char *value) {
+    char path[PATH_MAX] = {0};
+    size_t len = strlen(value);
+    int fd, r = OK;
+
+    snprintf(path, PATH_MAX, PROC_SYS_PATH "/%s", key);
+    //第一个分隔符是/时，键中的.是名字的一部分
+    if (!strchr(key, '/')) {
+        for (char *p = path + strlen(PROC_SYS_PATH); *p; p++) {
+            if (*p == '.')
+                *p = '/';
+        }
+    }
+
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    errno = 0;
+    if (write(fd, value, len) != (ssize_t)len)
+        r = errno ? -errno : -EIO;
+    close(fd);
+    return r;
+}
+
+/*直接应用COREDUMP_SYSCTL_PATH中的设置，不用等到重启或运行systemd-sysctl，
+* 与systemd-sysctl一样，以-开头的键写入失败时忽略：
+*
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回负的错误码。*/
+static int apply_coredump_sysctls() {
+    char *line = NULL;
+    size_t len = 0;
+    FILE *fp;
+    int ret = OK;
+
+    fp = fopen(COREDUMP_SYSCTL_PATH, "re");
+    if (!fp) {
+        ret = -errno;
+        fprintf(stderr, "Failed to open %s: %m\n", COREDUMP_SYSCTL_PATH);
+        return ret;
+    }
+
+    while (getline(&line, &len, fp) != -1) {
+        char *key, *value, *eq;
+        bool ignore_failure = false;
+        int r;
+
+        g_strstrip(line);
+        if (line[0] == '\0' || line[0] == '#' || line[0] == ';')
+            continue;
+        eq = strchr(line, '=');
+        if (!eq)
+            continue;
+        *eq = '\0';
+        key = g_strstrip(line);
+        value = g_strstrip(eq + 1);
+        if (key[0] == '-') {
+            ignore_failure = true;
+            key++;
+        }
+        if (key[0] == '\0')
+            continue;
+
+        r = write_sysctl(key, value);
+        if (r < 0 && !ignore_failure) {
+            fprintf(stderr, "Failed to set %s: %s\n", key, strerror(-r));
+            ret = r;
+        }
+    }
+
+    free(line);
+    fclose(fp);
+    return ret;
+}
+
+/*打开或关闭coredump：写入COREDUMP_DROPIN_PATH，打开时还会安装systemd-coredump
+* 并应用它的sysctl设置。systemd-coredump每次处理core时都重新读取配置，
+* 所以不需要重新加载systemd：
+*
+* enable：true表示打开coredump，false表示关闭coredump。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int coredump_configure(bool enable) {
+    int r;
+
+    if (enable) {
+        r = ensure_coredump_package();
+        if (r < 0)
+            return r;
+    }
+
+    r = write_dropin(enable);
+    if (r < 0)
+        return r;
+
+    //关闭时保留core_pattern，core仍交给systemd-coredump，由drop-in丢弃
+    if (enable && apply_coredump_sysctls() < 0)
+        return ERROR;
+    return OK;
+}
@@ -0,0 +1,15 @@
+#ifndef COREDUMP_H_included
+#define COREDUMP_H_included 1
+#include <stdbool.h>
+#include "common.h"
+
+#define COREDUMP_PACKAGE "systemd-coredump"
+//只写自己的drop-in，不修改管理员维护的/etc/systemd/coredump.conf
+#define COREDUMP_DROPIN_DIR "/etc/systemd/coredump.conf.d"
+#define COREDUMP_DROPIN_PATH COREDUMP_DROPIN_DIR "/deepin-debug-config.conf"
+//systemd-coredump安装的sysctl配置，其中有kernel.core_pattern等
+#define COREDUMP_SYSCTL_PATH "/usr/lib/sysctl.d/50-coredump.conf"
+#define PROC_SYS_PATH "/proc/sys"
+
+int coredump_configure(bool enable);
+#endif
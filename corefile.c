@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include "corefile.h"
+#include "buildid.h"
+#include "util.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+
+#ifndef NT_FILE
+#define NT_FILE 0x46494c45
+#endif
+//core的PT_NOTE段包含所有线程的寄存器和NT_FILE，超过这个大小的不读取
+#define CORE_NOTES_MAX (64 * 1024 * 1024)
+//被映射的ELF文件的PT_NOTE段一般只有几十字节
+#define ELF_NOTES_MAX (64 * 1024)
+//程序头的数目超过这个值时认为ELF头已经损坏
+#define ELF_PHNUM_MAX 256
+//映射超过65535个时，core的e_phnum为PN_XNUM，实际数目在0号节头的sh_info中
+#define CORE_PHNUM_MAX (4 * 1024 * 1024)
+
+typedef struct core_file
+{
+    int fd;
+    Elf64_Phdr *loads;   // core中保存了内容的内存段
+    int loads_num;
+} core_file;
+
+static const struct {
+    const char *suffix;
+    const char *path;
+} decompressors[] = {
+    { ".zst", ZSTD_PATH },
+    { ".xz",  XZ_PATH },
+    { ".lz4", LZ4_PATH },
+};
+
+/*core的文件名不包含目录时，在DEFAULT_CORE_PATH下查找：
+*
+* 函数返回值：
+*
+* 成功：返回core的路径，需要调用者释放；
+* 失败：返回 NULL。*/
+char *corefile_resolve_path(const char *core) {
+    if (strchr(core, '/'))
+        return strdup(core);
+    return g_strconcat(DEFAULT_CORE_PATH, core, NULL);
+}
+
+//用解压程序把压缩的core解压到一个匿名临时文件中，in_fd总是会被关闭
+static int decompress_core(int in_fd, const char *tool) {
+    int out_fd, status, r;
+    pid_t pid;
+
+    out_fd = open(COREFILE_TMP_DIR, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (out_fd < 0 && errno == ENOENT)
+        out_fd = open(COREFILE_FALLBACK_TMP_DIR, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (out_fd < 0) {
+        r = -errno;
+        close(in_fd);
+        return r;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        r = -errno;
+        close(in_fd);
+        close(out_fd);
+        return r;
+    }
+    if (pid == 0) {
+        if (dup2(in_fd, STDIN_FILENO) < 0 || dup2(out_fd, STDOUT_FILENO) < 0)
+            _exit(127);
+        reset_signal_mask();
+        execl(tool, tool, "-dc", NULL);
+        _exit(127);
+    }
+    close(in_fd);
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            close(out_fd);
+            return -errno;
+        }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Failed to decompress the core with %s\n", tool);
+        close(out_fd);
+        return -EIO;
+    }
+    return out_fd;
+}
+
+static int open_core(const char *path) {
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0)
+        return -errno;
+
+    for (size_t i = 0; i < G_N_ELEMENTS(decompressors); i++) {
+        if (str_endsWith(path, decompressors[i].suffix))
+            return decompress_core(fd, decompressors[i].path);
+    }
+    return fd;
+}
+
+//core中只保存了部分内存，读取虚拟地址addr处的len字节
+static bool core_read_mem(const core_file *core, uint64_t addr, void *buf, size_t len) {
+    for (int i = 0; i < core->loads_num; i++) {
+        const Elf64_Phdr *p = &core->loads[i];
+
+        if (addr < p->p_vaddr || addr - p->p_vaddr >= p->p_filesz)
+            continue;
+        if (len > p->p_filesz - (addr - p->p_vaddr))
+            return false;
+        return pread(core->fd, buf, len, p->p_offset + (addr - p->p_vaddr)) == (ssize_t)len;
+    }
+    return false;
+}
+
+/*内核默认会dump文件映射的第一页，其中有ELF头和程序头。
+* 根据程序头算出加载偏移，再从内存中的PT_NOTE段读取build-id：
+*
+* start：文件的第一个映射的起始地址；
+* page_size：NT_FILE中记录的页大小。
+* 函数返回值：
+*
+* 找到：返回build-id，需要调用者释放；
+* 没有找到：返回 NULL。*/
+static char *core_module_build_id(const core_file *core, uint64_t start, uint64_t page_size) {
+    Elf64_Phdr *phdrs = NULL;
+    uint64_t base = UINT64_MAX, bias;
+    char *id = NULL;
+    Elf64_Ehdr ehdr;
+
+    if (!core_read_mem(core, start, &ehdr, sizeof(ehdr)))
+        return NULL;
+    if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 || ehdr.e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr.e_phentsize != sizeof(Elf64_Phdr) || ehdr.e_phnum == 0 || ehdr.e_phnum > ELF_PHNUM_MAX)
+        return NULL;
+
+    phdrs = calloc(ehdr.e_phnum, sizeof(Elf64_Phdr));
+    if (!phdrs || !core_read_mem(core, start + ehdr.e_phoff, phdrs, ehdr.e_phnum * sizeof(Elf64_Phdr)))
+        goto out;
+
+    for (int i = 0; i < ehdr.e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_vaddr < base)
+            base = phdrs[i].p_vaddr;
+    }
+    if (base == UINT64_MAX)
+        goto out;
+    bias = start - (base & ~(page_size - 1));
+
+    for (int i = 0; i < ehdr.e_phnum && !id; i++) {
+        void *notes;
+
+        if (phdrs[i].p_type != PT_NOTE || phdrs[i].p_filesz == 0 || phdrs[i].p_filesz > ELF_NOTES_MAX)
+            continue;
+        notes = malloc(phdrs[i].p_filesz);
+        if (notes && core_read_mem(core, bias + phdrs[i].p_vaddr, notes, phdrs[i].p_filesz))
+            id = buildid_find_note(notes, phdrs[i].p_filesz, phdrs[i].p_align == 8 ? 8 : 4);
+        free(notes);
+    }
+out:
+    free(phdrs);
+    return id;
+}
+
+/*解析NT_FILE：count、page_size，count个(start, end, file_ofs)，再是count个以NUL结尾的文件名。
+* 每个文件只取file_ofs为0的第一个映射，不是ELF的文件（字体、locale等）被跳过*/
+static int parse_nt_file(const core_file *core, const unsigned char *desc, size_t size, GArray *modules) {
+    GHashTable *seen;
+    const char *name, *names_end;
+    uint64_t count, page_size;
+
+    if (size < 2 * sizeof(uint64_t))
+        return -EINVAL;
+    memcpy(&count, desc, sizeof(uint64_t));
+    memcpy(&page_size, desc + sizeof(uint64_t), sizeof(uint64_t));
+    if (page_size == 0 || (page_size & (page_size - 1)) != 0 ||
+        count > (size - 2 * sizeof(uint64_t)) / (3 * sizeof(uint64_t)))
+        return -EINVAL;
+
+    name = (const char *)desc + (2 + 3 * count) * sizeof(uint64_t);
+    names_end = (const char *)desc + size;
+    seen = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (uint64_t i = 0; i < count && name < names_end; i++) {
+        size_t len = strnlen(name, names_end - name);
+        uint64_t entry[3];
+        core_module m = {0};
+
+        if (name + len == names_end)
+            break;
+        memcpy(entry, desc + (2 + 3 * i) * sizeof(uint64_t), sizeof(entry));
+
+        if (entry[2] == 0 && !g_hash_table_contains(seen, name)) {
+            g_hash_table_add(seen, (gpointer)name);
+
+            m.build_id = core_module_build_id(core, entry[0], page_size);
+            //ELF头没有被dump时，读取磁盘上的文件，文件被升级过时build-id可能不一致
+            if (m.build_id || buildid_read_elf(name, &m.build_id) == OK) {
+                m.path = strdup(name);
+                g_array_append_val(modules, m);
+            }
+        }
+        name += len + 1;
+    }
+
+    g_hash_table_destroy(seen);
+    return OK;
+}
+
+static int parse_core_notes(const core_file *core, const Elf64_Phdr *note, GArray *modules) {
+    unsigned char *notes;
+    size_t off = 0;
+    int r = -ENOENT;
+
+    if (note->p_filesz == 0 || note->p_filesz > CORE_NOTES_MAX)
+        return -ENOENT;
+    notes = malloc(note->p_filesz);
+    if (!notes)
+        return -ENOMEM;
+    if (pread(core->fd, notes, note->p_filesz, note->p_offset) != (ssize_t)note->p_filesz) {
+        free(notes);
+        return -EIO;
+    }
+
+    //core的note都按4字节对齐
+    while (off + sizeof(Elf64_Nhdr) <= note->p_filesz) {
+        Elf64_Nhdr nhdr;
+        size_t name_off, desc_off;
+
+        memcpy(&nhdr, notes + off, sizeof(nhdr));
+        name_off = off + sizeof(nhdr);
+        desc_off = name_off + ((nhdr.n_namesz + 3) & ~3U);
+        if (desc_off > note->p_filesz || nhdr.n_descsz > note->p_filesz - desc_off)
+            break;
+
+        if (nhdr.n_type == NT_FILE && nhdr.n_namesz == sizeof("CORE") &&
+            memcmp(notes + name_off, "CORE", sizeof("CORE")) == 0) {
+            r = parse_nt_file(core, notes + desc_off, nhdr.n_descsz, modules);
+            break;
+        }
+        off = desc_off + ((nhdr.n_descsz + 3) & ~3U);
+    }
+
+    free(notes);
+    return r;
+}
+
+//core的程序头数目，处理PN_XNUM
+static int core_phnum(int fd, const Elf64_Ehdr *ehdr, size_t *phnum) {
+    Elf64_Shdr shdr;
+
+    if (ehdr->e_phnum != PN_XNUM) {
+        *phnum = ehdr->e_phnum;
+        return OK;
+    }
+    if (ehdr->e_shoff == 0 || ehdr->e_shentsize != sizeof(Elf64_Shdr) ||
+        pread(fd, &shdr, sizeof(shdr), ehdr->e_shoff) != sizeof(shdr) ||
+        shdr.sh_info < PN_XNUM || shdr.sh_info > CORE_PHNUM_MAX)
+        return -EINVAL;
+    *phnum = shdr.sh_info;
+    return OK;
+}
+
+/*不借助gdb，直接从core的NT_FILE中读出进程映射的ELF文件和它们的build-id。
+* systemd-coredump压缩过的core先解压到临时文件中，只支持64位的core：
+*
+* core_path：core文件路径；
+* modules：保存结果，需要调用者用corefile_modules_free释放；
+* n：结果的数目。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回负的错误码。*/
+int corefile_read_modules(const char *core_path, core_module **modules, int *n) {
+    core_file core = { .fd = -1 };
+    GArray *result = NULL;
+    Elf64_Phdr *phdrs = NULL;
+    Elf64_Ehdr ehdr;
+    size_t phnum = 0;
+    int r = -ENOENT;
+
+    assert(core_path && modules && n);
+
+    core.fd = open_core(core_path);
+    if (core.fd < 0) {
+        fprintf(stderr, N_("Error: file %s,failed:%s\n"), core_path, strerror(-core.fd));
+        return core.fd;
+    }
+
+    if (pread(core.fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) ||
+        memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 || ehdr.e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr.e_type != ET_CORE || ehdr.e_phentsize != sizeof(Elf64_Phdr) || ehdr.e_phnum == 0 ||
+        core_phnum(core.fd, &ehdr, &phnum) < 0) {
+        fprintf(stderr, N_("Error: %s is not a 64-bit core file\n"), core_path);
+        r = -EINVAL;
+        goto out;
+    }
+
+    phdrs = calloc(phnum, sizeof(Elf64_Phdr));
+    if (!phdrs) {
+        r = -ENOMEM;
+        goto out;
+    }
+    if (pread(core.fd, phdrs, phnum * sizeof(Elf64_Phdr), ehdr.e_phoff) !=
+        (ssize_t)(phnum * sizeof(Elf64_Phdr))) {
+        r = -EIO;
+        goto out;
+    }
+
+    core.loads = calloc(phnum, sizeof(Elf64_Phdr));
+    if (!core.loads) {
+        r = -ENOMEM;
+        goto out;
+    }
+    for (size_t i = 0; i < phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_filesz > 0)
+            core.loads[core.loads_num++] = phdrs[i];
+    }
+
+    result = g_array_new(false, true, sizeof(core_module));
+    for (size_t i = 0; i < phnum && r == -ENOENT; i++) {
+        if (phdrs[i].p_type == PT_NOTE)
+            r = parse_core_notes(&core, &phdrs[i], result);
+    }
+    if (r < 0) {
+        fprintf(stderr, N_("Error: No NT_FILE note in %s\n"), core_path);
+        goto out;
+    }
+
+    *n = result->len;
+    *modules = (core_module *)(void *)g_array_free(result, false);
+    result = NULL;
+
+out:
+    if (result) {
+        for (unsigned i = 0; i < result->len; i++) {
+            free(g_array_index(result, core_module, i).path);
+            free(g_array_index(result, core_module, i).build_id);
+        }
+        g_array_free(result, true);
+    }
+    free(core.loads);
+    free(phdrs);
+    close(core.fd);
+    return r;
+}
+
+void corefile_modules_free(core_module *modules, int n) {
+    if (!modules)
+        return;
+    for (int i = 0; i < n; i++) {
+        free(modules[i].path);
+        free(modules[i].build_id);
+    }
+    g_free(modules);
+}
@@ -0,0 +1,25 @@
+#ifndef COREFILE_H_included
+#define COREFILE_H_included 1
+#include <stdbool.h>
+#include "common.h"
+
+//systemd-coredump压缩core时使用的解压程序
+#define ZSTD_PATH "/usr/bin/zstd"
+#define XZ_PATH "/usr/bin/xz"
+#define LZ4_PATH "/usr/bin/lz4"
+//解压后的core放在这个目录下的匿名临时文件中，core可能很大，不放在内存里。
+//服务只能写这个目录，目录不存在时（例如命令行在本进程中执行）使用/var/tmp
+#define COREFILE_TMP_DIR "/var/cache/deepin-debug-config"
+#define COREFILE_FALLBACK_TMP_DIR "/var/tmp"
+
+//core中映射的一个ELF文件
+typedef struct core_module
+{
+    char *path;       // NT_FILE中记录的文件路径
+    char *build_id;   // 从core的内存中读出的build-id，没有dump ELF头时为NULL
+} core_module;
+
+char *corefile_resolve_path(const char *core);
+int corefile_read_modules(const char *core_path, core_module **modules, int *n);
+void corefile_modules_free(core_module *modules, int n);
+#endif
@@ -0,0 +1,1097 @@
+#define _GNU_SOURCE
+#include "dbgsym.h"
+#include "buildid.h"
+#include "corefile.h"
+#include "elfdeps.h"
+#include "fetch.h"
+#include "util.h"
+#include <dirent.h>
+#include <glob.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <glib.h>
+
+#define DBGSYM_SUFFIX "-dbgsym"
+#define PACKAGES_LIST_SUFFIX "_Packages"
+#define DPKG_LIST_SUFFIX ".list"
+
+//dpkg状态文件或apt的Packages文件中的一段
+typedef struct control_stanza
+{
+    char *package;
+    char *version;
+    char *status;
+    uint64_t size;              // Packages中的Size，单位为字节
+    uint64_t installed_size;    // Installed-Size，单位为KiB
+} control_stanza;
+
+typedef void (*control_stanza_cb)(const control_stanza *st, void *userdata);
+
+static const struct {
+    const char *suffix;
+    const char *path;
+} list_decompressors[] = {
+    { ".gz",  GZIP_PATH },
+    { ".xz",  XZ_PATH },
+    { ".lz4", LZ4_PATH },
+    { ".zst", ZSTD_PATH },
+};
+
+typedef struct installed_pkg
+{
+    char *name;
+    char *version;
+} installed_pkg;
+
+//apt源中可用的一个包的大小
+typedef struct available_pkg
+{
+    uint64_t size;
+    uint64_t installed_size;    // 单位为字节
+} available_pkg;
+
+struct dbgsym_index
+{
+    GHashTable *installed;      // 包名 -> installed_pkg
+    GHashTable *dbg_source;     // 调试包源中可用的"包名=版本" -> available_pkg
+    GHashTable *main_source;    // 系统apt源中可用的"包名=版本" -> available_pkg
+};
+
+static void free_installed_pkg(void *t_pointer) {
+    installed_pkg *pkg = t_pointer;
+    if (!pkg) return;
+
+    free(pkg->name);
+    free(pkg->version);
+    free(pkg);
+}
+
+static void control_stanza_clear(control_stanza *st) {
+    free(st->package);
+    free(st->version);
+    free(st->status);
+    memset(st, 0, sizeof(control_stanza));
+}
+
+static char *strip_value(char *value) {
+    char *end;
+
+    while (*value == ' ' || *value == '\t')
+        value++;
+    end = value + strlen(value);
+    while (end > value && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+        *--end = '\0';
+    return value;
+}
+
+static void finish_stanza(control_stanza *st, control_stanza_cb cb, void *userdata) {
+    if (st->package && st->version)
+        cb(st, userdata);
+    control_stanza_clear(st);
+}
+
+//压缩的列表返回解压程序，未压缩的返回NULL
+static const char *list_decompressor(const char *path) {
+    for (size_t i = 0; i < G_N_ELEMENTS(list_decompressors); i++) {
+        if (str_endsWith(path, list_decompressors[i].suffix))
+            return list_decompressors[i].path;
+    }
+    return NULL;
+}
+
+//lists目录中的Packages文件，可能是压缩过的
+static bool is_packages_list(const char *name) {
+    const char *tool = list_decompressor(name);
+    size_t len = strlen(name);
+
+    if (tool)
+        len = strrchr(name, '.') - name;
+    return len >= strlen(PACKAGES_LIST_SUFFIX) &&
+           strncmp(name + len - strlen(PACKAGES_LIST_SUFFIX), PACKAGES_LIST_SUFFIX, strlen(PACKAGES_LIST_SUFFIX)) == 0;
+}
+
+/*打开控制文件，压缩的列表通过管道从解压程序读取：
+*
+* path：文件路径；
+* pid：保存解压进程的pid，未压缩时为0。
+* 函数返回值：
+*
+* 成功：返回文件流；
+* 失败：返回 NULL。*/
+static FILE *open_control_file(const char *path, pid_t *pid) {
+    const char *tool = list_decompressor(path);
+    int fds[2];
+    FILE *fp;
+
+    *pid = 0;
+    if (!tool)
+        return fopen(path, "re");
+
+    if (access(path, R_OK) < 0 || pipe2(fds, O_CLOEXEC) < 0)
+        return NULL;
+    *pid = fork();
+    if (*pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return NULL;
+    }
+    if (*pid == 0) {
+        if (dup2(fds[1], STDOUT_FILENO) < 0)
+            _exit(127);
+        reset_signal_mask();
+        execl(tool, tool, "-dc", path, NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+
+    fp = fdopen(fds[0], "r");
+    if (!fp) {
+        close(fds[0]);
+        (void) kill(*pid, SIGTERM);
+        (void) waitpid(*pid, NULL, 0);
+        return NULL;
+    }
+    return fp;
+}
+
+//关闭控制文件，解压程序失败时返回 ERR_RET
+static int close_control_file(FILE *fp, pid_t pid) {
+    int status;
+
+    fclose(fp);
+    if (pid == 0)
+        return OK;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return ERROR;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? OK : ERROR;
+}
+
+/*逐段解析deb822格式的控制文件，只读取需要的字段：
+*
+* path：文件路径；
+* dbgsym_only：只关心调试包，其它包的段直接跳过，用于很大的Packages文件；
+* cb：每一段调用一次的回调函数。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+static int parse_control_file(const char *path, bool dbgsym_only, control_stanza_cb cb, void *userdata) {
+    control_stanza st = {0};
+    char *line = NULL;
+    size_t len = 0;
+    bool skip = false;
+    pid_t pid;
+    FILE *fp;
+
+    fp = open_control_file(path, &pid);
+    if (!fp)
+        return ERROR;
+
+    while (getline(&line, &len, fp) != -1) {
+        char *value;
+
+        if (line[0] == '\n' || line[0] == '\r' || line[0] == '\0') {
+            finish_stanza(&st, cb, userdata);
+            skip = false;
+            continue;
+        }
+        //续行和不需要的段
+        if (skip || line[0] == ' ' || line[0] == '\t')
+            continue;
+
+        value = strchr(line, ':');
+        if (!value)
+            continue;
+        *value++ = '\0';
+        value = strip_value(value);
+
+        if (strcmp(line, "Package") == 0) {
+            if (dbgsym_only && !str_endsWith(value, DBGSYM_SUFFIX)) {
+                skip = true;
+                continue;
+            }
+            st.package = strdup(value);
+        } else if (strcmp(line, "Version") == 0) {
+            st.version = strdup(value);
+        } else if (strcmp(line, "Status") == 0) {
+            st.status = strdup(value);
+        } else if (strcmp(line, "Size") == 0) {
+            st.size = g_ascii_strtoull(value, NULL, 10);
+        } else if (strcmp(line, "Installed-Size") == 0) {
+            st.installed_size = g_ascii_strtoull(value, NULL, 10);
+        }
+    }
+    if (!skip)
+        finish_stanza(&st, cb, userdata);
+    control_stanza_clear(&st);
+
+    free(line);
+    return close_control_file(fp, pid);
+}
+
+static void index_installed(const control_stanza *st, void *userdata) {
+    dbgsym_index *idx = userdata;
+    installed_pkg *pkg;
+
+    if (!st->status || strcmp(st->status, "install ok installed") != 0)
+        return;
+    //Multi-Arch: same的包在状态文件中会出现多次，只保留一个
+    if (g_hash_table_contains(idx->installed, st->package))
+        return;
+
+    pkg = malloc(sizeof(installed_pkg));
+    assert(pkg);
+    pkg->name = strdup(st->package);
+    pkg->version = strdup(st->version);
+    g_hash_table_insert(idx->installed, pkg->name, pkg);
+}
+
+static void index_available(const control_stanza *st, void *userdata) {
+    GHashTable *available = userdata;
+    available_pkg *pkg = g_new0(available_pkg, 1);
+
+    pkg->size = st->size;
+    pkg->installed_size = st->installed_size * 1024;
+    g_hash_table_replace(available, g_strdup_printf("%s=%s", st->package, st->version), pkg);
+}
+
+//读取apt的lists目录中所有的Packages文件，包括压缩过的
+static void load_lists(const char *dir_path, GHashTable *available) {
+    struct dirent *pdirent;
+    char path[PATH_MAX] = {0};
+    DIR *pdir;
+
+    pdir = opendir(dir_path);
+    if (!pdir)
+        return;
+
+    for (pdirent = readdir(pdir); pdirent != NULL; pdirent = readdir(pdir)) {
+        if (!is_packages_list(pdirent->d_name))
+            continue;
+        snprintf(path, PATH_MAX, "%s/%s", dir_path, pdirent->d_name);
+        if (parse_control_file(path, true, index_available, available) < 0)
+            fprintf(stderr, "Failed to read the package list %s\n", path);
+    }
+    closedir(pdir);
+}
+
+/*读取dpkg的状态文件、调试包源和系统apt源的Packages文件，建立索引：
+*
+* 函数返回值：
+*
+* 成功：返回索引，需要用dbgsym_index_free释放；
+* 失败：返回 NULL。*/
+dbgsym_index *dbgsym_index_load() {
+    dbgsym_index *idx;
+
+    idx = malloc(sizeof(dbgsym_index));
+    if (!idx)
+        return NULL;
+
+    idx->installed = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_installed_pkg);
+    idx->dbg_source = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    idx->main_source = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    if (parse_control_file(DPKG_STATUS_PATH, false, index_installed, idx) < 0) {
+        fprintf(stderr, N_("Error: file %s,failed:%m\n"), DPKG_STATUS_PATH);
+        dbgsym_index_free(idx);
+        return NULL;
+    }
+    load_lists(DBG_LISTS_PATH, idx->dbg_source);
+    load_lists(APT_LISTS_PATH, idx->main_source);
+
+    return idx;
+}
+
+void dbgsym_index_free(dbgsym_index *idx) {
+    if (!idx)
+        return;
+
+    g_hash_table_destroy(idx->installed);
+    g_hash_table_destroy(idx->dbg_source);
+    g_hash_table_destroy(idx->main_source);
+    free(idx);
+}
+
+typedef struct version_lookup
+{
+    const char *package;
+    char *version;
+} version_lookup;
+
+static void find_installed(const control_stanza *st, void *userdata) {
+    version_lookup *l = userdata;
+
+    if (l->version || strcmp(st->package, l->package) != 0)
+        return;
+    if (st->status && strcmp(st->status, "install ok installed") == 0)
+        l->version = strdup(st->version);
+}
+
+/*从dpkg的状态文件中查询一个包的安装版本，不需要运行dpkg-query：
+*
+* package：包名。
+* 函数返回值：
+*
+* 已安装：返回版本号，需要用free释放；
+* 未安装或读取失败：返回 NULL。*/
+char *dpkg_installed_version(const char *package) {
+    version_lookup l = { package, NULL };
+
+    assert(package);
+
+    if (parse_control_file(DPKG_STATUS_PATH, false, find_installed, &l) < 0)
+        return NULL;
+    return l.version;
+}
+
+//"包名.list"或"包名:架构.list"中的包名，包名本身可以含有.，例如libglib2.0-0
+static char *list_package_name(const char *list_name) {
+    size_t len = strlen(list_name) - strlen(DPKG_LIST_SUFFIX);
+    const char *colon = memchr(list_name, ':', len);
+
+    return strndup(list_name, colon ? (size_t)(colon - list_name) : len);
+}
+
+//返回是否新加入了spec
+static bool plan_add(char ***l, int *n, const char *spec) {
+    char **t;
+
+    for (int i = 0; i < *n; i++) {
+        if (strcmp((*l)[i], spec) == 0)
+            return false;
+    }
+
+    t = realloc(*l, sizeof(char *) * (*n + 2));
+    assert(t);
+    t[*n] = strdup(spec);
+    t[*n + 1] = NULL;
+    *l = t;
+    (*n)++;
+    return true;
+}
+
+static void plan_add_available(char ***l, int *n, const char *spec, const available_pkg *pkg, dbgsym_plan *plan) {
+    if (plan_add(l, n, spec)) {
+        plan->download_size += pkg->size;
+        plan->installed_size += pkg->installed_size;
+        if (l == &plan->from_main_source)
+            plan->main_download_size += pkg->size;
+    }
+}
+
+//p对应的"包名-dbgsym=版本"按是否已安装、在哪个源中可用加入plan
+static void plan_add_package(dbgsym_index *idx, const installed_pkg *p, dbgsym_plan *plan) {
+    installed_pkg *dbg;
+    available_pkg *pkg;
+    char *name, *spec;
+
+    name = g_strconcat(p->name, DBGSYM_SUFFIX, NULL);
+    spec = g_strdup_printf("%s=%s", name, p->version);
+
+    dbg = g_hash_table_lookup(idx->installed, name);
+    if (dbg && strcmp(dbg->version, p->version) == 0)
+        plan->installed_num++;
+    else if ((pkg = g_hash_table_lookup(idx->dbg_source, spec)))
+        plan_add_available(&plan->from_dbg_source, &plan->from_dbg_source_num, spec, pkg, plan);
+    else if ((pkg = g_hash_table_lookup(idx->main_source, spec)))
+        plan_add_available(&plan->from_main_source, &plan->from_main_source_num, spec, pkg, plan);
+    else
+        (void) plan_add(&plan->missing, &plan->missing_num, spec);
+
+    g_free(name);
+    g_free(spec);
+}
+
+//软件包中可能是ELF的文件：普通文件并且可执行或者是共享库，图标、文档等不需要打开
+static GPtrArray *package_elf_files(const char *package) {
+    GPtrArray *files = g_ptr_array_new_with_free_func(free);
+    char pattern[PATH_MAX] = {0};
+    char *line = NULL;
+    size_t len = 0;
+    glob_t g = {0};
+
+    //Multi-Arch: same的包的文件列表带有架构
+    snprintf(pattern, PATH_MAX, "%s/%s.list", DPKG_INFO_PATH, package);
+    if (access(pattern, F_OK) != 0)
+        snprintf(pattern, PATH_MAX, "%s/%s:*.list", DPKG_INFO_PATH, package);
+    if (glob(pattern, 0, NULL, &g) != 0)
+        return files;
+
+    for (size_t i = 0; i < g.gl_pathc; i++) {
+        FILE *fp = fopen(g.gl_pathv[i], "r");
+        ssize_t l;
+
+        if (!fp)
+            continue;
+        while ((l = getline(&line, &len, fp)) != -1) {
+            struct stat st;
+
+            if (l > 0 && line[l - 1] == '\n')
+                line[l - 1] = '\0';
+            if (lstat(line, &st) < 0 || !S_ISREG(st.st_mode))
+                continue;
+            if ((st.st_mode & 0111) || strstr(Basename(line), ".so"))
+                g_ptr_array_add(files, strdup(line));
+        }
+        fclose(fp);
+    }
+
+    free(line);
+    globfree(&g);
+    return files;
+}
+
+/*计算安装一个软件包的调试符号需要的调试包：这个包本身，以及它的可执行文件和库
+* 沿DT_NEEDED依赖的所有共享库所属的包，各自对应的"包名-dbgsym=版本"。
+* 依赖的包按各自安装的版本计算。结果追加到plan中，多次调用时重复的包只出现一次：
+*
+* idx：dbgsym_index_load返回的索引；
+* package：软件包名；
+* plan：保存结果。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 软件包没有安装：返回 ERR_RET。*/
+int dbgsym_resolve(dbgsym_index *idx, const char *package, dbgsym_plan *plan) {
+    GPtrArray *files;
+    char **libs = NULL, **owners = NULL;
+    int libs_num = 0, r;
+
+    r = dbgsym_resolve_package(idx, package, plan);
+    if (r < 0)
+        return r;
+
+    files = package_elf_files(package);
+    r = elfdeps_closure((char **)files->pdata, files->len, &libs, &libs_num);
+    g_ptr_array_unref(files);
+    if (r < 0 || libs_num == 0)
+        goto out;
+
+    owners = g_new0(char *, libs_num + 1);
+    if (dbgsym_find_owners(libs, libs_num, owners) < 0)
+        goto out;
+
+    for (int i = 0; i < libs_num; i++) {
+        installed_pkg *p;
+
+        //不属于任何包的库（例如手动安装到/usr/local的）没有调试包
+        if (!owners[i])
+            continue;
+        p = g_hash_table_lookup(idx->installed, owners[i]);
+        if (p)
+            plan_add_package(idx, p, plan);
+    }
+
+out:
+    for (int i = 0; owners && i < libs_num; i++)
+        free(owners[i]);
+    g_free(owners);
+    g_strfreev(libs);
+    return OK;
+}
+
+/*只计算一个软件包自己的调试包，不包含它依赖的库，
+* 用于已经知道具体需要哪些文件的调试符号的情况。参数和返回值与dbgsym_resolve相同*/
+int dbgsym_resolve_package(dbgsym_index *idx, const char *package, dbgsym_plan *plan) {
+    installed_pkg *pkg;
+
+    assert(idx && package && plan);
+
+    pkg = g_hash_table_lookup(idx->installed, package);
+    if (!pkg) {
+        fprintf(stderr, N_("Error: Cannot find the installed version of %s\n"), package);
+        return -ENOENT;
+    }
+
+    plan_add_package(idx, pkg, plan);
+    return OK;
+}
+
+//把文件路径和它在/usr合并前后的另一个路径都加入wanted
+static void add_wanted_path(GHashTable *wanted, const char *path, int i) {
+    static const char *const merged[] = { "/bin/", "/sbin/", "/lib" };
+
+    g_hash_table_insert(wanted, g_strdup(path), GINT_TO_POINTER(i + 1));
+    for (size_t j = 0; j < G_N_ELEMENTS(merged); j++) {
+        if (g_str_has_prefix(path, merged[j]))
+            g_hash_table_insert(wanted, g_strconcat("/usr", path, NULL), GINT_TO_POINTER(i + 1));
+        else if (g_str_has_prefix(path, "/usr") && g_str_has_prefix(path + strlen("/usr"), merged[j]))
+            g_hash_table_insert(wanted, g_strdup(path + strlen("/usr")), GINT_TO_POINTER(i + 1));
+    }
+}
+
+/*通过dpkg的文件列表查找文件属于哪个软件包，所有文件列表只读一遍：
+*
+* paths：文件路径；
+* n：文件数目；
+* owners：保存每个文件所属的软件包名（不含架构），没有找到时为NULL，需要调用者释放每一项。
+* 函数返回值：
+*
+* 成功：返回找到的文件数目；
+* 失败：返回 ERR_RET。*/
+int dbgsym_find_owners(char **paths, int n, char **owners) {
+    GHashTable *wanted;
+    struct dirent *pdirent;
+    char path[PATH_MAX] = {0};
+    char *line = NULL;
+    size_t len = 0;
+    int found = 0;
+    DIR *pdir;
+
+    assert(paths || n == 0);
+
+    pdir = opendir(DPKG_INFO_PATH);
+    if (!pdir) {
+        fprintf(stderr, "Error: Failed to open dir %s, err: %m\n", DPKG_INFO_PATH);
+        return ERROR;
+    }
+
+    wanted = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (int i = 0; i < n; i++) {
+        owners[i] = NULL;
+        add_wanted_path(wanted, paths[i], i);
+    }
+
+    for (pdirent = readdir(pdir); pdirent != NULL && found < n; pdirent = readdir(pdir)) {
+        ssize_t l;
+        FILE *fp;
+
+        if (!str_endsWith(pdirent->d_name, DPKG_LIST_SUFFIX))
+            continue;
+        snprintf(path, PATH_MAX, "%s/%s", DPKG_INFO_PATH, pdirent->d_name);
+        fp = fopen(path, "r");
+        if (!fp)
+            continue;
+
+        while ((l = getline(&line, &len, fp)) != -1) {
+            int i;
+
+            if (l > 0 && line[l - 1] == '\n')
+                line[l - 1] = '\0';
+            i = GPOINTER_TO_INT(g_hash_table_lookup(wanted, line)) - 1;
+            if (i < 0 || owners[i])
+                continue;
+
+            owners[i] = list_package_name(pdirent->d_name);
+            found++;
+        }
+        fclose(fp);
+    }
+
+    free(line);
+    closedir(pdir);
+    g_hash_table_destroy(wanted);
+    return found;
+}
+
+void dbgsym_plan_clear(dbgsym_plan *plan) {
+    if (!plan)
+        return;
+    strv_free(plan->from_dbg_source);
+    strv_free(plan->from_main_source);
+    strv_free(plan->missing);
+    memset(plan, 0, sizeof(dbgsym_plan));
+}
+
+//开发包和sysv脚本包没有调试包，缺少它们不算失败
+static bool is_dev_or_sysv(const char *spec) {
+    _cleanup_free_ char *name = strdup(spec);
+    char *p = name ? strchr(name, '=') : NULL;
+
+    if (p)
+        *p = '\0';
+    return name && (str_endsWith(name, "-dev" DBGSYM_SUFFIX) || str_endsWith(name, "-sysv" DBGSYM_SUFFIX));
+}
+
+//apt-config shell的输出中的一行：名字='值'
+static char *shell_value(const char *output, const char *name) {
+    gchar **lines = g_strsplit(output, "\n", -1);
+    char *value = NULL;
+
+    for (gchar **l = lines; *l && !value; l++) {
+        size_t len = strlen(name);
+
+        if (strncmp(*l, name, len) == 0 && (*l)[len] == '=' && (*l)[len + 1] == '\'' && str_endsWith(*l, "'"))
+            value = g_strndup(*l + len + 2, strlen(*l) - len - 3);
+    }
+    g_strfreev(lines);
+    return value;
+}
+
+/*用apt-config读取apt下载文件的目录，conf为NULL时使用系统的apt配置：
+*
+* proxied：返回apt是否配置了代理，可为NULL。
+* 函数返回值：
+*
+* 成功：返回目录，需要调用者用g_free释放；
+* 读取配置失败：返回 NULL。*/
+static char *apt_config_archives(const char *conf, bool *proxied) {
+    char *output = NULL, *dir, *http_proxy, *https_proxy;
+    GString *args;
+    int r;
+
+    args = g_string_new(NULL);
+    if (conf)
+        g_string_append_printf(args, "-c %s ", conf);
+    g_string_append(args, "shell ARCHIVES Dir::Cache::archives/d HTTP_PROXY Acquire::http::Proxy HTTPS_PROXY Acquire::https::Proxy");
+    r = start_process(APT_CONFIG_PATH, args->str, &output);
+    g_string_free(args, TRUE);
+    if (r != 0 || !output) {
+        free(output);
+        return NULL;
+    }
+
+    http_proxy = shell_value(output, "HTTP_PROXY");
+    https_proxy = shell_value(output, "HTTPS_PROXY");
+    if (proxied)
+        *proxied = !(isempty(http_proxy) || strcmp(http_proxy, "DIRECT") == 0) ||
+                   !(isempty(https_proxy) || strcmp(https_proxy, "DIRECT") == 0);
+    dir = shell_value(output, "ARCHIVES");
+
+    g_free(http_proxy);
+    g_free(https_proxy);
+    free(output);
+    return dir;
+}
+
+/*apt下载文件的目录。配置了代理时不预先下载，apt的代理和认证设置由apt自己处理：
+*
+* 函数返回值：
+*
+* 成功：返回目录，需要调用者释放；
+* 配置了代理或者读取配置失败：返回 NULL。*/
+static char *apt_archives_dir(const char *conf) {
+    bool proxied = false;
+    char *dir;
+
+    if (!isempty(getenv("http_proxy")) || !isempty(getenv("https_proxy")))
+        return NULL;
+
+    dir = apt_config_archives(conf, &proxied);
+    if (proxied) {
+        g_free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+//apt-get --print-uris的一行：'URI' 文件名 大小 散列值
+static bool parse_print_uri(char *line, fetch_item *item) {
+    char *end, *saveptr = NULL, *filename, *size, *hash;
+
+    if (line[0] != '\'')
+        return false;
+    end = strchr(line + 1, '\'');
+    if (!end)
+        return false;
+    *end = '\0';
+    //file:等本地的源不需要预先下载
+    if (!g_str_has_prefix(line + 1, "http://") && !g_str_has_prefix(line + 1, "https://"))
+        return false;
+
+    filename = strtok_r(end + 1, " ", &saveptr);
+    size = strtok_r(NULL, " ", &saveptr);
+    hash = strtok_r(NULL, " \n", &saveptr);
+    if (!filename || !size || !hash)
+        return false;
+
+    item->uri = g_strdup(line + 1);
+    item->filename = g_strdup(filename);
+    item->size = g_ascii_strtoull(size, NULL, 10);
+    item->hash = g_strdup(hash);
+    item->result = OK;
+    return true;
+}
+
+/*预先并行下载要安装的包：边下载边校验Packages文件中的散列值，完成后放入apt的archives目录，
+* 之后的apt-get install直接使用；archives中已经有的文件跳过，中断的下载下次从断点继续。
+* 预先下载失败的文件仍然由apt下载，所以不返回错误。*/
+static void apt_prefetch(const char *conf, char **specs, int n) {
+    _cleanup_free_ char *archives = NULL;
+    char *output = NULL, *line, *saveptr = NULL;
+    fetch_item *items = NULL;
+    GString *args;
+    int count = 0, lines = 0, ok, r;
+
+    if (n == 0 || fetch_jobs() == 0)
+        return;
+    archives = apt_archives_dir(conf);
+    if (!archives)
+        return;
+
+    args = g_string_new(NULL);
+    if (conf)
+        g_string_append_printf(args, "-c %s ", conf);
+    //install --print-uris不输出散列值，download --print-uris输出，而且只列出指定的包
+    g_string_append(args, "-qq --print-uris download");
+    for (int i = 0; i < n; i++)
+        g_string_append_printf(args, " %s", specs[i]);
+    r = start_process(APT_GET_PATH, args->str, &output);
+    g_string_free(args, TRUE);
+    if (r != 0 || !output) {
+        free(output);
+        return;
+    }
+
+    for (const char *p = output; (p = strchr(p, '\n')); p++)
+        lines++;
+    items = g_new0(fetch_item, lines + 1);
+    for (line = strtok_r(output, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+        if (parse_print_uri(line, &items[count]))
+            count++;
+    }
+    free(output);
+
+    if (count > 0) {
+        ok = fetch_files(items, count, archives);
+        if (ok >= 0)
+            fprintf(stdout, "Prefetched %d of %d packages into %s\n", ok, count, archives);
+    }
+    fetch_items_free(items, count);
+}
+
+//用一次apt-get调用安装所有的包，conf为NULL时使用系统的apt配置
+static int apt_install(const char *conf, char **specs, int n) {
+    GString *args;
+    int r;
+
+    if (n == 0)
+        return OK;
+
+    apt_prefetch(conf, specs, n);
+
+    args = g_string_new(NULL);
+    if (conf)
+        g_string_append_printf(args, "-c %s ", conf);
+    g_string_append(args, "install -y");
+    for (int i = 0; i < n; i++)
+        g_string_append_printf(args, " %s", specs[i]);
+
+    fprintf(stdout, "Installing dbgsym packages: %s\n", args->str);
+    r = start_process(APT_GET_PATH, args->str, NULL);
+    g_string_free(args, TRUE);
+    return r == 0 ? OK : ERROR;
+}
+
+static uint64_t min_free_bytes() {
+    const char *e = getenv(DBG_MIN_FREE_ENV);
+    char *end = NULL;
+    long long v;
+
+    if (isempty(e))
+        return (uint64_t)DBG_MIN_FREE_MB << 20;
+    errno = 0;
+    v = strtoll(e, &end, 10);
+    if (errno != 0 || *end != '\0' || v < 0)
+        return (uint64_t)DBG_MIN_FREE_MB << 20;
+    return (uint64_t)v << 20;
+}
+
+//path所在文件系统的可用空间，path不存在时（例如还没有安装过调试包）使用上级目录
+static int fs_available(const char *path, dev_t *dev, uint64_t *avail) {
+    char *p = g_strdup(path);
+
+    for (;;) {
+        struct statvfs vfs;
+        struct stat st;
+        char *parent;
+
+        if (stat(p, &st) == 0 && statvfs(p, &vfs) == 0) {
+            *dev = st.st_dev;
+            *avail = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+            g_free(p);
+            return OK;
+        }
+        if (strcmp(p, "/") == 0)
+            break;
+        parent = g_path_get_dirname(p);
+        g_free(p);
+        p = parent;
+    }
+    g_free(p);
+    return -errno;
+}
+
+//安装需要写入的一个文件系统
+typedef struct fs_usage
+{
+    dev_t dev;
+    uint64_t avail;
+    uint64_t need;
+} fs_usage;
+
+//path所在的文件系统要写入bytes字节，同一个文件系统上的需求累加
+static int fs_usage_add(fs_usage *fs, int *n, const char *path, uint64_t bytes) {
+    dev_t dev;
+    uint64_t avail;
+    int r;
+
+    r = fs_available(path, &dev, &avail);
+    if (r < 0)
+        return r;
+    for (int i = 0; i < *n; i++) {
+        if (fs[i].dev == dev) {
+            fs[i].need += bytes;
+            return OK;
+        }
+    }
+    fs[(*n)++] = (fs_usage) { dev, avail, bytes };
+    return OK;
+}
+
+//apt下载到的目录，读取不到配置时使用fallback
+static char *archives_or_default(const char *conf, const char *fallback) {
+    char *dir = apt_config_archives(conf, NULL);
+    return dir ? dir : g_strdup(fallback);
+}
+
+/*检查安装后调试文件和下载目录所在的文件系统上是否都至少剩下DBG_MIN_FREE_MB的空间：
+*
+* dbg_archives、main_archives：从调试包源和系统apt源下载的包存放的目录；
+* install_avail：返回DEBUG_FILES_PATH所在文件系统的可用空间，可为NULL。
+* 函数返回值：
+*
+* 空间足够：返回 true；
+* 空间不够或读取失败：返回 false。*/
+static bool plan_fits(const dbgsym_plan *plan, const char *dbg_archives, const char *main_archives, uint64_t *install_avail) {
+    uint64_t reserve = min_free_bytes();
+    fs_usage fs[3];
+    int n = 0;
+
+    if (fs_usage_add(fs, &n, DEBUG_FILES_PATH, plan->installed_size) < 0)
+        return false;
+    if (install_avail)
+        *install_avail = fs[0].avail;
+    if (plan->download_size > plan->main_download_size &&
+        fs_usage_add(fs, &n, dbg_archives, plan->download_size - plan->main_download_size) < 0)
+        return false;
+    if (plan->main_download_size > 0 && fs_usage_add(fs, &n, main_archives, plan->main_download_size) < 0)
+        return false;
+
+    for (int i = 0; i < n; i++) {
+        if (fs[i].need + reserve > fs[i].avail)
+            return false;
+    }
+    return true;
+}
+
+/*估算执行安装计划需要下载的大小和占用的空间，并检查空间是否足够：调试文件安装到
+* DEBUG_FILES_PATH，下载的包放在各自apt配置的Dir::Cache::archives中，这些文件系统上
+* 安装后都要至少剩下DBG_MIN_FREE_MB的空间：
+*
+* plan：安装计划；
+* est：保存结果。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回负的错误码。*/
+int dbgsym_plan_estimate(const dbgsym_plan *plan, dbgsym_estimate *est) {
+    uint64_t reserve = min_free_bytes(), install_avail = 0;
+    char *dbg_archives = NULL, *main_archives = NULL;
+    dev_t install_dev;
+    int r;
+
+    assert(plan && est);
+
+    memset(est, 0, sizeof(dbgsym_estimate));
+    est->packages = plan->from_dbg_source_num + plan->from_main_source_num;
+    for (int i = 0; i < plan->missing_num; i++) {
+        if (!is_dev_or_sysv(plan->missing[i]))
+            est->missing++;
+    }
+    est->download_size = plan->download_size;
+    est->installed_size = plan->installed_size;
+
+    r = fs_available(DEBUG_FILES_PATH, &install_dev, &install_avail);
+    if (r < 0)
+        return r;
+
+    if (plan->download_size > plan->main_download_size)
+        dbg_archives = archives_or_default(dbgsym_apt_conf(), DBG_ARCHIVES_PATH);
+    if (plan->main_download_size > 0)
+        main_archives = archives_or_default(NULL, APT_ARCHIVES_PATH);
+
+    est->enough_space = plan_fits(plan, dbg_archives, main_archives, &install_avail);
+    est->available_size = install_avail > reserve ? install_avail - reserve : 0;
+
+    g_free(dbg_archives);
+    g_free(main_archives);
+    return OK;
+}
+
+//调试包源安装失败后从系统apt源重新安装，这时所有的包都下载到系统apt源的目录
+static bool fallback_fits(const dbgsym_plan *plan) {
+    dbgsym_plan all = *plan;
+    char *main_archives = archives_or_default(NULL, APT_ARCHIVES_PATH);
+    bool fits;
+
+    all.main_download_size = all.download_size;
+    fits = plan_fits(&all, NULL, main_archives, NULL);
+    g_free(main_archives);
+    return fits;
+}
+
+/*执行dbgsym_resolve计算出的安装计划。调试包源安装失败时再尝试系统的apt源：
+*
+* plan：安装计划。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int dbgsym_plan_install(const dbgsym_plan *plan) {
+    dbgsym_estimate est;
+    int r = OK;
+
+    assert(plan);
+
+    for (int i = 0; i < plan->missing_num; i++) {
+        if (!is_dev_or_sysv(plan->missing[i]))
+            fprintf(stderr, "No dbgsym package %s available, skip.\n", plan->missing[i]);
+    }
+
+    if (plan->from_dbg_source_num == 0 && plan->from_main_source_num == 0) {
+        for (int i = 0; i < plan->missing_num; i++) {
+            if (!is_dev_or_sysv(plan->missing[i])) {
+                fprintf(stderr, N_("Error: No matching dbgsym packages available to install.\n"));
+                return -ENOENT;
+            }
+        }
+        return OK;
+    }
+
+    //在下载之前拒绝空间不够的安装，不要等到dpkg解包到一半时才失败
+    if (dbgsym_plan_estimate(plan, &est) == OK && !est.enough_space) {
+        gchar *need = g_format_size(est.download_size + est.installed_size);
+        gchar *avail = g_format_size(est.available_size);
+
+        fprintf(stderr, N_("Error: Not enough disk space for dbgsym packages: need %s, %s available after keeping %d MiB free.\n"),
+                need, avail, (int)(min_free_bytes() >> 20));
+        g_free(need);
+        g_free(avail);
+        return -ENOSPC;
+    }
+
+    if (apt_install(dbgsym_apt_conf(), plan->from_dbg_source, plan->from_dbg_source_num) < 0) {
+        fprintf(stderr, "install from dbg source failed,now try to install from main source!\n");
+        if (fallback_fits(plan)) {
+            r = apt_install(NULL, plan->from_dbg_source, plan->from_dbg_source_num);
+        } else {
+            fprintf(stderr, N_("Error: Not enough disk space in the apt cache to install dbgsym packages from the main source.\n"));
+            r = -ENOSPC;
+        }
+    }
+    if (apt_install(NULL, plan->from_main_source, plan->from_main_source_num) < 0)
+        r = ERROR;
+    return r;
+}
+
+const char *dbgsym_apt_conf() {
+    const char *e = getenv(DBG_APT_CONF_ENV);
+
+    return isempty(e) ? DBG_APT_CONF_PATH : e;
+}
+
+static time_t lists_ttl_sec() {
+    const char *e = getenv(DBG_LISTS_TTL_ENV);
+    char *end = NULL;
+    long v;
+
+    if (isempty(e))
+        return DBG_LISTS_TTL_SEC;
+
+    errno = 0;
+    v = strtol(e, &end, 10);
+    if (errno != 0 || *end != '\0' || v < 0)
+        return DBG_LISTS_TTL_SEC;
+    return (time_t)v;
+}
+
+static bool has_packages_lists(const char *dir_path) {
+    struct dirent *pdirent;
+    bool found = false;
+    DIR *pdir;
+
+    pdir = opendir(dir_path);
+    if (!pdir)
+        return false;
+    for (pdirent = readdir(pdir); pdirent != NULL && !found; pdirent = readdir(pdir))
+        found = is_packages_list(pdirent->d_name);
+    closedir(pdir);
+    return found;
+}
+
+/*判断调试包源的列表是否还可以直接使用：上次更新没有超过TTL，
+* 之后源的配置没有变化，列表也没有被删除*/
+static bool lists_are_fresh(const char *conf) {
+    time_t ttl = lists_ttl_sec(), now = time(NULL);
+    struct stat stamp, st;
+
+    if (ttl == 0)
+        return false;
+    if (stat(DBG_LISTS_STAMP_PATH, &stamp) < 0)
+        return false;
+    //时钟被往回调过时也认为过期
+    if (stamp.st_mtime > now || now - stamp.st_mtime >= ttl)
+        return false;
+
+    if (stat(conf, &st) == 0 && st.st_mtime > stamp.st_mtime)
+        return false;
+    if (stat(DBG_SOURCES_LIST_PATH, &st) == 0 && st.st_mtime > stamp.st_mtime)
+        return false;
+    if (stat(DBG_SOURCE_PARTS_PATH, &st) == 0 && st.st_mtime > stamp.st_mtime)
+        return false;
+
+    return has_packages_lists(DBG_LISTS_PATH);
+}
+
+static void touch_lists_stamp() {
+    int fd;
+
+    fd = open(DBG_LISTS_STAMP_PATH, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, N_("Error: file %s,failed:%m\n"), DBG_LISTS_STAMP_PATH);
+        return;
+    }
+    (void) futimens(fd, NULL);
+    close(fd);
+}
+
+/*更新调试包源的软件包列表。列表在TTL内更新过时直接返回；需要更新时由apt
+* 用If-Modified-Since和Release文件中的哈希值判断哪些索引真的需要下载：
+*
+* force：忽略TTL，总是更新。
+* 函数返回值：
+*
+* 已更新：返回 0；
+* 列表还没有过期：返回 DBG_LISTS_FRESH；
+* 失败：返回 ERR_RET，之后只能使用已有的列表或系统的apt源。*/
+int dbgsym_refresh_lists(bool force) {
+    const char *conf = dbgsym_apt_conf();
+    char args[PATH_MAX] = {0};
+
+    if (access(conf, F_OK) < 0)
+        return ERROR;
+
+    if (!force && lists_are_fresh(conf))
+        return DBG_LISTS_FRESH;
+
+    //调试包源的列表总是解压保存，每次建立索引时不用再解压
+    snprintf(args, PATH_MAX, "-c %s -o Acquire::By-Hash=yes -o Acquire::GzipIndexes=false update", conf);
+    if (start_process(APT_GET_PATH, args, NULL) != 0) {
+        fprintf(stderr, "Failed to update the package lists of the dbg source.\n");
+        return ERROR;
+    }
+
+    touch_lists_stamp();
+    return OK;
+}
@@ -0,0 +1,81 @@
+#ifndef DBGSYM_H_included
+#define DBGSYM_H_included 1
+#include <stdbool.h>
+#include <stdint.h>
+#include "common.h"
+
+#define DPKG_STATUS_PATH "/var/lib/dpkg/status"
+#define APT_GET_PATH "/usr/bin/apt-get"
+#define APT_CONFIG_PATH "/usr/bin/apt-config"
+//Acquire::GzipIndexes等配置会让apt保留压缩的Packages文件，读取时用这些程序解压
+#define GZIP_PATH "/bin/gzip"
+#define APT_LISTS_PATH "/var/lib/apt/lists"
+//调试包源的apt配置，其中Dir::State::lists指向DBG_LISTS_PATH
+#define DBG_APT_CONF_PATH MODULES_DEBUG_CONFIG_PATH "/dbg.conf"
+#define DBG_LISTS_PATH "/var/lib/deepin-debug-config/lists"
+#define DBG_SOURCES_LIST_PATH MODULES_DEBUG_CONFIG_PATH "/sources.list"
+#define DBG_SOURCE_PARTS_PATH MODULES_DEBUG_CONFIG_PATH "/sources.list.d"
+//可以用这个环境变量指定另一个apt配置，例如指向本地file://或回环地址上的镜像做测试
+#define DBG_APT_CONF_ENV "DEEPIN_DEBUG_CONFIG_DBG_CONF"
+
+//上次成功更新调试包源的时间。apt update会删除lists目录中不认识的文件，所以放在目录外
+#define DBG_LISTS_STAMP_PATH "/var/lib/deepin-debug-config/dbg-lists.stamp"
+//列表在这段时间内更新过就不再更新，为0时每次都更新
+#define DBG_LISTS_TTL_SEC (6 * 3600)
+#define DBG_LISTS_TTL_ENV "DEEPIN_DEBUG_CONFIG_LISTS_TTL_SEC"
+//dbgsym_refresh_lists的返回值：列表还没有过期，没有更新
+#define DBG_LISTS_FRESH 1
+
+//调试包下载到这里，调试文件安装到DEBUG_FILES_PATH
+#define DBG_CACHE_PATH "/var/cache/deepin-debug-config"
+//读取不到apt的Dir::Cache::archives配置时，调试包源和系统apt源默认的下载目录
+#define DBG_ARCHIVES_PATH DBG_CACHE_PATH "/archives/"
+#define APT_ARCHIVES_PATH "/var/cache/apt/archives/"
+#define DEBUG_FILES_PATH "/usr/lib/debug"
+//安装后文件系统上至少要剩下的空间，单位为MiB，空间不够时拒绝安装
+#define DBG_MIN_FREE_MB 1024
+#define DBG_MIN_FREE_ENV "DEEPIN_DEBUG_CONFIG_MIN_FREE_MB"
+
+//已安装的软件包和apt源中可用的调试包
+typedef struct dbgsym_index dbgsym_index;
+
+//一次安装要执行的操作，列表中的每一项为"包名-dbgsym=版本"
+typedef struct dbgsym_plan
+{
+    char **from_dbg_source;   // 在调试包源中找到的包
+    int from_dbg_source_num;
+    char **from_main_source;  // 只在系统的apt源中找到的包
+    int from_main_source_num;
+    char **missing;           // 所有源中都没有的包
+    int missing_num;
+    int installed_num;        // 已经安装的调试包数目
+    uint64_t download_size;   // 要下载的包的大小，单位为字节
+    uint64_t main_download_size;  // download_size中从系统apt源下载的部分
+    uint64_t installed_size;  // 安装后占用的空间，单位为字节
+} dbgsym_plan;
+
+//安装计划的下载大小、占用空间和可用空间
+typedef struct dbgsym_estimate
+{
+    int packages;               // 要下载安装的调试包数目
+    int missing;                // 没有可用调试包的包数目
+    uint64_t download_size;
+    uint64_t installed_size;
+    uint64_t available_size;    // 扣除要保留的空间后的可用空间
+    bool enough_space;
+} dbgsym_estimate;
+
+dbgsym_index *dbgsym_index_load();
+void dbgsym_index_free(dbgsym_index *idx);
+char *dpkg_installed_version(const char *package);
+
+int dbgsym_resolve(dbgsym_index *idx, const char *package, dbgsym_plan *plan);
+int dbgsym_resolve_package(dbgsym_index *idx, const char *package, dbgsym_plan *plan);
+int dbgsym_find_owners(char **paths, int n, char **owners);
+int dbgsym_plan_estimate(const dbgsym_plan *plan, dbgsym_estimate *est);
+int dbgsym_plan_install(const dbgsym_plan *plan);
+void dbgsym_plan_clear(dbgsym_plan *plan);
+
+const char *dbgsym_apt_conf();
+int dbgsym_refresh_lists(bool force);
+#endif
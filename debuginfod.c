@@ -0,0 +1,463 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <time.h>
+
+#include <systemd/sd-event.h>
+#include <systemd/sd-daemon.h>
+
+#include <glib.h>
+
+#include "util.h"
+#include "buildid.h"
+
+/* 由deepin-debuginfod.socket在回环地址上激活，实现debuginfod协议中的
+ * /buildid/<id>/debuginfo和/buildid/<id>/executable，文件通过build-id索引找到后
+ * 用sendfile直接发送。调试包不带源码，/buildid/<id>/source/<path>总是返回404 */
+
+/* debuginfod的默认端口，没有被socket激活时自己监听127.0.0.1上的这个端口，方便本地测试 */
+#define DEBUGINFOD_PORT 8002
+#define DEBUGINFOD_MAX_THREADS 4
+#define DEBUGINFOD_REQUEST_MAX 8192
+#define DEBUGINFOD_IO_TIMEOUT_SEC 30
+
+#define IDLE_TIMEOUT_ENV "DEBUGINFOD_IDLE_TIMEOUT_SEC"
+#define DEFAULT_IDLE_TIMEOUT_USEC (60ULL * 1000000ULL)
+#define NO_EXIT_TIMEOUT UINT64_MAX
+
+typedef struct Server {
+        sd_event *event;
+        sd_event_source *idle_source;
+        GThreadPool *pool;
+        uint64_t idle_timeout;
+        gint active;    /* 正在处理的连接数，工作线程中用原子操作修改 */
+        bool exiting;
+} Server;
+
+typedef struct Request {
+        char method[8];
+        char *target;
+} Request;
+
+static const char *status_text(int status) {
+        switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 414: return "URI Too Long";
+        default: return "Internal Server Error";
+        }
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+        while (len > 0) {
+                ssize_t n = write(fd, buf, len);
+
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+                buf += n;
+                len -= n;
+        }
+        return 0;
+}
+
+static int send_error(int fd, int status) {
+        char header[256];
+        int n;
+
+        n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %d %s\r\n"
+                     "Content-Length: 0\r\n"
+                     "Connection: close\r\n\r\n",
+                     status, status_text(status));
+        return write_all(fd, header, n);
+}
+
+/* 读取请求行和请求头，不处理请求体，GET和HEAD请求都没有请求体 */
+static int read_request(int fd, Request *req) {
+        char buf[DEBUGINFOD_REQUEST_MAX + 1];
+        size_t len = 0;
+        char *end, *sp1, *sp2;
+
+        for (;;) {
+                ssize_t n;
+
+                if (len == DEBUGINFOD_REQUEST_MAX)
+                        return 414;
+                n = read(fd, buf + len, DEBUGINFOD_REQUEST_MAX - len);
+                if (n < 0 && errno == EINTR)
+                        continue;
+                if (n <= 0)
+                        return -EIO;
+                len += n;
+                buf[len] = '\0';
+                if (strstr(buf, "\r\n\r\n") || strstr(buf, "\n\n"))
+                        break;
+        }
+
+        end = strpbrk(buf, "\r\n");
+        *end = '\0';
+        sp1 = strchr(buf, ' ');
+        if (!sp1)
+                return 400;
+        *sp1++ = '\0';
+        sp2 = strchr(sp1, ' ');
+        if (!sp2 || strncmp(sp2 + 1, "HTTP/1.", strlen("HTTP/1.")) != 0)
+                return 400;
+        *sp2 = '\0';
+
+        if (strcmp(buf, "GET") != 0 && strcmp(buf, "HEAD") != 0)
+                return 405;
+        snprintf(req->method, sizeof(req->method), "%s", buf);
+
+        /* 忽略查询参数 */
+        sp2 = strchr(sp1, '?');
+        if (sp2)
+                *sp2 = '\0';
+        req->target = strdup(sp1);
+        return req->target ? 200 : -ENOMEM;
+}
+
+/* 把/buildid/<id>/<type>解析成本地文件：
+ * 函数返回值：HTTP状态码 */
+static int resolve_target(char *target, char **file) {
+        _cleanup_free_ char *package = NULL;
+        char *id, *type;
+        int r;
+
+        if (strncmp(target, "/buildid/", strlen("/buildid/")) != 0)
+                return 404;
+
+        id = target + strlen("/buildid/");
+        type = strchr(id, '/');
+        if (!type)
+                return 404;
+        *type++ = '\0';
+        if (strcmp(type, "debuginfo") == 0)
+                r = buildid_lookup(id, file, &package);
+        else if (strcmp(type, "executable") == 0)
+                r = buildid_lookup_executable(id, file, &package);
+        else
+                return 404;
+
+        if (r == -EINVAL)
+                return 400;
+        if (r < 0)
+                return 404;
+        return 200;
+}
+
+static int send_file(int fd, const char *method, const char *path) {
+        char header[PATH_MAX + 256];
+        struct stat st;
+        off_t offset = 0;
+        int file_fd, n, r;
+
+        file_fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+        if (file_fd < 0)
+                return send_error(fd, 404);
+        if (fstat(file_fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+                close(file_fd);
+                return send_error(fd, 404);
+        }
+
+        n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: application/octet-stream\r\n"
+                     "Content-Length: %lld\r\n"
+                     "X-DEBUGINFOD-SIZE: %lld\r\n"
+                     "X-DEBUGINFOD-FILE: %s\r\n"
+                     "Connection: close\r\n\r\n",
+                     (long long) st.st_size, (long long) st.st_size, path);
+        r = write_all(fd, header, n);
+        if (r < 0 || strcmp(method, "HEAD") == 0) {
+                close(file_fd);
+                return r;
+        }
+
+        /* 文件内容不经过用户态缓冲区 */
+        while (offset < st.st_size) {
+                ssize_t sent = sendfile(fd, file_fd, &offset, st.st_size - offset);
+
+                if (sent < 0 && errno == EINTR)
+                        continue;
+                if (sent <= 0) {
+                        r = sent < 0 ? -errno : -EIO;
+                        break;
+                }
+        }
+
+        close(file_fd);
+        return r;
+}
+
+/* 工作线程中处理一个连接，每个连接只处理一个请求 */
+static void handle_connection(gpointer data, gpointer user_data) {
+        int fd = GPOINTER_TO_INT(data);
+        Server *s = user_data;
+        struct timeval tv = { .tv_sec = DEBUGINFOD_IO_TIMEOUT_SEC };
+        _cleanup_free_ char *file = NULL;
+        Request req = {};
+        int status;
+
+        (void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        (void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        status = read_request(fd, &req);
+        if (status == 200)
+                status = resolve_target(req.target, &file);
+
+        if (status == 200)
+                (void) send_file(fd, req.method, file);
+        else if (status > 0)
+                (void) send_error(fd, status);
+
+        free(req.target);
+        close(fd);
+        (void) g_atomic_int_dec_and_test(&s->active);
+}
+
+static int on_accept(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+
+        for (;;) {
+                int conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+
+                if (conn < 0) {
+                        if (errno == EAGAIN || errno == EINTR || errno == ECONNABORTED)
+                                return 0;
+                        fprintf(stderr, "Failed to accept connection: %m\n");
+                        return 0;
+                }
+
+                g_atomic_int_inc(&s->active);
+                if (!g_thread_pool_push(s->pool, GINT_TO_POINTER(conn), NULL)) {
+                        (void) g_atomic_int_dec_and_test(&s->active);
+                        close(conn);
+                }
+        }
+}
+
+/* 没有被socket激活时只监听回环地址 */
+static int listen_loopback(void) {
+        struct sockaddr_in addr = {
+                .sin_family = AF_INET,
+                .sin_port = htons(DEBUGINFOD_PORT),
+                .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        int fd, one = 1;
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (fd < 0)
+                return -errno;
+
+        (void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+                int r = -errno;
+                close(fd);
+                return r;
+        }
+        return fd;
+}
+
+static int setup_listen(Server *s) {
+        int n, r;
+
+        n = sd_listen_fds(true);
+        if (n < 0)
+                return n;
+
+        if (n == 0) {
+                int fd = listen_loopback();
+                if (fd < 0)
+                        return fd;
+                r = sd_event_add_io(s->event, NULL, fd, EPOLLIN, on_accept, s);
+                return r < 0 ? r : 0;
+        }
+
+        for (int fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + n; fd++) {
+                (void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                r = sd_event_add_io(s->event, NULL, fd, EPOLLIN, on_accept, s);
+                if (r < 0)
+                        return r;
+        }
+        return 0;
+}
+
+static int rearm_idle_timer(Server *s) {
+        uint64_t now;
+        int r;
+
+        r = sd_event_now(s->event, CLOCK_MONOTONIC, &now);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_time(s->idle_source, now + s->idle_timeout);
+        if (r < 0)
+                return r;
+
+        return sd_event_source_set_enabled(s->idle_source, SD_EVENT_ONESHOT);
+}
+
+/* 没有连接时退出，之后的连接由systemd排队并重新激活服务 */
+static int on_idle_timeout(sd_event_source *source, uint64_t usec, void *userdata) {
+        Server *s = userdata;
+
+        /* 连接在工作线程中结束，不会产生事件，所以要自己重新设置定时器 */
+        if (g_atomic_int_get(&s->active) > 0)
+                return rearm_idle_timer(s);
+
+        (void) sd_notify(false, "STOPPING=1");
+        s->exiting = true;
+        return sd_event_exit(s->event, 0);
+}
+
+/* 每处理完一批事件后推迟空闲定时器 */
+static int on_post(sd_event_source *source, void *userdata) {
+        Server *s = userdata;
+
+        if (s->exiting || !s->idle_source)
+                return 0;
+
+        return rearm_idle_timer(s);
+}
+
+static int setup_idle_exit(Server *s) {
+        uint64_t now;
+        int r;
+
+        if (s->idle_timeout == NO_EXIT_TIMEOUT)
+                return 0;
+
+        r = sd_event_now(s->event, CLOCK_MONOTONIC, &now);
+        if (r < 0)
+                return r;
+
+        r = sd_event_add_time(s->event, &s->idle_source, CLOCK_MONOTONIC, now + s->idle_timeout, 0, on_idle_timeout, s);
+        if (r < 0)
+                return r;
+
+        return sd_event_add_post(s->event, NULL, on_post, s);
+}
+
+static int on_signal(sd_event_source *source, const struct signalfd_siginfo *si, void *userdata) {
+        Server *s = userdata;
+
+        s->exiting = true;
+        return sd_event_exit(s->event, 0);
+}
+
+static int setup_signals(Server *s) {
+        sigset_t mask;
+        int r;
+
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGTERM);
+        sigaddset(&mask, SIGINT);
+        if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+                return -errno;
+
+        r = sd_event_add_signal(s->event, NULL, SIGTERM, on_signal, s);
+        if (r < 0)
+                return r;
+
+        return sd_event_add_signal(s->event, NULL, SIGINT, on_signal, s);
+}
+
+static uint64_t parse_idle_timeout(void) {
+        const char *e;
+        char *end = NULL;
+        unsigned long long v;
+
+        e = getenv(IDLE_TIMEOUT_ENV);
+        if (isempty(e))
+                return DEFAULT_IDLE_TIMEOUT_USEC;
+
+        errno = 0;
+        v = strtoull(e, &end, 10);
+        if (errno != 0 || !end || *end != '\0') {
+                fprintf(stderr, "Invalid %s=%s, using default\n", IDLE_TIMEOUT_ENV, e);
+                return DEFAULT_IDLE_TIMEOUT_USEC;
+        }
+
+        return v == 0 ? NO_EXIT_TIMEOUT : (uint64_t) v * 1000000ULL;
+}
+
+static void server_clear(Server *s) {
+        /* 等待正在发送的文件发送完 */
+        if (s->pool)
+                g_thread_pool_free(s->pool, false, true);
+        sd_event_source_unref(s->idle_source);
+        sd_event_unref(s->event);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(server_clear) Server server = {};
+        int r;
+
+        if (argc != 1)
+                return -EINVAL;
+
+        server.idle_timeout = parse_idle_timeout();
+
+        r = sd_event_default(&server.event);
+        if (r < 0) {
+                fprintf(stderr, "Failed to allocate event loop: %s\n", strerror(-r));
+                return -EINVAL;
+        }
+
+        /* 客户端中途断开时sendfile会产生SIGPIPE，没有被systemd启动时也要忽略它 */
+        (void) signal(SIGPIPE, SIG_IGN);
+
+        /* 必须在创建工作线程之前屏蔽信号，信号只通过事件循环处理 */
+        r = setup_signals(&server);
+        if (r < 0) {
+                fprintf(stderr, "Failed to set up signal handling: %s\n", strerror(-r));
+                return -EINVAL;
+        }
+
+        server.pool = g_thread_pool_new(handle_connection, &server, DEBUGINFOD_MAX_THREADS, false, NULL);
+        if (!server.pool) {
+                fprintf(stderr, "Failed to create thread pool\n");
+                return -EINVAL;
+        }
+
+        r = setup_listen(&server);
+        if (r < 0) {
+                fprintf(stderr, "Failed to listen: %s\n", strerror(-r));
+                return -EINVAL;
+        }
+
+        r = setup_idle_exit(&server);
+        if (r < 0) {
+                fprintf(stderr, "Failed to set up idle exit: %s\n", strerror(-r));
+                return -EINVAL;
+        }
+
+        (void) sd_notify(false, "READY=1");
+
+        r = sd_event_loop(server.event);
+        if (r < 0) {
+                fprintf(stderr, "Failed to run event loop: %s\n", strerror(-r));
+                return -EINVAL;
+        }
+
+        return 0;
+}
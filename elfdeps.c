@@ -0,0 +1,490 @@
+#include "elfdeps.h"
+#include "util.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#define LD_CACHE_OLD_MAGIC "ld.so-1.7.0"
+#define LD_CACHE_MAGIC "glibc-ld.so.cache"
+#define LD_CACHE_VERSION "1.1"
+//依赖关系异常时（例如文件被替换成循环的符号链接）最多读取这么多文件
+#define ELFDEPS_MAX_FILES 4096
+
+//ld.so.cache的格式，参考glibc的sysdeps/generic/dl-cache.h
+typedef struct ld_cache_old_header
+{
+    char magic[sizeof(LD_CACHE_OLD_MAGIC) - 1];
+    uint32_t nlibs;
+} ld_cache_old_header;
+
+typedef struct ld_cache_old_entry
+{
+    int32_t flags;
+    uint32_t key, value;
+} ld_cache_old_entry;
+
+typedef struct ld_cache_header
+{
+    char magic[sizeof(LD_CACHE_MAGIC) - 1];
+    char version[sizeof(LD_CACHE_VERSION) - 1];
+    uint32_t nlibs;
+    uint32_t len_strings;
+    uint8_t flags;
+    uint8_t padding[3];
+    uint32_t extension_offset;
+    uint32_t unused[3];
+} ld_cache_header;
+
+typedef struct ld_cache_entry
+{
+    int32_t flags;
+    uint32_t key, value;    // 相对于新格式文件头的字符串偏移
+    uint32_t osversion;
+    uint64_t hwcap;
+} ld_cache_entry;
+
+//ELF文件的程序头，32位和64位统一成一种
+typedef struct elf_phdr
+{
+    uint32_t type;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t filesz;
+} elf_phdr;
+
+//一个ELF文件的动态段中与查找依赖有关的内容
+typedef struct elf_object
+{
+    unsigned char elf_class;
+    uint16_t machine;
+    GPtrArray *needed;
+    char *rpath;
+    char *runpath;
+} elf_object;
+
+typedef struct elfdeps_walk
+{
+    GHashTable *ld_cache;   // soname -> ld.so.cache中的所有路径(GPtrArray)，包含所有架构
+    GHashTable *visited;    // 已经读取过的文件的"设备:inode"
+    GPtrArray *libs;        // 找到的库的路径
+    GQueue pending;         // 等待读取的文件
+} elfdeps_walk;
+
+static void elf_object_clear(elf_object *obj) {
+    if (obj->needed)
+        g_ptr_array_unref(obj->needed);
+    g_free(obj->rpath);
+    g_free(obj->runpath);
+    memset(obj, 0, sizeof(elf_object));
+}
+
+/*读取ld.so.cache，建立soname到路径的表。glibc 2.32之前的ldconfig默认生成兼容格式，
+* 新格式的文件头跟在旧格式的表之后：
+*
+* 函数返回值：
+*
+* soname到路径的表，文件不存在或者格式不认识时为空表。*/
+static GHashTable *ld_cache_load() {
+    GHashTable *cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
+    const ld_cache_header *hdr;
+    gchar *data = NULL;
+    gsize size = 0;
+    size_t off = 0;
+
+    if (!g_file_get_contents(LD_SO_CACHE_PATH, &data, &size, NULL))
+        return cache;
+
+    if (size >= sizeof(ld_cache_old_header) &&
+        memcmp(data, LD_CACHE_OLD_MAGIC, sizeof(LD_CACHE_OLD_MAGIC) - 1) == 0) {
+        const ld_cache_old_header *old = (const ld_cache_old_header *)data;
+
+        off = sizeof(ld_cache_old_header) + (size_t)old->nlibs * sizeof(ld_cache_old_entry);
+        off = (off + _Alignof(ld_cache_header) - 1) & ~(_Alignof(ld_cache_header) - 1);
+    }
+    if (off > size || size - off < sizeof(ld_cache_header))
+        goto out;
+
+    hdr = (const ld_cache_header *)(data + off);
+    if (memcmp(hdr->magic, LD_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        memcmp(hdr->version, LD_CACHE_VERSION, sizeof(hdr->version)) != 0 ||
+        hdr->nlibs > (size - off - sizeof(ld_cache_header)) / sizeof(ld_cache_entry))
+        goto out;
+
+    for (uint32_t i = 0; i < hdr->nlibs; i++) {
+        const ld_cache_entry *e = (const ld_cache_entry *)(data + off + sizeof(ld_cache_header)) + i;
+        const char *key, *value;
+        GPtrArray *paths;
+
+        if (e->key >= size - off || e->value >= size - off)
+            continue;
+        key = data + off + e->key;
+        value = data + off + e->value;
+        if (!memchr(key, '\0', size - off - e->key) || !memchr(value, '\0', size - off - e->value))
+            continue;
+
+        paths = g_hash_table_lookup(cache, key);
+        if (!paths) {
+            paths = g_ptr_array_new_with_free_func(g_free);
+            g_hash_table_insert(cache, g_strdup(key), paths);
+        }
+        g_ptr_array_add(paths, g_strdup(value));
+    }
+
+out:
+    g_free(data);
+    return cache;
+}
+
+static bool read_phdr(const unsigned char *base, size_t size, unsigned char elf_class,
+                      uint64_t phoff, unsigned i, elf_phdr *phdr) {
+    if (elf_class == ELFCLASS64) {
+        Elf64_Phdr p;
+
+        if (phoff > size || (size - phoff) / sizeof(p) <= i)
+            return false;
+        memcpy(&p, base + phoff + (uint64_t)i * sizeof(p), sizeof(p));
+        *phdr = (elf_phdr) { p.p_type, p.p_offset, p.p_vaddr, p.p_filesz };
+    } else {
+        Elf32_Phdr p;
+
+        if (phoff > size || (size - phoff) / sizeof(p) <= i)
+            return false;
+        memcpy(&p, base + phoff + (uint64_t)i * sizeof(p), sizeof(p));
+        *phdr = (elf_phdr) { p.p_type, p.p_offset, p.p_vaddr, p.p_filesz };
+    }
+    return true;
+}
+
+//动态段中的字符串表用虚拟地址表示，通过PT_LOAD段换算成文件偏移
+static bool vaddr_to_offset(const GArray *loads, uint64_t vaddr, uint64_t *offset) {
+    for (unsigned i = 0; i < loads->len; i++) {
+        const elf_phdr *p = &g_array_index(loads, elf_phdr, i);
+
+        if (vaddr >= p->vaddr && vaddr - p->vaddr < p->filesz) {
+            *offset = p->offset + (vaddr - p->vaddr);
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *string_at(const unsigned char *base, size_t size, uint64_t strtab, uint64_t off) {
+    if (strtab > size || off >= size - strtab)
+        return NULL;
+    if (!memchr(base + strtab + off, '\0', size - strtab - off))
+        return NULL;
+    return (const char *)base + strtab + off;
+}
+
+/*读取ELF文件的DT_NEEDED、DT_RPATH和DT_RUNPATH，只支持与本机字节序相同的文件：
+*
+* base、size：映射到内存中的文件；
+* obj：保存结果，需要用elf_object_clear释放。
+* 函数返回值：
+*
+* 成功：返回 0，静态链接的文件没有依赖；
+* 不是ELF文件：返回 -ENOENT。*/
+static int parse_elf_object(const unsigned char *base, size_t size, elf_object *obj) {
+    GArray *loads, *needed;
+    elf_phdr dynamic = {0}, phdr;
+    uint64_t phoff, strtab = 0, rpath = 0, runpath = 0;
+    bool has_strtab = false, has_rpath = false, has_runpath = false;
+    unsigned phnum;
+    int r = OK;
+
+    if (size < EI_NIDENT || memcmp(base, ELFMAG, SELFMAG) != 0)
+        return -ENOENT;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    if (base[EI_DATA] != ELFDATA2LSB)
+        return -ENOENT;
+#else
+    if (base[EI_DATA] != ELFDATA2MSB)
+        return -ENOENT;
+#endif
+
+    obj->elf_class = base[EI_CLASS];
+    if (obj->elf_class == ELFCLASS64 && size >= sizeof(Elf64_Ehdr)) {
+        Elf64_Ehdr ehdr;
+
+        memcpy(&ehdr, base, sizeof(ehdr));
+        if (ehdr.e_phentsize != sizeof(Elf64_Phdr))
+            return -ENOENT;
+        obj->machine = ehdr.e_machine;
+        phoff = ehdr.e_phoff;
+        phnum = ehdr.e_phnum;
+    } else if (obj->elf_class == ELFCLASS32 && size >= sizeof(Elf32_Ehdr)) {
+        Elf32_Ehdr ehdr;
+
+        memcpy(&ehdr, base, sizeof(ehdr));
+        if (ehdr.e_phentsize != sizeof(Elf32_Phdr))
+            return -ENOENT;
+        obj->machine = ehdr.e_machine;
+        phoff = ehdr.e_phoff;
+        phnum = ehdr.e_phnum;
+    } else {
+        return -ENOENT;
+    }
+
+    obj->needed = g_ptr_array_new_with_free_func(g_free);
+    loads = g_array_new(false, false, sizeof(elf_phdr));
+    needed = g_array_new(false, false, sizeof(uint64_t));
+
+    for (unsigned i = 0; i < phnum; i++) {
+        if (!read_phdr(base, size, obj->elf_class, phoff, i, &phdr)) {
+            r = -ENOENT;
+            goto out;
+        }
+        if (phdr.type == PT_LOAD)
+            g_array_append_val(loads, phdr);
+        else if (phdr.type == PT_DYNAMIC)
+            dynamic = phdr;
+    }
+    if (dynamic.type != PT_DYNAMIC || dynamic.offset > size || dynamic.filesz > size - dynamic.offset)
+        goto out;
+
+    for (uint64_t off = dynamic.offset; off < dynamic.offset + dynamic.filesz; ) {
+        int64_t tag;
+        uint64_t val;
+
+        if (obj->elf_class == ELFCLASS64) {
+            Elf64_Dyn dyn;
+
+            if (dynamic.offset + dynamic.filesz - off < sizeof(dyn))
+                break;
+            memcpy(&dyn, base + off, sizeof(dyn));
+            tag = dyn.d_tag;
+            val = dyn.d_un.d_val;
+            off += sizeof(dyn);
+        } else {
+            Elf32_Dyn dyn;
+
+            if (dynamic.offset + dynamic.filesz - off < sizeof(dyn))
+                break;
+            memcpy(&dyn, base + off, sizeof(dyn));
+            tag = dyn.d_tag;
+            val = dyn.d_un.d_val;
+            off += sizeof(dyn);
+        }
+
+        if (tag == DT_NULL)
+            break;
+        if (tag == DT_NEEDED)
+            g_array_append_val(needed, val);
+        else if (tag == DT_STRTAB)
+            has_strtab = vaddr_to_offset(loads, val, &strtab);
+        else if (tag == DT_RPATH)
+            has_rpath = true, rpath = val;
+        else if (tag == DT_RUNPATH)
+            has_runpath = true, runpath = val;
+    }
+    if (!has_strtab)
+        goto out;
+
+    for (unsigned i = 0; i < needed->len; i++) {
+        const char *name = string_at(base, size, strtab, g_array_index(needed, uint64_t, i));
+
+        if (name && *name)
+            g_ptr_array_add(obj->needed, g_strdup(name));
+    }
+    if (has_rpath && string_at(base, size, strtab, rpath))
+        obj->rpath = g_strdup(string_at(base, size, strtab, rpath));
+    if (has_runpath && string_at(base, size, strtab, runpath))
+        obj->runpath = g_strdup(string_at(base, size, strtab, runpath));
+
+out:
+    g_array_free(loads, true);
+    g_array_free(needed, true);
+    if (r < 0)
+        elf_object_clear(obj);
+    return r;
+}
+
+//ld.so.cache包含所有架构的库，只使用与依赖它的文件类型和架构相同的
+static bool elf_matches(const char *path, unsigned char elf_class, uint16_t machine) {
+    unsigned char ehdr[sizeof(Elf32_Ehdr)];
+    uint16_t m;
+    int fd;
+    bool ok;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0)
+        return false;
+    ok = pread(fd, ehdr, sizeof(ehdr), 0) == sizeof(ehdr) &&
+         memcmp(ehdr, ELFMAG, SELFMAG) == 0 && ehdr[EI_CLASS] == elf_class;
+    close(fd);
+    if (!ok)
+        return false;
+
+    //e_machine在32位和64位的文件头中位置相同
+    memcpy(&m, ehdr + offsetof(Elf32_Ehdr, e_machine), sizeof(m));
+    return m == machine;
+}
+
+//在RPATH或RUNPATH的目录中查找，支持$ORIGIN
+static char *search_dirs(const char *dirs, const char *origin, const char *name, const elf_object *obj) {
+    gchar **list = g_strsplit(dirs, ":", -1);
+    char *found = NULL;
+
+    for (gchar **dir = list; *dir && !found; dir++) {
+        gchar *expanded, *path;
+
+        if (**dir == '\0')
+            continue;
+        if (g_str_has_prefix(*dir, "$ORIGIN"))
+            expanded = g_strconcat(origin, *dir + strlen("$ORIGIN"), NULL);
+        else if (g_str_has_prefix(*dir, "${ORIGIN}"))
+            expanded = g_strconcat(origin, *dir + strlen("${ORIGIN}"), NULL);
+        else
+            expanded = g_strdup(*dir);
+
+        path = g_build_filename(expanded, name, NULL);
+        if (elf_matches(path, obj->elf_class, obj->machine))
+            found = path;
+        else
+            g_free(path);
+        g_free(expanded);
+    }
+    g_strfreev(list);
+    return found;
+}
+
+/*按动态链接器的顺序查找一个依赖：DT_RPATH（没有DT_RUNPATH时）、DT_RUNPATH、
+* ld.so.cache、默认目录。不处理LD_LIBRARY_PATH，也不继承上级文件的DT_RPATH：
+*
+* 函数返回值：
+*
+* 找到：返回路径，需要调用者释放；
+* 没有找到：返回 NULL。*/
+static char *resolve_needed(elfdeps_walk *w, const char *file, const elf_object *obj, const char *name) {
+    static const char *const default_dirs[] = { "/lib64", "/usr/lib64", "/lib", "/usr/lib" };
+    gchar *origin = g_path_get_dirname(file);
+    char *found = NULL;
+    GPtrArray *paths;
+
+    if (strchr(name, '/')) {
+        found = elf_matches(name, obj->elf_class, obj->machine) ? g_strdup(name) : NULL;
+        goto out;
+    }
+    if (obj->rpath && !obj->runpath && (found = search_dirs(obj->rpath, origin, name, obj)))
+        goto out;
+    if (obj->runpath && (found = search_dirs(obj->runpath, origin, name, obj)))
+        goto out;
+
+    paths = g_hash_table_lookup(w->ld_cache, name);
+    for (unsigned i = 0; paths && i < paths->len; i++) {
+        const char *path = g_ptr_array_index(paths, i);
+
+        if (elf_matches(path, obj->elf_class, obj->machine)) {
+            found = g_strdup(path);
+            goto out;
+        }
+    }
+
+    for (size_t i = 0; i < G_N_ELEMENTS(default_dirs) && !found; i++) {
+        gchar *path = g_build_filename(default_dirs[i], name, NULL);
+
+        if (elf_matches(path, obj->elf_class, obj->machine))
+            found = path;
+        else
+            g_free(path);
+    }
+
+out:
+    g_free(origin);
+    return found;
+}
+
+//同一个文件可能通过不同的路径（符号链接、/usr合并）被找到，按设备和inode去重
+static bool mark_visited(elfdeps_walk *w, const char *path) {
+    struct stat st;
+
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+        return false;
+    return g_hash_table_add(w->visited, g_strdup_printf("%lu:%lu", (unsigned long)st.st_dev, (unsigned long)st.st_ino));
+}
+
+//读取一个文件的依赖，新找到的库加入结果和待读取的队列
+static void walk_file(elfdeps_walk *w, const char *file) {
+    elf_object obj = {0};
+    struct stat st;
+    void *base;
+    int fd;
+
+    fd = open(file, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0)
+        return;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < EI_NIDENT) {
+        close(fd);
+        return;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return;
+
+    if (parse_elf_object(base, st.st_size, &obj) == OK) {
+        for (unsigned i = 0; i < obj.needed->len; i++) {
+            char *lib = resolve_needed(w, file, &obj, g_ptr_array_index(obj.needed, i));
+
+            if (lib && mark_visited(w, lib)) {
+                g_ptr_array_add(w->libs, lib);
+                g_queue_push_tail(&w->pending, lib);
+            } else {
+                g_free(lib);
+            }
+        }
+        elf_object_clear(&obj);
+    }
+    munmap(base, st.st_size);
+}
+
+/*从一组文件出发，沿DT_NEEDED递归找到它们依赖的所有共享库，不需要ldd或gdb。
+* 不是ELF的文件会被跳过，所以可以直接传入一个软件包的所有文件：
+*
+* files：文件路径；
+* n：文件数目；
+* libs：保存依赖的库的路径，不包括files中的文件，用g_strfreev释放；
+* libs_num：库的数目。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int elfdeps_closure(char **files, int n, char ***libs, int *libs_num) {
+    elfdeps_walk w = {0};
+    char *file;
+
+    assert((files || n == 0) && libs && libs_num);
+
+    w.ld_cache = ld_cache_load();
+    w.visited = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    w.libs = g_ptr_array_new();
+    g_queue_init(&w.pending);
+
+    for (int i = 0; i < n; i++) {
+        if (mark_visited(&w, files[i]))
+            g_queue_push_tail(&w.pending, files[i]);
+    }
+
+    while ((file = g_queue_pop_head(&w.pending))) {
+        if (g_hash_table_size(w.visited) > ELFDEPS_MAX_FILES) {
+            fprintf(stderr, "Too many shared libraries, stop at %s\n", file);
+            break;
+        }
+        walk_file(&w, file);
+    }
+
+    g_queue_clear(&w.pending);
+    g_hash_table_destroy(w.visited);
+    g_hash_table_destroy(w.ld_cache);
+
+    *libs_num = w.libs->len;
+    g_ptr_array_add(w.libs, NULL);
+    *libs = (char **)g_ptr_array_free(w.libs, false);
+    return OK;
+}
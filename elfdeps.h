@@ -0,0 +1,9 @@
+#ifndef ELFDEPS_H_included
+#define ELFDEPS_H_included 1
+#include <stdbool.h>
+#include "common.h"
+
+#define LD_SO_CACHE_PATH "/etc/ld.so.cache"
+
+int elfdeps_closure(char **files, int n, char ***libs, int *libs_num);
+#endif
@@ -0,0 +1,734 @@
+#define _GNU_SOURCE
+#include "fetch.h"
+#include "util.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <pwd.h>
+#include <signal.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+
+#include <glib.h>
+
+#define FETCH_BUF_SIZE (64 * 1024)
+#define FETCH_LINE_MAX 8192
+#define FETCH_USER_AGENT "deepin-debug-config"
+//apt的下载进程以这个用户运行，断点续传的文件要让它也能写
+#define APT_SANDBOX_USER "_apt"
+
+typedef struct fetch_url
+{
+    bool tls;
+    char *host;
+    char *port;
+    char *path;
+} fetch_url;
+
+//一个HTTP连接，带有读缓冲区，https时通过ssl读写
+typedef struct fetch_conn
+{
+    int fd;
+    SSL *ssl;
+    char buf[FETCH_BUF_SIZE];
+    size_t pos, len;
+} fetch_conn;
+
+//响应中与下载有关的头部
+typedef struct fetch_response
+{
+    int status;
+    int64_t content_length;     // 没有Content-Length时为-1
+    int64_t range_start;        // 206的Content-Range的起始位置
+    bool chunked;
+    char *location;
+} fetch_response;
+
+//所有下载线程共享的设置
+typedef struct fetch_context
+{
+    SSL_CTX *ssl_ctx;
+    const char *dir;
+    uid_t apt_uid;
+    gid_t apt_gid;
+} fetch_context;
+
+static void fetch_url_clear(fetch_url *u) {
+    g_free(u->host);
+    g_free(u->port);
+    g_free(u->path);
+    memset(u, 0, sizeof(fetch_url));
+}
+
+/*解析"http://主机[:端口]/路径"或"https://..."，IPv6地址写在方括号中：
+*
+* 函数返回值：
+*
+* 成功：返回 0；
+* 其它协议或格式错误：返回 -EINVAL。*/
+static int parse_url(const char *uri, fetch_url *u) {
+    const char *host, *end, *port = NULL;
+
+    memset(u, 0, sizeof(fetch_url));
+    if (g_str_has_prefix(uri, "http://")) {
+        host = uri + strlen("http://");
+    } else if (g_str_has_prefix(uri, "https://")) {
+        host = uri + strlen("https://");
+        u->tls = true;
+    } else {
+        return -EINVAL;
+    }
+
+    end = host + strcspn(host, "/?#");
+    if (*host == '[') {
+        const char *close = memchr(host, ']', end - host);
+
+        if (!close)
+            return -EINVAL;
+        u->host = g_strndup(host + 1, close - host - 1);
+        if (close[1] == ':')
+            port = close + 2;
+    } else {
+        const char *colon = memchr(host, ':', end - host);
+
+        u->host = g_strndup(host, (colon ? colon : end) - host);
+        if (colon)
+            port = colon + 1;
+    }
+    u->port = port && port < end ? g_strndup(port, end - port) : g_strdup(u->tls ? "443" : "80");
+    u->path = *end == '/' ? g_strdup(end) : g_strconcat("/", end, NULL);
+
+    if (isempty(u->host) || isempty(u->port)) {
+        fetch_url_clear(u);
+        return -EINVAL;
+    }
+    return OK;
+}
+
+static void conn_close(fetch_conn *c) {
+    if (c->ssl) {
+        (void) SSL_shutdown(c->ssl);
+        SSL_free(c->ssl);
+        c->ssl = NULL;
+    }
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+//连接和读写都有超时，服务器没有响应时不会让安装一直等下去
+static int conn_open(fetch_conn *c, const fetch_context *ctx, const fetch_url *u) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct timeval tv = { .tv_sec = FETCH_TIMEOUT_SEC };
+    struct addrinfo *res = NULL;
+    int r;
+
+    c->fd = -1;
+    c->ssl = NULL;
+    c->pos = c->len = 0;
+
+    r = getaddrinfo(u->host, u->port, &hints, &res);
+    if (r != 0)
+        return -EHOSTUNREACH;
+
+    for (struct addrinfo *ai = res; ai && c->fd < 0; ai = ai->ai_next) {
+        c->fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (c->fd < 0)
+            continue;
+        (void) setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        (void) setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (connect(c->fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+            close(c->fd);
+            c->fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (c->fd < 0)
+        return -ECONNREFUSED;
+
+    if (!u->tls)
+        return OK;
+
+    c->ssl = SSL_new(ctx->ssl_ctx);
+    if (!c->ssl || SSL_set_fd(c->ssl, c->fd) != 1 ||
+        SSL_set_tlsext_host_name(c->ssl, u->host) != 1 || SSL_set1_host(c->ssl, u->host) != 1 ||
+        SSL_connect(c->ssl) != 1) {
+        conn_close(c);
+        return -ECONNABORTED;
+    }
+    return OK;
+}
+
+static int conn_write_all(fetch_conn *c, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n;
+
+        if (c->ssl)
+            n = SSL_write(c->ssl, data, len);
+        else
+            n = send(c->fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return -EIO;
+        data += n;
+        len -= n;
+    }
+    return OK;
+}
+
+//读取到缓冲区中，返回读到的字节数，连接关闭时返回0
+static ssize_t conn_fill(fetch_conn *c) {
+    ssize_t n;
+
+    c->pos = c->len = 0;
+    if (c->ssl) {
+        n = SSL_read(c->ssl, c->buf, sizeof(c->buf));
+        if (n <= 0)
+            n = SSL_get_error(c->ssl, n) == SSL_ERROR_ZERO_RETURN ? 0 : -EIO;
+    } else {
+        n = recv(c->fd, c->buf, sizeof(c->buf), 0);
+        if (n < 0)
+            n = -errno;
+    }
+    if (n > 0)
+        c->len = n;
+    return n;
+}
+
+static ssize_t conn_read(fetch_conn *c, char *out, size_t max) {
+    size_t n;
+
+    if (c->pos == c->len) {
+        ssize_t r = conn_fill(c);
+
+        if (r <= 0)
+            return r;
+    }
+    n = MIN(max, c->len - c->pos);
+    memcpy(out, c->buf + c->pos, n);
+    c->pos += n;
+    return n;
+}
+
+//读取一行，去掉结尾的"\r\n"
+static int conn_read_line(fetch_conn *c, char *line, size_t size) {
+    size_t n = 0;
+
+    for (;;) {
+        char ch;
+
+        if (c->pos == c->len) {
+            ssize_t r = conn_fill(c);
+
+            if (r <= 0)
+                return r < 0 ? (int)r : -EPROTO;
+        }
+        ch = c->buf[c->pos++];
+        if (ch == '\n')
+            break;
+        if (n + 1 >= size)
+            return -E2BIG;
+        line[n++] = ch;
+    }
+    if (n > 0 && line[n - 1] == '\r')
+        n--;
+    line[n] = '\0';
+    return OK;
+}
+
+static void fetch_response_clear(fetch_response *resp) {
+    g_free(resp->location);
+    memset(resp, 0, sizeof(fetch_response));
+}
+
+static int read_response(fetch_conn *c, fetch_response *resp) {
+    char line[FETCH_LINE_MAX];
+    int r;
+
+    memset(resp, 0, sizeof(fetch_response));
+    resp->content_length = -1;
+    resp->range_start = -1;
+
+    r = conn_read_line(c, line, sizeof(line));
+    if (r < 0)
+        return r;
+    if (sscanf(line, "HTTP/%*d.%*d %d", &resp->status) != 1)
+        return -EPROTO;
+
+    for (;;) {
+        char *value;
+
+        r = conn_read_line(c, line, sizeof(line));
+        if (r < 0)
+            return r;
+        if (line[0] == '\0')
+            return OK;
+
+        value = strchr(line, ':');
+        if (!value)
+            continue;
+        *value++ = '\0';
+        value += strspn(value, " \t");
+
+        if (strcasecmp(line, "Content-Length") == 0)
+            resp->content_length = g_ascii_strtoll(value, NULL, 10);
+        else if (strcasecmp(line, "Content-Range") == 0 && g_str_has_prefix(value, "bytes "))
+            resp->range_start = g_ascii_strtoll(value + strlen("bytes "), NULL, 10);
+        else if (strcasecmp(line, "Transfer-Encoding") == 0)
+            resp->chunked = strcasestr(value, "chunked") != NULL;
+        else if (strcasecmp(line, "Location") == 0)
+            resp->location = g_strdup(value);
+    }
+}
+
+//重定向的地址可以是绝对地址，也可以是同一个服务器上的路径
+static char *redirect_uri(const fetch_url *u, const char *location) {
+    bool ipv6 = strchr(u->host, ':') != NULL;
+
+    if (g_str_has_prefix(location, "http://") || g_str_has_prefix(location, "https://"))
+        return g_strdup(location);
+    if (location[0] != '/')
+        return NULL;
+    return g_strdup_printf("%s://%s%s%s:%s%s", u->tls ? "https" : "http", ipv6 ? "[" : "",
+                           u->host, ipv6 ? "]" : "", u->port, location);
+}
+
+//下载的内容写入文件并计算散列值，写入的内容超过预期大小时失败
+typedef struct fetch_sink
+{
+    int fd;
+    EVP_MD_CTX *md;
+    const EVP_MD *type;
+    uint64_t offset;
+    uint64_t size;
+} fetch_sink;
+
+static int sink_reset(fetch_sink *s) {
+    if (ftruncate(s->fd, 0) < 0 || lseek(s->fd, 0, SEEK_SET) < 0)
+        return -errno;
+    s->offset = 0;
+    return EVP_DigestInit_ex(s->md, s->type, NULL) == 1 ? OK : -EIO;
+}
+
+static int sink_write(fetch_sink *s, const char *data, size_t len) {
+    if (len > s->size - s->offset)
+        return -EFBIG;
+    if (EVP_DigestUpdate(s->md, data, len) != 1)
+        return -EIO;
+    while (len > 0) {
+        ssize_t n = write(s->fd, data, len);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        data += n;
+        len -= n;
+        s->offset += n;
+    }
+    return OK;
+}
+
+//续传之前先把已经下载的部分计入散列值
+static int sink_resume(fetch_sink *s) {
+    char *buf;
+    struct stat st;
+    int r = OK;
+
+    if (EVP_DigestInit_ex(s->md, s->type, NULL) != 1)
+        return -EIO;
+    if (fstat(s->fd, &st) < 0)
+        return -errno;
+    if ((uint64_t)st.st_size > s->size)
+        return sink_reset(s);
+
+    buf = malloc(FETCH_BUF_SIZE);
+    if (!buf)
+        return -ENOMEM;
+    s->offset = 0;
+    while (s->offset < (uint64_t)st.st_size) {
+        ssize_t n = pread(s->fd, buf, FETCH_BUF_SIZE, s->offset);
+
+        if (n <= 0) {
+            r = n < 0 ? -errno : -EIO;
+            break;
+        }
+        if (EVP_DigestUpdate(s->md, buf, n) != 1) {
+            r = -EIO;
+            break;
+        }
+        s->offset += n;
+    }
+    free(buf);
+    if (r < 0)
+        return sink_reset(s);
+    return lseek(s->fd, s->offset, SEEK_SET) < 0 ? -errno : OK;
+}
+
+//读取响应的内容，支持Content-Length、chunked和读到连接关闭三种方式
+static int read_body(fetch_conn *c, const fetch_response *resp, fetch_sink *s) {
+    char *buf = malloc(FETCH_BUF_SIZE);
+    int64_t left = resp->chunked ? 0 : resp->content_length;
+    char line[FETCH_LINE_MAX];
+    int r = OK;
+
+    if (!buf)
+        return -ENOMEM;
+
+    for (;;) {
+        ssize_t n;
+
+        if (resp->chunked && left == 0) {
+            r = conn_read_line(c, line, sizeof(line));
+            if (r < 0)
+                break;
+            //上一块结尾的空行
+            if (line[0] == '\0') {
+                r = conn_read_line(c, line, sizeof(line));
+                if (r < 0)
+                    break;
+            }
+            left = g_ascii_strtoll(line, NULL, 16);
+            if (left <= 0)
+                break;
+        }
+        if (left == 0)
+            break;
+
+        n = conn_read(c, buf, left > 0 ? MIN((int64_t)FETCH_BUF_SIZE, left) : FETCH_BUF_SIZE);
+        if (n < 0) {
+            r = n;
+            break;
+        }
+        if (n == 0) {
+            //没有Content-Length时读到连接关闭为止
+            if (left > 0)
+                r = -EPIPE;
+            break;
+        }
+        r = sink_write(s, buf, n);
+        if (r < 0)
+            break;
+        if (left > 0)
+            left -= n;
+    }
+    free(buf);
+    return r;
+}
+
+static int send_request(fetch_conn *c, const fetch_url *u, uint64_t offset) {
+    GString *req = g_string_new(NULL);
+    bool ipv6 = strchr(u->host, ':') != NULL;
+    int r;
+
+    g_string_append_printf(req, "GET %s HTTP/1.1\r\nHost: %s%s%s", u->path, ipv6 ? "[" : "", u->host, ipv6 ? "]" : "");
+    if (strcmp(u->port, u->tls ? "443" : "80") != 0)
+        g_string_append_printf(req, ":%s", u->port);
+    g_string_append(req, "\r\nUser-Agent: " FETCH_USER_AGENT "\r\nAccept-Encoding: identity\r\nConnection: close\r\n");
+    if (offset > 0)
+        g_string_append_printf(req, "Range: bytes=%" PRIu64 "-\r\n", offset);
+    g_string_append(req, "\r\n");
+
+    r = conn_write_all(c, req->str, req->len);
+    g_string_free(req, TRUE);
+    return r;
+}
+
+/*下载到sink中，已经有部分内容时从断点继续，服务器不支持Range时从头下载：
+*
+* 函数返回值：
+*
+* 成功：返回 0，内容的大小和散列值由调用者检查；
+* 失败：返回负的错误码。*/
+static int download(const fetch_context *ctx, const char *uri, fetch_sink *s) {
+    char *current = g_strdup(uri);
+    bool retried = false;
+    int r = -ELOOP;
+
+    for (int redirects = 0; redirects <= FETCH_MAX_REDIRECTS; ) {
+        fetch_response resp = {0};
+        fetch_conn *c;
+        fetch_url u;
+        char *next = NULL;
+
+        if (s->offset == s->size) {
+            r = OK;
+            break;
+        }
+
+        r = parse_url(current, &u);
+        if (r < 0)
+            break;
+
+        c = malloc(sizeof(fetch_conn));
+        if (!c) {
+            fetch_url_clear(&u);
+            r = -ENOMEM;
+            break;
+        }
+        r = conn_open(c, ctx, &u);
+        if (r == OK)
+            r = send_request(c, &u, s->offset);
+        if (r == OK)
+            r = read_response(c, &resp);
+
+        if (r < 0) {
+            ;
+        } else if (resp.status == 206 && resp.range_start == (int64_t)s->offset) {
+            r = read_body(c, &resp, s);
+        } else if (resp.status == 200 || resp.status == 206) {
+            r = sink_reset(s);
+            if (r == OK && resp.status == 200)
+                r = read_body(c, &resp, s);
+            else if (r == OK)
+                next = g_strdup(current);    // Content-Range与请求不符，重新请求整个文件
+        } else if (resp.status == 416 && !retried) {
+            //已下载的部分比服务器上的文件还大，说明文件已经变了
+            retried = true;
+            r = sink_reset(s);
+            if (r == OK)
+                next = g_strdup(current);
+        } else if (resp.status >= 300 && resp.status < 400 && resp.location) {
+            next = redirect_uri(&u, resp.location);
+            redirects++;
+            r = next ? OK : -EPROTO;
+        } else {
+            r = -EPROTO;
+        }
+
+        conn_close(c);
+        free(c);
+        fetch_url_clear(&u);
+        fetch_response_clear(&resp);
+        if (r < 0 || !next)
+            break;
+
+        g_free(current);
+        current = next;
+        r = -ELOOP;
+    }
+    g_free(current);
+    return r;
+}
+
+static const EVP_MD *digest_of(const char *hash, const char **hex) {
+    static const struct {
+        const char *prefix;
+        const char *name;
+    } types[] = {
+        { "SHA512:", "SHA512" },
+        { "SHA256:", "SHA256" },
+        { "SHA1:", "SHA1" },
+        { "MD5Sum:", "MD5" },
+    };
+
+    for (size_t i = 0; hash && i < G_N_ELEMENTS(types); i++) {
+        if (g_str_has_prefix(hash, types[i].prefix)) {
+            *hex = hash + strlen(types[i].prefix);
+            return EVP_get_digestbyname(types[i].name);
+        }
+    }
+    return NULL;
+}
+
+static bool digest_matches(EVP_MD_CTX *md, const char *hex) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+
+    if (EVP_DigestFinal_ex(md, digest, &len) != 1 || strlen(hex) != len * 2)
+        return false;
+    for (unsigned int i = 0; i < len; i++) {
+        char byte[3];
+
+        snprintf(byte, sizeof(byte), "%02x", digest[i]);
+        if (g_ascii_strncasecmp(byte, hex + i * 2, 2) != 0)
+            return false;
+    }
+    return true;
+}
+
+/*下载一个文件到dir/partial中，大小和散列值都与Packages文件一致后才移到dir中，
+* apt安装时发现文件已经存在就不会再下载：
+*
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回负的错误码，未完成的文件保留下来用于续传，散列值错误的文件删除。*/
+static int fetch_one(const fetch_context *ctx, fetch_item *item) {
+    fetch_sink s = { .fd = -1 };
+    const char *hex = NULL;
+    char *partial, *final;
+    struct stat st;
+    int r;
+
+    if (strchr(item->filename, '/') || item->filename[0] == '.')
+        return -EINVAL;
+    s.type = digest_of(item->hash, &hex);
+    if (!s.type)
+        return -ENOTSUP;
+    s.size = item->size;
+
+    partial = g_build_filename(ctx->dir, FETCH_PARTIAL_DIR, item->filename, NULL);
+    final = g_build_filename(ctx->dir, item->filename, NULL);
+
+    //apt下载过的文件由apt自己校验
+    if (stat(final, &st) == 0 && (uint64_t)st.st_size == item->size) {
+        r = OK;
+        goto out;
+    }
+
+    s.fd = open(partial, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0644);
+    if (s.fd < 0) {
+        r = -errno;
+        goto out;
+    }
+    if (ctx->apt_uid != (uid_t)-1)
+        (void) fchown(s.fd, ctx->apt_uid, ctx->apt_gid);
+
+    s.md = EVP_MD_CTX_new();
+    if (!s.md) {
+        r = -ENOMEM;
+        goto out;
+    }
+
+    r = sink_resume(&s);
+    if (r == OK)
+        r = download(ctx, item->uri, &s);
+    if (r == OK && s.offset != s.size)
+        r = -EPIPE;
+    if (r == OK && !digest_matches(s.md, hex)) {
+        (void) unlink(partial);
+        r = -EBADMSG;
+    }
+    //与apt相同，下载完成的文件属于root
+    if (r == OK && ctx->apt_uid != (uid_t)-1)
+        (void) fchown(s.fd, 0, 0);
+    if (r == OK && rename(partial, final) < 0)
+        r = -errno;
+
+out:
+    if (s.md)
+        EVP_MD_CTX_free(s.md);
+    if (s.fd >= 0)
+        close(s.fd);
+    g_free(partial);
+    g_free(final);
+    return r;
+}
+
+/*SSL_write等通过套接字BIO的write()发送，MSG_NOSIGNAL管不到，对端断开时会产生SIGPIPE，
+* 在CLI里会直接杀死进程。下载期间在本线程屏蔽SIGPIPE，结束后取走挂起的信号再恢复*/
+static void fetch_worker(gpointer data, gpointer user_data) {
+    fetch_item *item = data;
+    const fetch_context *ctx = user_data;
+    const struct timespec zero = { 0, 0 };
+    sigset_t pipe_set, old_set;
+
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+    item->result = fetch_one(ctx, item);
+    while (sigtimedwait(&pipe_set, NULL, &zero) == SIGPIPE)
+        ;
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    if (item->result < 0)
+        fprintf(stderr, "Prefetch %s failed: %s\n", item->filename, strerror(-item->result));
+    else
+        fprintf(stdout, "Prefetched %s\n", item->filename);
+}
+
+int fetch_jobs() {
+    const char *e = getenv(FETCH_JOBS_ENV);
+    char *end = NULL;
+    long v;
+
+    if (isempty(e))
+        return FETCH_JOBS;
+    errno = 0;
+    v = strtol(e, &end, 10);
+    if (errno != 0 || *end != '\0' || v < 0 || v > 64)
+        return FETCH_JOBS;
+    return v;
+}
+
+/*并行下载多个文件到dir中，每个文件边下载边校验散列值，中断后下次从断点继续。
+* 只支持http和https，其它协议的文件返回 -EPROTONOSUPPORT：
+*
+* items：要下载的文件，结果保存在每一项的result中；
+* n：文件数目；
+* dir：目标目录，未完成的文件放在其中的partial目录。
+* 函数返回值：
+*
+* 成功：返回下载成功的文件数目；
+* 失败：返回 ERR_RET。*/
+int fetch_files(fetch_item *items, int n, const char *dir) {
+    fetch_context ctx = { .dir = dir, .apt_uid = (uid_t)-1, .apt_gid = (gid_t)-1 };
+    struct passwd *pw;
+    GThreadPool *pool;
+    char *partial;
+    int jobs = fetch_jobs(), ok = 0;
+
+    assert((items || n == 0) && dir);
+
+    if (n == 0 || jobs == 0)
+        return 0;
+
+    partial = g_build_filename(dir, FETCH_PARTIAL_DIR, NULL);
+    if (g_mkdir_with_parents(partial, 0755) < 0) {
+        fprintf(stderr, "Error: Failed to create dir %s, err: %m\n", partial);
+        g_free(partial);
+        return ERROR;
+    }
+    g_free(partial);
+
+    ctx.ssl_ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx.ssl_ctx)
+        return ERROR;
+    SSL_CTX_set_verify(ctx.ssl_ctx, SSL_VERIFY_PEER, NULL);
+    (void) SSL_CTX_set_default_verify_paths(ctx.ssl_ctx);
+
+    pw = getpwnam(APT_SANDBOX_USER);
+    if (pw) {
+        ctx.apt_uid = pw->pw_uid;
+        ctx.apt_gid = pw->pw_gid;
+    }
+
+    pool = g_thread_pool_new(fetch_worker, &ctx, MIN(jobs, n), TRUE, NULL);
+    if (!pool) {
+        SSL_CTX_free(ctx.ssl_ctx);
+        return ERROR;
+    }
+    for (int i = 0; i < n; i++) {
+        if (!g_str_has_prefix(items[i].uri, "http://") && !g_str_has_prefix(items[i].uri, "https://")) {
+            items[i].result = -EPROTONOSUPPORT;
+            continue;
+        }
+        g_thread_pool_push(pool, &items[i], NULL);
+    }
+    //等待所有文件下载完
+    g_thread_pool_free(pool, FALSE, TRUE);
+    SSL_CTX_free(ctx.ssl_ctx);
+
+    for (int i = 0; i < n; i++) {
+        if (items[i].result == OK)
+            ok++;
+    }
+    return ok;
+}
+
+void fetch_items_free(fetch_item *items, int n) {
+    for (int i = 0; items && i < n; i++) {
+        g_free(items[i].uri);
+        g_free(items[i].filename);
+        g_free(items[i].hash);
+    }
+    g_free(items);
+}
@@ -0,0 +1,28 @@
+#ifndef FETCH_H_included
+#define FETCH_H_included 1
+#include <stdbool.h>
+#include <stdint.h>
+#include "common.h"
+
+//同时下载的文件数，为0时不预先下载，全部交给apt
+#define FETCH_JOBS 4
+#define FETCH_JOBS_ENV "DEEPIN_DEBUG_CONFIG_FETCH_JOBS"
+#define FETCH_TIMEOUT_SEC 30
+#define FETCH_MAX_REDIRECTS 5
+//与apt相同，未下载完的文件放在这个子目录中，下次从断点继续
+#define FETCH_PARTIAL_DIR "partial"
+
+//要下载的一个文件，与apt-get --print-uris输出的一行对应
+typedef struct fetch_item
+{
+    char *uri;
+    char *filename;     // 保存到目标目录中的文件名
+    uint64_t size;
+    char *hash;         // "SHA256:十六进制"，apt的Packages文件中的散列值
+    int result;
+} fetch_item;
+
+int fetch_jobs();
+int fetch_files(fetch_item *items, int n, const char *dir);
+void fetch_items_free(fetch_item *items, int n);
+#endif
@@ -1,11 +1,18 @@
 #include "util.h"
 #include "module_configure.h"
+#include "client.h"
+#include "buildid.h"
+#include "cJSON.h"
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
 #include <locale.h>
 #include <unistd.h>
 
+/* --json输出的初始缓冲区大小，不够时加倍 */
+#define JSON_BUFFER_SIZE 4096
+#define JSON_BUFFER_MAX (16 * 1024 * 1024)
+
 typedef struct arg_cfg
 {
     /* data */
@@ -14,13 +21,24 @@ typedef struct arg_cfg
     char *level;
     char *coredump_arg;
     char *dbg_pkg_name;
+    char *batch_file;
+    char *profile;
+    char *build_id;
+    char *core;
     bool set;
     bool get;
     bool get_coredump_state;
     bool install_dbg;
     bool show_debug_level_of_type;
+    bool json;
+    bool update_build_ids;
+    bool estimate;
 } arg_cfg;
 
+//--json时要输出的文档，以及被重定向到stderr之前的stdout
+static cJSON *g_json_output = NULL;
+static int g_saved_stdout = -1;
+
 bool check_g_cfg_is_valid(arg_cfg *g_cfg);
 void arg_cfg_unrefp(arg_cfg **g_cfg);
 
@@ -32,8 +50,15 @@ void showUsage(const char *cmd) {
     printf(N_("\t-g --get:\tno arg, means to obtain debug mode information, used together with --coredump or --level\n"));
     printf(N_("\t-c --coredump:\toptionally receive a parameter, depending on the --set and --get options, which indicates switch coredump or get coredump status\n"));
     printf(N_("\t-i --install-dbg:\trequire one arg, which means to install the debug package of the specified pkg, example: -i systemd\n"));
+    printf(N_("\t-e --estimate:\tno arg, used together with --install-dbg, print the download size and disk space needed instead of installing\n"));
     printf(N_("\t-l --level:\toptionally receive a parameter, depending on the --set and --get options, which indicates setting and getting the module log level and coredump status\n"));
     printf(N_("\t-m --module:\trequire one arg, input the name of the module to be configured, example: -m systemd\n"));
+    printf(N_("\t-p --profile:\trequire one arg, apply a named profile from the descriptor directory, example: -p network\n"));
+    printf(N_("\t-j --json:\tno arg, print the result of the operation as a JSON document\n"));
+    printf(N_("\t-b --batch:\trequire one arg, a file (or - for stdin) with one module=level, group:type=level or coredump=on|off per line, applied together\n"));
+    printf(N_("\t-B --build-id:\trequire one arg, print the installed debug file and package for a build-id, example: -B 3f2a9c...\n"));
+    printf(N_("\t-U --update-build-ids:\tno arg, update the build-id index of installed debug symbols\n"));
+    printf(N_("\t-C --core:\trequire one arg, install only the debug packages needed by a core file, a bare name is looked up in %s, example: -C core.ls.1000.xxx.zst\n"), DEFAULT_CORE_PATH);
     printf("\n\n");
 }
 
@@ -62,6 +87,18 @@ void arg_cfg_unrefp(arg_cfg **g_cfg) {
     if(cfg->dbg_pkg_name)
         free(cfg->dbg_pkg_name);
 
+    if(cfg->batch_file)
+        free(cfg->batch_file);
+
+    if(cfg->profile)
+        free(cfg->profile);
+
+    if(cfg->build_id)
+        free(cfg->build_id);
+
+    if(cfg->core)
+        free(cfg->core);
+
     free(cfg);
 }
 
@@ -77,6 +114,25 @@ bool check_g_cfg_is_valid(arg_cfg *g_cfg)
 {
     if(!g_cfg) return false;
 
+    //--estimate只能和--install-dbg一起使用
+    if (g_cfg->estimate && !g_cfg->install_dbg)
+        return false;
+
+    //--build-id、--update-build-ids和--core不能和其他操作一起使用
+    if (g_cfg->build_id || g_cfg->update_build_ids || g_cfg->core) {
+        return !(g_cfg->set || g_cfg->get || g_cfg->install_dbg ||
+                 g_cfg->module_names || g_cfg->module_types ||
+                 g_cfg->batch_file || g_cfg->profile ||
+                 (!!g_cfg->build_id + g_cfg->update_build_ids + !!g_cfg->core > 1));
+    }
+
+    //--batch和--profile不能和其他操作一起使用
+    if (g_cfg->batch_file || g_cfg->profile) {
+        return !(g_cfg->set || g_cfg->get || g_cfg->install_dbg ||
+                 g_cfg->module_names || g_cfg->module_types ||
+                 (g_cfg->batch_file && g_cfg->profile));
+    }
+
     //指定了--set或--get后，必须使用--coredump或者--level
     if (g_cfg->set) {
         if (g_cfg->get || g_cfg->install_dbg) {
@@ -120,6 +176,499 @@ bool check_g_cfg_is_valid(arg_cfg *g_cfg)
     return true;
 }
 
+/*用cJSON的预分配打印函数输出文档，缓冲区不够时加倍重试：
+*
+* root：要输出的文档；
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+static int print_json(cJSON *root)
+{
+    int size = JSON_BUFFER_SIZE;
+
+    while (size <= JSON_BUFFER_MAX) {
+        char *buffer = malloc(size);
+
+        if (!buffer) {
+            fprintf(stderr,N_("Error: NOMEMORY:%m\n"));
+            return ERROR;
+        }
+        if (cJSON_PrintPreallocated(root, buffer, size, true)) {
+            fprintf(stdout, "%s\n", buffer);
+            free(buffer);
+            return OK;
+        }
+        free(buffer);
+        size *= 2;
+    }
+    return ERROR;
+}
+
+/*--json时stdout只输出JSON文档，库函数、服务客户端和脚本输出的文字都重定向到stderr：
+*
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+static int json_redirect_stdout()
+{
+    fflush(stdout);
+    g_saved_stdout = dup(STDOUT_FILENO);
+    if (g_saved_stdout < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+        return ERROR;
+    return OK;
+}
+
+static void json_restore_stdout()
+{
+    if (g_saved_stdout < 0)
+        return;
+    fflush(stdout);
+    dup2(g_saved_stdout, STDOUT_FILENO);
+    close(g_saved_stdout);
+    g_saved_stdout = -1;
+}
+
+static cJSON *json_output()
+{
+    if (!g_json_output)
+        g_json_output = cJSON_CreateObject();
+    return g_json_output;
+}
+
+//输出一个模块(或coredump)的调试等级
+static void output_level(const arg_cfg *g_cfg, const char *name, const char *level)
+{
+    if (g_cfg->json) {
+        cJSON_AddStringToObject(json_output(), "name", name);
+        cJSON_AddStringToObject(json_output(), "level", level);
+    } else {
+        fprintf(stdout,"%s\n", level);
+    }
+}
+
+static void json_add_module_state(const module_state *state, void *userdata)
+{
+    cJSON *modules = userdata;
+    cJSON *module = cJSON_CreateObject();
+
+    cJSON_AddStringToObject(module, "name", state->name);
+    if (state->type)
+        cJSON_AddStringToObject(module, "group", state->type);
+    else
+        cJSON_AddNullToObject(module, "group");
+    if (state->level)
+        cJSON_AddStringToObject(module, "level", state->level);
+    else
+        cJSON_AddNullToObject(module, "level");
+    cJSON_AddBoolToObject(module, "reboot", state->reboot != 0);
+    cJSON_AddItemToArray(modules, module);
+}
+
+/*生成包含所有模块的名字、类型、调试等级、是否需要重启和脚本sha256检查结果的文档：
+*
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+static int output_all_modules_json()
+{
+    cJSON *modules = cJSON_AddArrayToObject(json_output(), "modules");
+    cJSON *module = NULL;
+    char *coredump_state = NULL;
+    int r;
+
+    r = config_modules_foreach_state(0, json_add_module_state, modules, NULL);
+    if (r < 0)
+        return r;
+
+    //计算sha256比较耗时，在遍历结束、释放锁之后再做
+    cJSON_ArrayForEach(module, modules) {
+        const char *name = cJSON_GetStringValue(cJSON_GetObjectItem(module, "name"));
+        r = config_module_check_scripts(name);
+        if (r < 0)
+            cJSON_AddNullToObject(module, "scripts_allowed");
+        else
+            cJSON_AddBoolToObject(module, "scripts_allowed", r == 1);
+    }
+
+    _cleanup_strv_free_ char **profiles = get_profile_names();
+    cJSON *profile_list = cJSON_AddArrayToObject(json_output(), "profiles");
+    for (int i = 0; profiles && profiles[i]; i++)
+        cJSON_AddItemToArray(profile_list, cJSON_CreateString(profiles[i]));
+
+    if (config_module_get_debug_level_by_type("coredump", &coredump_state) == OK) {
+        cJSON_AddStringToObject(json_output(), "coredump", coredump_state);
+        free(coredump_state);
+    } else {
+        cJSON_AddNullToObject(json_output(), "coredump");
+    }
+    return OK;
+}
+
+static void json_add_list(cJSON *object, const char *name, const char *list)
+{
+    int count = 0;
+    _cleanup_strv_free_ char **items = parseString(list, ",", &count);
+
+    if (items && count > 0)
+        cJSON_AddItemToObject(object, name, cJSON_CreateStringArray((const char *const *)items, count));
+}
+
+//设置、安装调试包等没有其他输出的操作，只输出操作的参数
+static void output_operation_json(const arg_cfg *g_cfg)
+{
+    cJSON *doc = json_output();
+
+    if (g_cfg->set) {
+        cJSON_AddStringToObject(doc, "operation", "set");
+        if (g_cfg->module_types)
+            json_add_list(doc, "groups", g_cfg->module_types);
+        if (g_cfg->module_names)
+            json_add_list(doc, "modules", g_cfg->module_names);
+        if (g_cfg->coredump_arg)
+            cJSON_AddStringToObject(doc, "coredump", g_cfg->coredump_arg);
+        else if (g_cfg->level)
+            cJSON_AddStringToObject(doc, "level", g_cfg->level);
+    } else if (g_cfg->profile) {
+        cJSON_AddStringToObject(doc, "operation", "profile");
+        cJSON_AddStringToObject(doc, "profile", g_cfg->profile);
+    } else if (g_cfg->install_dbg) {
+        cJSON_AddStringToObject(doc, "operation", g_cfg->estimate ? "estimate-dbg" : "install-dbg");
+        json_add_list(doc, "modules", g_cfg->dbg_pkg_name);
+    } else if (g_cfg->build_id) {
+        cJSON_AddStringToObject(doc, "operation", "build-id");
+        cJSON_AddStringToObject(doc, "build_id", g_cfg->build_id);
+    } else if (g_cfg->update_build_ids) {
+        cJSON_AddStringToObject(doc, "operation", "update-build-ids");
+    } else if (g_cfg->core) {
+        cJSON_AddStringToObject(doc, "operation", "install-core-dbg");
+        cJSON_AddStringToObject(doc, "core", g_cfg->core);
+    }
+}
+
+//stdout恢复之后输出最终的文档，所有文档都带有result
+static void output_json_result(const arg_cfg *g_cfg, bool ok)
+{
+    json_restore_stdout();
+    if (!g_json_output)
+        output_operation_json(g_cfg);
+    cJSON_AddStringToObject(json_output(), "result", ok ? "ok" : "fail");
+    (void) print_json(g_json_output);
+    cJSON_Delete(g_json_output);
+    g_json_output = NULL;
+}
+
+static const char *batch_kind_to_string(config_batch_kind kind)
+{
+    switch (kind) {
+    case CONFIG_BATCH_GROUP:
+        return "group";
+    case CONFIG_BATCH_COREDUMP:
+        return "coredump";
+    default:
+        return "module";
+    }
+}
+
+static void json_add_batch_op(cJSON *lines, const config_batch_op *op)
+{
+    cJSON *line = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(line, "line", op->line);
+    cJSON_AddStringToObject(line, "kind", batch_kind_to_string(op->kind));
+    cJSON_AddStringToObject(line, "target", op->target ? op->target : "");
+    if (op->level)
+        cJSON_AddStringToObject(line, "level", op->level);
+    else
+        cJSON_AddNullToObject(line, "level");
+    if (op->unchanged) {
+        cJSON_AddStringToObject(line, "result", "unchanged");
+    } else if (op->result != OK) {
+        cJSON_AddStringToObject(line, "result", "fail");
+        cJSON_AddStringToObject(line, "message", op->message ? op->message : "error");
+    } else if (op->superseded_by > 0) {
+        cJSON_AddStringToObject(line, "result", "superseded");
+        cJSON_AddNumberToObject(line, "superseded_by", op->superseded_by);
+    } else {
+        cJSON_AddStringToObject(line, "result", "ok");
+    }
+    cJSON_AddItemToArray(lines, line);
+}
+
+static void output_size(const char *label, uint64_t size)
+{
+    fprintf(stdout, "%s\t%.1f MiB\n", label, size / 1048576.0);
+}
+
+/*输出安装调试包的估算结果：
+*
+* est：估算结果。
+* 函数返回值：
+*
+* 空间足够：返回 0；
+* 空间不够：返回 -ENOSPC。*/
+static int output_estimate(const arg_cfg *g_cfg, const dbgsym_estimate *est)
+{
+    if (g_cfg->json) {
+        cJSON_AddNumberToObject(json_output(), "packages", est->packages);
+        cJSON_AddNumberToObject(json_output(), "missing", est->missing);
+        cJSON_AddNumberToObject(json_output(), "download_size", est->download_size);
+        cJSON_AddNumberToObject(json_output(), "installed_size", est->installed_size);
+        cJSON_AddNumberToObject(json_output(), "available_size", est->available_size);
+        cJSON_AddBoolToObject(json_output(), "enough_space", est->enough_space);
+    } else {
+        fprintf(stdout, N_("dbgsym packages to install:\t%d\n"), est->packages);
+        if (est->missing > 0)
+            fprintf(stdout, N_("packages without dbgsym:\t%d\n"), est->missing);
+        output_size(N_("download size:"), est->download_size);
+        output_size(N_("installed size:"), est->installed_size);
+        output_size(N_("available space:"), est->available_size);
+    }
+
+    if (!est->enough_space) {
+        fprintf(stderr, N_("Error: Not enough disk space to install the dbgsym packages.\n"));
+        return -ENOSPC;
+    }
+    return OK;
+}
+
+/*通过system bus交给deepin-debug-config-service执行，服务已经加载好了模块配置，
+* 权限由polkit检查，所以不需要root：
+*
+* g_cfg：保存了用户输入参数的结构体；
+* 函数返回值：
+*
+* 成功：返回 0；
+* 服务不可用：返回 CLIENT_UNAVAILABLE，需要在本进程中执行；
+* 失败：返回 ERR_RET。*/
+static int run_with_service(arg_cfg *g_cfg)
+{
+    int r;
+
+    //服务没有按模块类型和coredump一起设置的接口，批量模式总是在本进程中执行
+    if (g_cfg->batch_file)
+        return CLIENT_UNAVAILABLE;
+
+    if (g_cfg->profile)
+        return client_set_profile(g_cfg->profile);
+
+    if (g_cfg->show_debug_level_of_type) {
+        char *debug_level = NULL;
+        if (!g_cfg->module_names)
+            return CLIENT_UNAVAILABLE;
+        r = client_get_debug_level(g_cfg->module_names, &debug_level);
+        if (r == OK) {
+            output_level(g_cfg, g_cfg->module_names, debug_level);
+            free(debug_level);
+        }
+        return r;
+    }
+
+    if (g_cfg->get_coredump_state) {
+        char *coredump_state = NULL;
+        r = client_get_debug_level("coredump", &coredump_state);
+        if (r == OK) {
+            output_level(g_cfg, "coredump", coredump_state);
+            free(coredump_state);
+        }
+        return r;
+    }
+
+    //服务不提供脚本的sha256检查结果，完整的JSON文档在本进程中生成
+    if (g_cfg->get && g_cfg->json)
+        return CLIENT_UNAVAILABLE;
+
+    if (g_cfg->get) {
+        _cleanup_strv_free_ char **names = NULL;
+        r = client_get_module_names(&names);
+        if (r == OK) {
+            printf("Support module names:\n");
+            for (int i = 0; names[i] != NULL; i++) {
+                printf("\t%s\n", names[i]);
+            }
+        }
+        return r;
+    }
+
+    if (g_cfg->set) {
+        //服务没有按模块类型设置的接口
+        if (g_cfg->module_types)
+            return CLIENT_UNAVAILABLE;
+        if (g_cfg->module_names)
+            return client_set_debug_level(g_cfg->module_names, g_cfg->level);
+        if (g_cfg->coredump_arg)
+            return client_set_coredump(strcmp(g_cfg->coredump_arg,"on")==0);
+    } else if (g_cfg->install_dbg && g_cfg->estimate) {
+        dbgsym_estimate est;
+
+        r = client_estimate_dbgpkgs(g_cfg->dbg_pkg_name, &est);
+        if (r == OK)
+            r = output_estimate(g_cfg, &est);
+        return r;
+    } else if (g_cfg->install_dbg) {
+        return client_install_dbgpkgs(g_cfg->dbg_pkg_name);
+    } else if (g_cfg->core) {
+        //服务只读取DEFAULT_CORE_PATH下的core，其它路径在本进程中处理
+        const char *name = g_cfg->core;
+
+        if (strncmp(name, DEFAULT_CORE_PATH, strlen(DEFAULT_CORE_PATH)) == 0)
+            name += strlen(DEFAULT_CORE_PATH);
+        if (!strchr(name, '/'))
+            return client_install_core_dbgpkgs(name);
+    }
+
+    return CLIENT_UNAVAILABLE;
+}
+
+static void print_batch_op(const config_batch_op *op)
+{
+    fprintf(stdout, "line %d: %s%s=%s ", op->line,
+            op->kind == CONFIG_BATCH_GROUP ? "group:" : "",
+            op->target ? op->target : "", op->level ? op->level : "");
+    if (op->unchanged)
+        fprintf(stdout, "unchanged\n");
+    else if (op->result != OK)
+        fprintf(stdout, "fail (%s)\n", op->message ? op->message : "error");
+    else if (op->superseded_by > 0)
+        fprintf(stdout, "superseded by line %d\n", op->superseded_by);
+    else
+        fprintf(stdout, "ok\n");
+}
+
+//打印批量操作每一行的结果
+static void report_batch(const arg_cfg *g_cfg, const char *operation, const config_batch_op *ops, int ops_num)
+{
+    if (g_cfg->json) {
+        cJSON *lines;
+
+        cJSON_AddStringToObject(json_output(), "operation", operation);
+        lines = cJSON_AddArrayToObject(json_output(), "lines");
+        for (int i = 0; i < ops_num; i++)
+            json_add_batch_op(lines, &ops[i]);
+    } else {
+        for (int i = 0; i < ops_num; i++)
+            print_batch_op(&ops[i]);
+    }
+}
+
+/*执行--batch指定的文件中的所有操作，并打印每一行的结果：
+*
+* path：输入文件的路径，为"-"时从标准输入读取；
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+static int run_batch(const arg_cfg *g_cfg, const char *path)
+{
+    config_batch_op *ops = NULL;
+    int ops_num = 0, r;
+    FILE *fp;
+
+    fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) {
+        r = ERROR;
+        fprintf(stderr, N_("Error: file %s,failed:%m\n"), path);
+        return r;
+    }
+
+    r = config_batch_parse(fp, &ops, &ops_num);
+    if (fp != stdin)
+        fclose(fp);
+    if (r < 0)
+        return r;
+
+    r = config_batch_apply(ops, ops_num);
+    report_batch(g_cfg, "batch", ops, ops_num);
+
+    config_batch_free(ops, ops_num);
+    return r;
+}
+
+/*在本进程中应用一个配置方案，已经是目标等级的模块不会被执行：
+*
+* name：配置方案名；
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+static int run_profile(const arg_cfg *g_cfg, const char *name)
+{
+    config_batch_op *ops = NULL;
+    int ops_num = 0, r;
+
+    r = config_profile_build_batch(name, &ops, &ops_num);
+    if (r < 0)
+        return r;
+
+    r = config_batch_apply(ops, ops_num);
+    if (g_cfg->json)
+        cJSON_AddStringToObject(json_output(), "profile", name);
+    report_batch(g_cfg, "profile", ops, ops_num);
+
+    config_batch_free(ops, ops_num);
+    return r;
+}
+
+//在本进程中估算，只读取软件包列表，不需要root权限
+static int run_estimate(const arg_cfg *g_cfg)
+{
+    _cleanup_strv_free_ char **modules = NULL;
+    dbgsym_estimate est;
+    int count = 0, r;
+
+    modules = parseString(g_cfg->dbg_pkg_name, ",", &count);
+    if (count <= 0 || !modules) {
+        fprintf(stderr, N_("Error: Invalid module_name: %s\n"), g_cfg->dbg_pkg_name);
+        return ERROR;
+    }
+
+    r = config_modules_estimate_dbgpkgs(modules, count, &est);
+    if (r < 0) {
+        fprintf(stderr, N_("Error: Failed to estimate dbg packages for %s\n"), g_cfg->dbg_pkg_name);
+        return r;
+    }
+    return output_estimate(g_cfg, &est);
+}
+
+/*查找build-id对应的调试文件，只读取本地的索引，不需要root权限：
+*
+* build_id：十六进制的build-id；
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+static int run_lookup_build_id(const arg_cfg *g_cfg, const char *build_id)
+{
+    _cleanup_free_ char *path = NULL;
+    _cleanup_free_ char *package = NULL;
+    int r;
+
+    r = buildid_lookup(build_id, &path, &package);
+    if (r == -EINVAL) {
+        fprintf(stderr, N_("Error: Invalid build-id: %s\n"), build_id);
+        return r;
+    }
+    if (r < 0) {
+        fprintf(stderr, N_("Error: No debug file for build-id %s\n"), build_id);
+        return r;
+    }
+
+    if (g_cfg->json) {
+        cJSON_AddStringToObject(json_output(), "operation", "build-id");
+        cJSON_AddStringToObject(json_output(), "build_id", build_id);
+        cJSON_AddStringToObject(json_output(), "path", path);
+        if (isempty(package))
+            cJSON_AddNullToObject(json_output(), "package");
+        else
+            cJSON_AddStringToObject(json_output(), "package", package);
+    } else {
+        fprintf(stdout, "%s\t%s\n", path, isempty(package) ? "-" : package);
+    }
+    return OK;
+}
+
 int main(int argc,char *argv[]) {
     _cleanup_(arg_cfg_unrefp) arg_cfg *g_cfg = NULL;
     int argidx = 1;
@@ -150,6 +699,13 @@ int main(int argc,char *argv[]) {
         { "help",	      no_argument,       NULL, 'h' },
         { "set",	      no_argument,       NULL, 's' },
         { "get",	      no_argument,       NULL, 'g' },
+        { "batch",          required_argument, NULL, 'b' },
+        { "json",           no_argument,       NULL, 'j' },
+        { "profile",        required_argument, NULL, 'p' },
+        { "build-id",       required_argument, NULL, 'B' },
+        { "update-build-ids", no_argument,     NULL, 'U' },
+        { "core",           required_argument, NULL, 'C' },
+        { "estimate",       no_argument,       NULL, 'e' },
         { NULL, 0, NULL, 0 }
 	};
 
@@ -161,7 +717,7 @@ int main(int argc,char *argv[]) {
 
     int c;
     while ((c = getopt_long (argc, argv,
-			    "t:m:lci:hgs", longopts, NULL)) != -1) {
+			    "t:m:lci:hgsb:jp:B:UC:e", longopts, NULL)) != -1) {
         ++argidx;
         switch (c) {
             case 's':
@@ -235,6 +791,31 @@ int main(int argc,char *argv[]) {
                 ++argidx;
                 g_cfg->install_dbg = true;
                 break;
+            case 'p':
+                g_cfg->profile = strdup(optarg);
+                ++argidx;
+                break;
+            case 'j':
+                g_cfg->json = true;
+                break;
+            case 'b':
+                g_cfg->batch_file = strdup(optarg);
+                ++argidx;
+                break;
+            case 'B':
+                g_cfg->build_id = strdup(optarg);
+                ++argidx;
+                break;
+            case 'U':
+                g_cfg->update_build_ids = true;
+                break;
+            case 'C':
+                g_cfg->core = strdup(optarg);
+                ++argidx;
+                break;
+            case 'e':
+                g_cfg->estimate = true;
+                break;
             case 'h':
                 showUsage(Basename (argv[0]));
                 return OK;
@@ -251,12 +832,6 @@ int main(int argc,char *argv[]) {
         }
     }
 
-    //加载json配置文件
-    int r = init_module_cfgs(MODULES_DEBUG_CONFIG_PATH);
-    if (r < 0) {
-        goto fail;
-    }
-
     //检查参数是否符合有效
     if(!check_g_cfg_is_valid(g_cfg)) {
         fprintf(stderr, N_("Try '%s --help' for more information.\n"), \
@@ -264,6 +839,56 @@ int main(int argc,char *argv[]) {
         goto fail;
     }
 
+    if (g_cfg->json && json_redirect_stdout() < 0) {
+        fprintf(stderr, N_("Error: Failed to redirect stdout: %m\n"));
+        goto fail;
+    }
+
+    int r;
+
+    //build-id的查询和索引的更新只读写本地文件，不需要服务和模块配置
+    if (g_cfg->build_id) {
+        r = run_lookup_build_id(g_cfg, g_cfg->build_id);
+        if (r < 0)
+            goto fail;
+        goto success;
+    }
+
+    //由dpkg触发器在调试包安装或卸载后调用
+    if (g_cfg->update_build_ids) {
+        if(getuid() != 0) {
+            fprintf (stderr,
+                        N_("Error: %s: Permission denied.\n"),
+                        Basename (argv[0]));
+            goto fail;
+        }
+        r = buildid_index_update(false);
+        if (r < 0)
+            goto fail;
+        goto success;
+    }
+
+    //优先交给服务执行，只有服务不可用时才在本进程中执行
+    r = run_with_service(g_cfg);
+    if (r == OK)
+        goto success;
+    if (r < 0)
+        goto fail;
+
+    //估算不修改系统，不需要模块配置和root权限
+    if (g_cfg->install_dbg && g_cfg->estimate) {
+        r = run_estimate(g_cfg);
+        if (r < 0)
+            goto fail;
+        goto success;
+    }
+
+    //加载json配置文件
+    r = init_module_cfgs(MODULES_DEBUG_CONFIG_PATH);
+    if (r < 0) {
+        goto fail;
+    }
+
     //打印某个类型的模块的开关状态
     if(g_cfg->show_debug_level_of_type) {
         char *debug_level = NULL;
@@ -275,7 +900,7 @@ int main(int argc,char *argv[]) {
         if(r < 0) {
             goto fail;
         }
-        fprintf(stdout,"%s\n", debug_level);
+        output_level(g_cfg, g_cfg->module_names, debug_level);
         free(debug_level);
         goto success;
     }
@@ -288,11 +913,18 @@ int main(int argc,char *argv[]) {
             fprintf(stderr, N_("Error: Failed to get coredump state.\n"));
             goto fail;
         }
-        fprintf(stdout,"%s\n", coredump_state);
+        output_level(g_cfg, "coredump", coredump_state);
         free(coredump_state);
         goto success;
     }
 
+    if (g_cfg->get && g_cfg->json) {
+        r = output_all_modules_json();
+        if (r < 0)
+            goto fail;
+        goto success;
+    }
+
     if (g_cfg->get) {
         char **names = get_module_names();
 
@@ -313,6 +945,23 @@ int main(int argc,char *argv[]) {
     }
 
 
+    //批量模式：所有操作只提交一次，日志相关的后续操作也只执行一次
+    if (g_cfg->batch_file) {
+        r = run_batch(g_cfg, g_cfg->batch_file);
+        config_module_check_log();
+        if(r < 0)
+            goto fail;
+        goto success;
+    }
+
+    if (g_cfg->profile) {
+        r = run_profile(g_cfg, g_cfg->profile);
+        config_module_check_log();
+        if(r < 0)
+            goto fail;
+        goto success;
+    }
+
     //当-m,--module参数被传入，进行相应的配置
     if (g_cfg->set) {
         if (g_cfg->module_types) {
@@ -336,13 +985,24 @@ int main(int argc,char *argv[]) {
         r = config_modules_install_dbgpkgs(g_cfg->dbg_pkg_name);
         if(r < 0)
             goto fail;
+    } else if (g_cfg->core) {
+        //只安装core中用到的调试包
+        r = config_core_install_dbgpkgs(g_cfg->core);
+        if(r < 0)
+            goto fail;
     }
 
 success:
+    if (g_cfg->json) {
+        output_json_result(g_cfg, true);
+        return 0;
+    }
     fprintf(stdout, N_("Done.\n"));
     return 0;
 
 fail:
+    if (g_cfg && g_cfg->json)
+        output_json_result(g_cfg, false);
     fprintf(stderr, N_("Failed.\n"));
     deinit_module_cfgs();
     return ERROR;
@@ -0,0 +1,258 @@
+#include "metrics.h"
+#include "common.h"
+#include "util.h"
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <glib.h>
+
+typedef struct metrics_family_info
+{
+    const char *name;
+    const char *help;
+} metrics_family_info;
+
+static const metrics_family_info g_family_info[_METRICS_FAMILY_MAX] = {
+    [METRICS_METHOD] = {"method", "Time from receiving a D-Bus method call to finishing it."},
+    [METRICS_SCRIPT] = {"script", "Time spent running a module configuration script."},
+    [METRICS_POLKIT] = {"polkit", "Round-trip time of polkit CheckAuthorization."},
+    [METRICS_DIGEST] = {"digest", "Time spent verifying the sha256 digest of a shell script."},
+    [METRICS_REGISTRY] = {"registry", "Time spent loading the module descriptor directory."},
+    [METRICS_STARTUP] = {"startup", "Time from service start until the bus name is acquired."},
+    [METRICS_AUTH_CACHE] = {"auth_cache", "Authorized calls answered from the authorization cache without asking polkit."},
+};
+
+//每个类别一个表，key为label，value为metrics_histogram
+static GHashTable *g_metrics[_METRICS_FAMILY_MAX];
+G_LOCK_DEFINE_STATIC(metrics);
+
+static void free_histogram(void *t_pointer) {
+    metrics_histogram *h = t_pointer;
+    if (!h) return;
+
+    free((char *)h->label);
+    free(h);
+}
+
+uint64_t metrics_now_usec() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+uint64_t metrics_bucket_bound_usec(int i) {
+    return 1ULL << i;
+}
+
+const char *metrics_family_to_string(metrics_family family) {
+    if (family < 0 || family >= _METRICS_FAMILY_MAX)
+        return NULL;
+    return g_family_info[family].name;
+}
+
+//usec落在(2^(i-1), 2^i]时返回i，和Prometheus的le一样包含上限，超出最后一个桶时返回METRICS_BUCKETS
+static int bucket_index(uint64_t usec) {
+    int i = 0;
+
+    if (usec > 0)
+        usec--;
+    while (usec) {
+        usec >>= 1;
+        i++;
+    }
+    return i < METRICS_BUCKETS ? i : METRICS_BUCKETS;
+}
+
+/*记录一次操作的耗时：
+*
+* family：操作类别；
+* label：具体的方法名、脚本名等，可以为NULL；
+* usec：耗时，单位微秒；
+* failed：操作是否失败，失败的次数单独计数。
+* 函数返回值：
+*
+* 无*/
+void metrics_observe(metrics_family family, const char *label, uint64_t usec, bool failed) {
+    metrics_histogram *h;
+    int i;
+
+    if (family < 0 || family >= _METRICS_FAMILY_MAX)
+        return;
+    if (!label)
+        label = "";
+
+    G_LOCK(metrics);
+    if (!g_metrics[family])
+        g_metrics[family] = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free_histogram);
+
+    h = g_hash_table_lookup(g_metrics[family], label);
+    if (!h) {
+        h = malloc(sizeof(metrics_histogram));
+        if (!h)
+            goto out;
+        memset(h, 0, sizeof(metrics_histogram));
+        h->family = family;
+        h->label = strdup(label);
+        if (!h->label) {
+            free(h);
+            goto out;
+        }
+        g_hash_table_insert(g_metrics[family], (char *)h->label, h);
+    }
+
+    h->count++;
+    h->sum_usec += usec;
+    if (failed)
+        h->errors++;
+    i = bucket_index(usec);
+    if (i < METRICS_BUCKETS)
+        h->buckets[i]++;
+out:
+    G_UNLOCK(metrics);
+}
+
+void metrics_observe_since(metrics_family family, const char *label, uint64_t start_usec, bool failed) {
+    uint64_t now = metrics_now_usec();
+
+    metrics_observe(family, label, now > start_usec ? now - start_usec : 0, failed);
+}
+
+/*遍历所有直方图，回调在持有锁时执行，不能在回调中调用metrics_observe：
+*
+* 函数返回值：
+*
+* 无*/
+void metrics_foreach(metrics_histogram_cb cb, void *userdata) {
+    GHashTableIter iter;
+    metrics_histogram *h;
+
+    assert(cb);
+
+    G_LOCK(metrics);
+    for (int f = 0; f < _METRICS_FAMILY_MAX; f++) {
+        if (!g_metrics[f])
+            continue;
+        g_hash_table_iter_init(&iter, g_metrics[f]);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&h))
+            cb(h, userdata);
+    }
+    G_UNLOCK(metrics);
+}
+
+void metrics_reset() {
+    G_LOCK(metrics);
+    for (int f = 0; f < _METRICS_FAMILY_MAX; f++) {
+        if (g_metrics[f]) {
+            g_hash_table_destroy(g_metrics[f]);
+            g_metrics[f] = NULL;
+        }
+    }
+    G_UNLOCK(metrics);
+}
+
+static void write_label_value(FILE *fp, const char *value) {
+    for (const char *p = value; *p; p++) {
+        if (*p == '\\' || *p == '"')
+            fprintf(fp, "\\%c", *p);
+        else if (*p == '\n')
+            fputs("\\n", fp);
+        else
+            fputc(*p, fp);
+    }
+}
+
+static void write_histogram(FILE *fp, const metrics_histogram *h) {
+    const char *family = g_family_info[h->family].name;
+    uint64_t cumulative = 0;
+
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        cumulative += h->buckets[i];
+        fprintf(fp, "deepin_debug_config_%s_duration_seconds_bucket{name=\"", family);
+        write_label_value(fp, h->label);
+        fprintf(fp, "\",le=\"%g\"} %llu\n", metrics_bucket_bound_usec(i) / 1e6, (unsigned long long)cumulative);
+    }
+    fprintf(fp, "deepin_debug_config_%s_duration_seconds_bucket{name=\"", family);
+    write_label_value(fp, h->label);
+    fprintf(fp, "\",le=\"+Inf\"} %llu\n", (unsigned long long)h->count);
+
+    fprintf(fp, "deepin_debug_config_%s_duration_seconds_sum{name=\"", family);
+    write_label_value(fp, h->label);
+    fprintf(fp, "\"} %.6f\n", h->sum_usec / 1e6);
+
+    fprintf(fp, "deepin_debug_config_%s_duration_seconds_count{name=\"", family);
+    write_label_value(fp, h->label);
+    fprintf(fp, "\"} %llu\n", (unsigned long long)h->count);
+}
+
+static void write_errors(FILE *fp, const metrics_histogram *h) {
+    fprintf(fp, "deepin_debug_config_%s_errors_total{name=\"", g_family_info[h->family].name);
+    write_label_value(fp, h->label);
+    fprintf(fp, "\"} %llu\n", (unsigned long long)h->errors);
+}
+
+/*把所有直方图以Prometheus文本格式写入path，供node_exporter的textfile collector读取。
+* 先写临时文件再rename，collector不会读到写了一半的文件：
+*
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int metrics_write_textfile(const char *path) {
+    char tmp[PATH_MAX] = {0};
+    GHashTableIter iter;
+    metrics_histogram *h;
+    FILE *fp = NULL;
+    int fd, r = OK;
+
+    assert(path);
+
+    snprintf(tmp, PATH_MAX, "%s.XXXXXX", path);
+    fd = mkstemp(tmp);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create %s: %m\n", tmp);
+        return ERROR;
+    }
+    fchmod(fd, 0644);
+
+    fp = fdopen(fd, "w");
+    if (!fp) {
+        r = ERROR;
+        close(fd);
+        unlink(tmp);
+        return r;
+    }
+
+    G_LOCK(metrics);
+    for (int f = 0; f < _METRICS_FAMILY_MAX; f++) {
+        if (!g_metrics[f] || g_hash_table_size(g_metrics[f]) == 0)
+            continue;
+
+        fprintf(fp, "# HELP deepin_debug_config_%s_duration_seconds %s\n", g_family_info[f].name, g_family_info[f].help);
+        fprintf(fp, "# TYPE deepin_debug_config_%s_duration_seconds histogram\n", g_family_info[f].name);
+        g_hash_table_iter_init(&iter, g_metrics[f]);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&h))
+            write_histogram(fp, h);
+
+        fprintf(fp, "# HELP deepin_debug_config_%s_errors_total Number of failed operations.\n", g_family_info[f].name);
+        fprintf(fp, "# TYPE deepin_debug_config_%s_errors_total counter\n", g_family_info[f].name);
+        g_hash_table_iter_init(&iter, g_metrics[f]);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&h))
+            write_errors(fp, h);
+    }
+    G_UNLOCK(metrics);
+
+    if (fflush(fp) != 0 || ferror(fp))
+        r = ERROR;
+    fclose(fp);
+
+    if (r == OK && rename(tmp, path) < 0) {
+        r = ERROR;
+        fprintf(stderr, "Failed to rename %s to %s: %m\n", tmp, path);
+    }
+    if (r != OK)
+        unlink(tmp);
+    return r;
+}
@@ -0,0 +1,42 @@
+#ifndef METRICS_H_included
+#define METRICS_H_included 1
+#include <stdint.h>
+#include <stdbool.h>
+
+//直方图的桶按2的幂划分，第i个桶的上限是2^i微秒，最后一个桶约为67秒，超过的只计入count
+#define METRICS_BUCKETS 27
+
+//被统计的操作类别
+typedef enum metrics_family
+{
+    METRICS_METHOD,     // D-Bus方法，label为方法名
+    METRICS_SCRIPT,     // 模块的配置脚本，label为脚本文件名
+    METRICS_POLKIT,     // polkit授权的往返时间，label为action id
+    METRICS_DIGEST,     // 脚本sha256校验，label为脚本路径
+    METRICS_REGISTRY,   // 加载模块配置目录，label为目录或缓存文件
+    METRICS_STARTUP,    // 服务从启动到获得bus name
+    METRICS_AUTH_CACHE, // 命中授权缓存、没有询问polkit的调用，label为action id
+    _METRICS_FAMILY_MAX
+} metrics_family;
+
+typedef struct metrics_histogram
+{
+    metrics_family family;
+    const char *label;
+    uint64_t count;
+    uint64_t errors;
+    uint64_t sum_usec;
+    uint64_t buckets[METRICS_BUCKETS];  // 不累加，每个桶只包含落在该区间的次数
+} metrics_histogram;
+
+typedef void (*metrics_histogram_cb)(const metrics_histogram *h, void *userdata);
+
+uint64_t metrics_now_usec();
+uint64_t metrics_bucket_bound_usec(int i);
+const char *metrics_family_to_string(metrics_family family);
+void metrics_observe(metrics_family family, const char *label, uint64_t usec, bool failed);
+void metrics_observe_since(metrics_family family, const char *label, uint64_t start_usec, bool failed);
+void metrics_foreach(metrics_histogram_cb cb, void *userdata);
+int metrics_write_textfile(const char *path);
+void metrics_reset();
+#endif
@@ -1,4 +1,9 @@
 #include "module_configure.h"
+#include "metrics.h"
+#include "dbgsym.h"
+#include "buildid.h"
+#include "corefile.h"
+#include "coredump.h"
 #include "util.h"
 #include "cJSON.h"
 #include <dirent.h>
@@ -7,6 +12,7 @@
 #include <unistd.h>
 #include <openssl/sha.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <glib.h>
 
@@ -18,6 +24,32 @@ extern unsigned char config_sha256[][SHA256_DIGEST_LENGTH];
 extern int config_sha256_count;
 
 GHashTable *g_module_cfgs = NULL;
+//"type"为"profile"的描述文件，key为配置方案名，value为module_cfg
+static GHashTable *g_profile_cfgs = NULL;
+
+typedef struct module_level
+{
+    char *level;           // 为NULL时表示这一项已经从文件中删除，保留下来用于报告删除
+    uint64_t generation;   // 最后一次变化时的代数
+    uint64_t last_changed; // 最后一次变化的时间，单位微秒(CLOCK_REALTIME)
+} module_level;
+
+//MODULES_DEBUG_LEVELS_PATH的内存缓存，key为模块名（或all、coredump），value为module_level
+static GHashTable *g_module_levels = NULL;
+static uint64_t g_levels_generation = 0;
+static struct stat g_levels_stat;
+//缓存中调试等级为debug或on的项数，随缓存的每次变化增量维护
+static unsigned int g_debug_on_count = 0;
+//服务会在工作线程中修改调试等级，缓存和MODULES_DEBUG_LEVELS_PATH的读写都要持有这个锁
+G_LOCK_DEFINE_STATIC(debug_levels);
+
+static void free_module_level(void *t_pointer) {
+    module_level *p_level = t_pointer;
+    if (!p_level) return;
+
+    if (p_level->level) free(p_level->level);
+    free(p_level);
+}
 
 static void free_submodule_cfg(sub_module_cfg *p_cfg) {
     if (!p_cfg) return;
@@ -38,18 +70,274 @@ static void free_module_cfg(void *t_pointer) {
         }
         free(p_cfg->sub_modules);
     }
+    strv_free(p_cfg->profile_modules);
+    strv_free(p_cfg->profile_levels);
+}
+
+#define REGISTRY_CACHE_VERSION 2
+#define REGISTRY_CACHE_GROUP "cache"
+#define REGISTRY_MODULE_GROUP_PREFIX "module "
+#define REGISTRY_PROFILE_GROUP_PREFIX "profile "
+
+static GHashTable *new_module_cfgs_table() {
+    return g_hash_table_new_full (g_str_hash,
+                                  g_str_equal,
+                                  g_free,
+                                  free_module_cfg);
+}
+
+static void destroy_module_cfgs() {
+    if (g_module_cfgs) {
+        g_hash_table_destroy(g_module_cfgs);
+        g_module_cfgs = NULL;
+    }
+    if (g_profile_cfgs) {
+        g_hash_table_destroy(g_profile_cfgs);
+        g_profile_cfgs = NULL;
+    }
+}
+
+//复制GKeyFile返回的字符串数组，保证与模块配置中的其它字符串一样用free释放
+static char **strv_copy(gchar **l, gsize n) {
+    char **r = malloc(sizeof(char *) * (n + 1));
+
+    assert(r);
+    for (gsize i = 0; i < n; i++) {
+        r[i] = strdup(l[i]);
+        assert(r[i]);
+    }
+    r[n] = NULL;
+    return r;
+}
+
+static int load_cached_profile(GKeyFile *keyfile, const char *group) {
+    gchar **modules = NULL, **levels = NULL;
+    gsize n_modules = 0, n_levels = 0;
+    module_cfg *mdle_cfg = NULL;
+
+    modules = g_key_file_get_string_list(keyfile, group, "modules", &n_modules, NULL);
+    levels = g_key_file_get_string_list(keyfile, group, "levels", &n_levels, NULL);
+    if (!modules || !levels || n_modules != n_levels) {
+        g_strfreev(modules);
+        g_strfreev(levels);
+        return ERROR;
+    }
+
+    mdle_cfg = (module_cfg*)malloc(sizeof(module_cfg));
+    assert(mdle_cfg);
+    memset(mdle_cfg, 0, sizeof(module_cfg));
+    mdle_cfg->name = strdup(group + strlen(REGISTRY_PROFILE_GROUP_PREFIX));
+    mdle_cfg->profile = true;
+    mdle_cfg->profile_modules = strv_copy(modules, n_modules);
+    mdle_cfg->profile_levels = strv_copy(levels, n_levels);
+    g_strfreev(modules);
+    g_strfreev(levels);
+
+    g_hash_table_insert (g_profile_cfgs, g_strdup (mdle_cfg->name), mdle_cfg);
+    return OK;
+}
+
+static gint compare_strings(gconstpointer a, gconstpointer b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*计算目录中json文件的签名，包含每个文件的文件名、大小和修改时间，
+* 任何一个文件被增加、删除或修改都会使签名变化：
+*
+* 函数返回值：
+*
+* 成功：返回签名字符串，需要用g_free释放；
+* 失败：返回 NULL。*/
+static char *registry_signature(const char *dir_path)
+{
+    DIR *pdir = NULL;
+    struct dirent *pdirent;
+    GPtrArray *names = NULL;
+    GString *signature = NULL;
+    char buff[PATH_MAX] = {0};
+    struct stat sbuf;
+
+    pdir = opendir(dir_path);
+    if (!pdir)
+        return NULL;
+
+    names = g_ptr_array_new_with_free_func(g_free);
+    for (pdirent = readdir(pdir); pdirent != NULL; pdirent = readdir(pdir)) {
+        if (str_endsWith(pdirent->d_name, ".json"))
+            g_ptr_array_add(names, g_strdup(pdirent->d_name));
+    }
+    closedir(pdir);
+    g_ptr_array_sort(names, compare_strings);
+
+    signature = g_string_new(NULL);
+    for (unsigned i = 0; i < names->len; i++) {
+        const char *name = g_ptr_array_index(names, i);
+
+        snprintf(buff, PATH_MAX, "%s/%s", dir_path, name);
+        if (lstat(buff, &sbuf) < 0 || !S_ISREG(sbuf.st_mode))
+            continue;
+        g_string_append_printf(signature, "%s:%lld:%lld.%09ld;", name, (long long)sbuf.st_size,
+                               (long long)sbuf.st_mtim.tv_sec, sbuf.st_mtim.tv_nsec);
+    }
+    g_ptr_array_unref(names);
+
+    return g_string_free(signature, FALSE);
+}
+
+/*从REGISTRY_CACHE_PATH加载上次解析好的模块配置，避免每次启动都重新解析所有json文件：
+*
+* dir_path：json配置文件目录；
+* signature：当前目录的签名，与缓存中的不一致时缓存无效。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 缓存不存在或已失效：返回 ERR_RET。*/
+static int load_registry_cache(const char *dir_path, const char *signature)
+{
+    GKeyFile *keyfile = NULL;
+    gchar **groups = NULL;
+    gchar *value = NULL;
+    int ret = -1;
+
+    keyfile = g_key_file_new();
+    if (!g_key_file_load_from_file(keyfile, REGISTRY_CACHE_PATH, G_KEY_FILE_NONE, NULL))
+        goto out;
+
+    if (g_key_file_get_integer(keyfile, REGISTRY_CACHE_GROUP, "version", NULL) != REGISTRY_CACHE_VERSION)
+        goto out;
+
+    value = g_key_file_get_string(keyfile, REGISTRY_CACHE_GROUP, "path", NULL);
+    if (g_strcmp0(value, dir_path) != 0)
+        goto out;
+    g_free(value);
+
+    value = g_key_file_get_string(keyfile, REGISTRY_CACHE_GROUP, "signature", NULL);
+    if (g_strcmp0(value, signature) != 0)
+        goto out;
+
+    g_module_cfgs = new_module_cfgs_table();
+    g_profile_cfgs = new_module_cfgs_table();
+
+    groups = g_key_file_get_groups(keyfile, NULL);
+    for (int i = 0; groups && groups[i]; i++) {
+        gchar **sub_names = NULL, **sub_execs = NULL;
+        gsize n_names = 0, n_execs = 0;
+        gchar *type = NULL;
+        module_cfg *mdle_cfg = NULL;
+
+        if (g_str_has_prefix(groups[i], REGISTRY_PROFILE_GROUP_PREFIX)) {
+            if (load_cached_profile(keyfile, groups[i]) < 0)
+                goto fail;
+            continue;
+        }
+        if (!g_str_has_prefix(groups[i], REGISTRY_MODULE_GROUP_PREFIX))
+            continue;
+
+        sub_names = g_key_file_get_string_list(keyfile, groups[i], "submodules", &n_names, NULL);
+        sub_execs = g_key_file_get_string_list(keyfile, groups[i], "execs", &n_execs, NULL);
+        if (!sub_names || !sub_execs || n_names != n_execs) {
+            g_strfreev(sub_names);
+            g_strfreev(sub_execs);
+            goto fail;
+        }
+
+        mdle_cfg = (module_cfg*)malloc(sizeof(module_cfg));
+        assert(mdle_cfg);
+        memset(mdle_cfg, 0, sizeof(module_cfg));
+        mdle_cfg->name = strdup(groups[i] + strlen(REGISTRY_MODULE_GROUP_PREFIX));
+        type = g_key_file_get_string(keyfile, groups[i], "type", NULL);
+        if (type)
+            mdle_cfg->type = strdup(type);
+        g_free(type);
+        mdle_cfg->reboot = g_key_file_get_integer(keyfile, groups[i], "reboot", NULL);
+
+        mdle_cfg->sub_modules = malloc(sizeof(sub_module_cfg*)*(n_names+1));
+        assert(mdle_cfg->sub_modules);
+        memset(mdle_cfg->sub_modules,0,sizeof(sub_module_cfg*)*(n_names+1));
+        mdle_cfg->sub_modules_num = n_names;
+        for (gsize j = 0; j < n_names; j++) {
+            mdle_cfg->sub_modules[j] = malloc(sizeof(sub_module_cfg));
+            assert(mdle_cfg->sub_modules[j]);
+            mdle_cfg->sub_modules[j]->name = strdup(sub_names[j]);
+            mdle_cfg->sub_modules[j]->shell_cmd = strdup(sub_execs[j]);
+        }
+        g_strfreev(sub_names);
+        g_strfreev(sub_execs);
+
+        g_hash_table_insert (g_module_cfgs, g_strdup (mdle_cfg->name), mdle_cfg);
+    }
+    ret = OK;
+    goto out;
+fail:
+    destroy_module_cfgs();
+out:
+    g_strfreev(groups);
+    g_free(value);
+    g_key_file_free(keyfile);
+    return ret;
+}
+
+//把g_module_cfgs保存到REGISTRY_CACHE_PATH，失败不影响正常使用（例如普通用户没有写权限）
+static void save_registry_cache(const char *dir_path, const char *signature)
+{
+    GKeyFile *keyfile = NULL;
+    GHashTableIter iter;
+    module_cfg *mdle_cfg = NULL;
+
+    if (geteuid() != 0)
+        return;
+
+    keyfile = g_key_file_new();
+    g_key_file_set_integer(keyfile, REGISTRY_CACHE_GROUP, "version", REGISTRY_CACHE_VERSION);
+    g_key_file_set_string(keyfile, REGISTRY_CACHE_GROUP, "path", dir_path);
+    g_key_file_set_string(keyfile, REGISTRY_CACHE_GROUP, "signature", signature);
+
+    g_hash_table_iter_init (&iter, g_module_cfgs);
+    while (g_hash_table_iter_next (&iter, NULL, (void**)&mdle_cfg)) {
+        char group[PATH_MAX] = {0};
+        const gchar **sub_names = NULL, **sub_execs = NULL;
+
+        snprintf(group, PATH_MAX, REGISTRY_MODULE_GROUP_PREFIX "%s", mdle_cfg->name);
+        if (mdle_cfg->type)
+            g_key_file_set_string(keyfile, group, "type", mdle_cfg->type);
+        g_key_file_set_integer(keyfile, group, "reboot", mdle_cfg->reboot);
+
+        sub_names = g_new0(const gchar *, mdle_cfg->sub_modules_num + 1);
+        sub_execs = g_new0(const gchar *, mdle_cfg->sub_modules_num + 1);
+        for (int i = 0; mdle_cfg->sub_modules[i]; i++) {
+            sub_names[i] = mdle_cfg->sub_modules[i]->name;
+            sub_execs[i] = mdle_cfg->sub_modules[i]->shell_cmd;
+        }
+        g_key_file_set_string_list(keyfile, group, "submodules", sub_names, mdle_cfg->sub_modules_num);
+        g_key_file_set_string_list(keyfile, group, "execs", sub_execs, mdle_cfg->sub_modules_num);
+        g_free(sub_names);
+        g_free(sub_execs);
+    }
+
+    g_hash_table_iter_init (&iter, g_profile_cfgs);
+    while (g_hash_table_iter_next (&iter, NULL, (void**)&mdle_cfg)) {
+        char group[PATH_MAX] = {0};
+        gsize n = 0;
+
+        while (mdle_cfg->profile_modules[n])
+            n++;
+        snprintf(group, PATH_MAX, REGISTRY_PROFILE_GROUP_PREFIX "%s", mdle_cfg->name);
+        g_key_file_set_string_list(keyfile, group, "modules", (const gchar * const *)mdle_cfg->profile_modules, n);
+        g_key_file_set_string_list(keyfile, group, "levels", (const gchar * const *)mdle_cfg->profile_levels, n);
+    }
+
+    (void) g_key_file_save_to_file(keyfile, REGISTRY_CACHE_PATH, NULL);
+    g_key_file_free(keyfile);
 }
 
-/*加载json配置文件目录下的json配置文件：
+/*逐个解析json配置文件目录下的json配置文件：
 *
 * dir_path：json配置文件目录；
-* module_cfgs：所有的模块的配置数组，用于保存解析好的配置文件；
-* valid_module_cfgs_count：用于保存解析好的配置文件的数目。
 * 函数返回值：
 *
 * 成功：返回 0；
 * 失败：返回 ERR_RET。*/
-int init_module_cfgs(const char *dir_path)
+static int parse_module_cfgs_dir(const char *dir_path)
 {
     DIR  *pdir = NULL;
     module_cfg *mdle_cfg = NULL;
@@ -57,19 +345,14 @@ int init_module_cfgs(const char *dir_path)
     int ret = 0;
     char buff[PATH_MAX] = {0};
 
-    if (g_module_cfgs)
-        return OK;
-
     pdir=opendir(dir_path);
     if(pdir==NULL)
     {
         fprintf(stderr, N_("Error: Failed to open dir %s, err: %m\n"), dir_path);
         return ERROR;
     }
-    g_module_cfgs = g_hash_table_new_full (g_str_hash,
-                                            g_str_equal,
-                                            g_free,
-                                            free_module_cfg);
+    g_module_cfgs = new_module_cfgs_table();
+    g_profile_cfgs = new_module_cfgs_table();
 
     for(pdirent= readdir(pdir); pdirent!=NULL; pdirent=readdir(pdir))
     {
@@ -96,22 +379,87 @@ int init_module_cfgs(const char *dir_path)
                 fprintf(stderr,N_("Error: cann't paste %s\n"),pdirent->d_name);
                 continue;
             }
-            g_hash_table_insert (g_module_cfgs, g_strdup (mdle_cfg->name), mdle_cfg);
+            //配置方案单独保存，不出现在模块列表中
+            g_hash_table_insert (mdle_cfg->profile ? g_profile_cfgs : g_module_cfgs,
+                                 g_strdup (mdle_cfg->name), mdle_cfg);
         }
     }
     closedir(pdir);
     return OK;
 ERRRET:
-    g_hash_table_destroy(g_module_cfgs);
-    g_module_cfgs = NULL;
+    destroy_module_cfgs();
     closedir(pdir);
     return ret;
 }
 
+/*加载json配置文件目录下的json配置文件，目录没有变化时直接使用上次保存的缓存：
+*
+* dir_path：json配置文件目录；
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int init_module_cfgs(const char *dir_path)
+{
+    char *signature = NULL;
+    uint64_t start_usec;
+    int ret;
+
+    if (g_module_cfgs)
+        return OK;
+
+    start_usec = metrics_now_usec();
+    signature = registry_signature(dir_path);
+    if (signature && load_registry_cache(dir_path, signature) == OK) {
+        metrics_observe_since(METRICS_REGISTRY, REGISTRY_CACHE_PATH, start_usec, false);
+        g_free(signature);
+        return OK;
+    }
+
+    ret = parse_module_cfgs_dir(dir_path);
+    if (ret == OK && signature)
+        save_registry_cache(dir_path, signature);
+    metrics_observe_since(METRICS_REGISTRY, dir_path, start_usec, ret != OK);
+    g_free(signature);
+    return ret;
+}
+
+/*重新加载json配置文件目录，用于目录内容变化后更新模块列表。
+* 调用者需要保证此时没有其它线程在访问模块配置：
+*
+* dir_path：json配置文件目录；
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET，原来的模块配置保持不变。*/
+int reload_module_cfgs(const char *dir_path)
+{
+    GHashTable *old = g_module_cfgs, *old_profiles = g_profile_cfgs;
+    int ret;
+
+    g_module_cfgs = NULL;
+    g_profile_cfgs = NULL;
+    ret = init_module_cfgs(dir_path);
+    if (ret < 0) {
+        g_module_cfgs = old;
+        g_profile_cfgs = old_profiles;
+        return ret;
+    }
+
+    if (old)
+        g_hash_table_destroy(old);
+    if (old_profiles)
+        g_hash_table_destroy(old_profiles);
+    return OK;
+}
+
 void deinit_module_cfgs() {
-    if (g_module_cfgs) {
-        g_hash_table_destroy(g_module_cfgs);
-        g_module_cfgs = NULL;
+    destroy_module_cfgs();
+    if (g_module_levels) {
+        g_hash_table_destroy(g_module_levels);
+        g_module_levels = NULL;
+        memset(&g_levels_stat, 0, sizeof(g_levels_stat));
+        g_debug_on_count = 0;
     }
 }
 
@@ -136,6 +484,18 @@ char **get_module_names() {
     return result;
 }
 
+char **get_profile_names() {
+    if (!g_profile_cfgs) {
+        return NULL;
+    }
+
+    GPtrArray *names = g_ptr_array_new();
+
+    g_hash_table_foreach(g_profile_cfgs, collect_module_names, names);
+    g_ptr_array_add(names, NULL);
+    return (char **)g_ptr_array_free(names, FALSE);
+}
+
 static int create_dir(const char *path) {
     assert(path);
     char* dir = NULL, *p = NULL;
@@ -229,48 +589,100 @@ static int set_journal_log (bool flag) {
         return ret;
 }
 
-/*用于打印指定模块类型的日志开关状态：
-*
-* module_type：模块类型；
-* debug_on：bool指针，作为返回值；
-*
-* 函数返回值：
-* 成功：返回 0；
-* 失败：返回 ERR_RET。*/
-int config_module_get_debug_level_by_type(const char *module_type, char **level) {
-    FILE *fp;
-    char *filename = MODULES_DEBUG_LEVELS_PATH;
-    char *line = NULL, *pos = NULL, *comment_pos = NULL, *trimmed_line = NULL;
-    char key[LINE_BUF_SIZE],value[LINE_BUF_SIZE];//key和value都默认为字符串
-    int ret = 0;
-    size_t len;
-    size_t read;
+static bool is_debug_level_on(const char *level) {
+    return g_strcmp0(level, "debug") == 0 || g_strcmp0(level, "on") == 0;
+}
 
-    assert(level);
-    *level = NULL;
+static uint64_t timespec_to_usec(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000ULL + (uint64_t)ts->tv_nsec / 1000ULL;
+}
 
-    if (access(filename, F_OK) == -1) {
-        //MODULES_DEBUG_LEVELS_PATH不存在
-        // 认为所有模块的debug状态是关闭的
-        *level = strdup("off");
-        return OK;
+static uint64_t now_realtime_usec() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return timespec_to_usec(&ts);
+}
+
+/*代数的起点。CLOCK_BOOTTIME在一次开机内不会回退，每次递增代数都要有一次文件的变化，
+* 远慢于每微秒一次，所以服务重启后的起点总是大于之前发出的代数*/
+static uint64_t generation_seed_usec() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return timespec_to_usec(&ts) + 1;
+}
+
+static bool levels_stat_changed(const struct stat *st) {
+    return st->st_ino != g_levels_stat.st_ino ||
+           st->st_size != g_levels_stat.st_size ||
+           st->st_mtim.tv_sec != g_levels_stat.st_mtim.tv_sec ||
+           st->st_mtim.tv_nsec != g_levels_stat.st_mtim.tv_nsec;
+}
+
+/*更新缓存中的一项，值有变化时递增代数：
+*
+* key：模块名；
+* value：调试等级；
+* changed_usec：变化发生的时间。*/
+static void levels_cache_set(const char *key, const char *value, uint64_t changed_usec, bool *bumped) {
+    module_level *p_level = g_hash_table_lookup(g_module_levels, key);
+
+    if (p_level && g_strcmp0(p_level->level, value) == 0)
+        return;
+
+    if (!*bumped) {
+        g_levels_generation++;
+        *bumped = true;
+    }
+    if (!p_level) {
+        p_level = (module_level *)malloc(sizeof(module_level));
+        assert(p_level);
+        memset(p_level, 0, sizeof(module_level));
+        g_hash_table_insert(g_module_levels, g_strdup(key), p_level);
     }
+    if (is_debug_level_on(p_level->level))
+        g_debug_on_count--;
+    if (is_debug_level_on(value))
+        g_debug_on_count++;
+
+    free(p_level->level);
+    p_level->level = strdup(value);
+    p_level->generation = g_levels_generation;
+    p_level->last_changed = changed_usec;
+}
 
-    fp = fopen(filename, "r");
-    if (fp == NULL) {
-        ret = ERROR;
-        fprintf(stderr, N_("Error: %s,failed :%m\n"), filename);
-        return ret;
+//把缓存中的一项标记为已删除，和值的变化一样递增代数
+static void levels_cache_remove(module_level *p_level, uint64_t changed_usec, bool *bumped) {
+    if (!p_level->level)
+        return;
+
+    if (!*bumped) {
+        g_levels_generation++;
+        *bumped = true;
     }
+    if (is_debug_level_on(p_level->level))
+        g_debug_on_count--;
+
+    free(p_level->level);
+    p_level->level = NULL;
+    p_level->generation = g_levels_generation;
+    p_level->last_changed = changed_usec;
+}
+
+static int parse_debug_levels_file(FILE *fp, GHashTable *table) {
+    char *line = NULL, *pos = NULL, *comment_pos = NULL, *trimmed_line = NULL, *saveptr = NULL;
+    char key[LINE_BUF_SIZE],value[LINE_BUF_SIZE];//key和value都默认为字符串
+    size_t len = 0;
 
-    while ((read = getline(&line, &len, fp)) != -1) {
+    while (getline(&line, &len, fp) != -1) {
         //忽略注释，包括键值对后的注释
         comment_pos = strchr(line, '#');
         if (comment_pos != NULL)
             *comment_pos = '\0'; // 截断注释部分
 
         // 去除行首和行尾的空格
-        trimmed_line = strtok(line, " \t\r\n");
+        trimmed_line = strtok_r(line, " \t\r\n", &saveptr);
         if (trimmed_line == NULL)
             continue; // 跳过空行
 
@@ -280,41 +692,51 @@ int config_module_get_debug_level_by_type(const char *module_type, char **level)
         if (pos == NULL)//该行不是一个有效的配置
             continue;
         //获取并处理key和value，如果要处理其他的配置请在这里修改
-        if (sscanf(trimmed_line, "%255[^=]=%255[^\n]", key, value) == 2)
-        {
-            if(strncmp(module_type, key, 255) == 0){
-                *level = strdup(value);
-                break;
-            }
-            comment_pos = NULL;
-            trimmed_line = NULL;
-            pos = NULL;
+        if (sscanf(trimmed_line, "%255[^=]=%255[^\n]", key, value) == 2) {
+            //与原来逐行查找的行为一致，重复的key以第一次出现的为准
+            if (!g_hash_table_contains(table, key))
+                g_hash_table_insert(table, g_strdup(key), g_strdup(value));
         }
     }
-    fclose(fp);
     if (line)//getline获取的line要free,因为filename文件可能是空的，所以这里要加个判断
         free(line);
-    if (*level == NULL) return ERROR;
     return OK;
 }
 
-int config_module_check_debug_level_has_on(bool *level) {
+/*一次读取MODULES_DEBUG_LEVELS_PATH并刷新内存缓存，文件未变化时不会重新读取：
+*
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+static int load_debug_levels() {
+    const char *filename = MODULES_DEBUG_LEVELS_PATH;
+    struct stat st = {0};
+    GHashTableIter iter;
+    const char *key = NULL, *value = NULL;
+    module_level *p_level = NULL;
+    GHashTable *table = NULL;
+    bool bumped = false;
     FILE *fp;
-    char *filename = MODULES_DEBUG_LEVELS_PATH;
-    char *line = NULL, *pos = NULL, *comment_pos = NULL, *trimmed_line = NULL;
-    char key[LINE_BUF_SIZE],value[LINE_BUF_SIZE];//key和value都默认为字符串
-    int ret = 0;
-    size_t len;
-    size_t read;
+    int ret = OK;
 
-    assert(level);
-    *level = false;
+    if (!g_module_levels) {
+        g_module_levels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_module_level);
+        g_levels_generation = generation_seed_usec();
+    }
 
-    if (access(filename, F_OK) == -1) {
-        //MODULES_DEBUG_LEVELS_PATH不存在
-        // 认为所有模块的debug状态是关闭的
+    if (stat(filename, &st) < 0) {
+        uint64_t now = now_realtime_usec();
+
+        //MODULES_DEBUG_LEVELS_PATH不存在，所有项都标记为已删除
+        memset(&g_levels_stat, 0, sizeof(g_levels_stat));
+        g_hash_table_iter_init(&iter, g_module_levels);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&p_level))
+            levels_cache_remove(p_level, now, &bumped);
         return OK;
     }
+    if (g_levels_stat.st_ino != 0 && !levels_stat_changed(&st))
+        return OK;
 
     fp = fopen(filename, "r");
     if (fp == NULL) {
@@ -322,70 +744,240 @@ int config_module_check_debug_level_has_on(bool *level) {
         fprintf(stderr, N_("Error: %s,failed :%m\n"), filename);
         return ret;
     }
+    table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    parse_debug_levels_file(fp, table);
+    fclose(fp);
 
-    while ((read = getline(&line, &len, fp)) != -1) {
-        //忽略注释，包括键值对后的注释
-        comment_pos = strchr(line, '#');
-        if (comment_pos != NULL)
-            *comment_pos = '\0'; // 截断注释部分
-
-        // 去除行首和行尾的空格
-        trimmed_line = strtok(line, " \t\r\n");
-        if (trimmed_line == NULL)
-            continue; // 跳过空行
-
-        //通过判断是否有"="来判断是不是一个有效的配置，如果之后配置文件
-        //有其他格式请修改这里的代码
-        pos = strchr(trimmed_line, '=');
-        if (pos == NULL)//该行不是一个有效的配置
-            continue;
-        //获取并处理key和value，如果要处理其他的配置请在这里修改
-        if (sscanf(trimmed_line, "%255[^=]=%255[^\n]", key, value) == 2)
-        {
-            if (strcmp(value,"debug") == 0 || strcmp(value,"on") == 0) {
-                *level = true;
-                break;
-            }
-            comment_pos = NULL;
-            trimmed_line = NULL;
-            pos = NULL;
-        }
+    //文件中已经不存在的项标记为已删除
+    g_hash_table_iter_init(&iter, g_module_levels);
+    while (g_hash_table_iter_next(&iter, (void **)&key, (void **)&p_level)) {
+        if (!g_hash_table_contains(table, key))
+            levels_cache_remove(p_level, timespec_to_usec(&st.st_mtim), &bumped);
     }
-    fclose(fp);
-    if (line)//getline获取的line要free,因为filename文件可能是空的，所以这里要加个判断
-        free(line);
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, (void **)&key, (void **)&value))
+        levels_cache_set(key, value, timespec_to_usec(&st.st_mtim), &bumped);
 
+    g_hash_table_destroy(table);
+    g_levels_stat = st;
     return OK;
 }
 
-// 判断一行是否读取完整
-static int newline_terminated(char *buf, size_t buflen)
-{
-    size_t len = strlen(buf);
-    if (len == buflen - 1 && buf[len - 1] != '\r' &&
-        buf[len - 1] != '\n')
-        return 0;
-    return 1;
-}
+/*用于打印指定模块类型的日志开关状态：
+*
+* module_type：模块类型；
+* debug_on：bool指针，作为返回值；
+*
+* 函数返回值：
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int config_module_get_debug_level_by_type(const char *module_type, char **level) {
+    module_level *p_level = NULL;
+    int ret = 0;
 
-// 去除字符数组（字符串）两端的空格和制表符，并返回新字符串的起始位置
-static char *trim_space(char *buf)
-{
-    char *pos = buf;
-    int len = strlen(buf);
-    if (len == 0)
-        return pos;
+    assert(level);
+    *level = NULL;
 
-    --len;
-    while (len && (buf[len] == ' ' || buf[len] == '\t'))
-    {
-        buf[len] = '\0';
-        --len;
+    if (access(MODULES_DEBUG_LEVELS_PATH, F_OK) == -1) {
+        //MODULES_DEBUG_LEVELS_PATH不存在
+        // 认为所有模块的debug状态是关闭的
+        *level = strdup("off");
+        return OK;
     }
-    while (*pos == ' ' || *pos == '\t')
-        ++pos;
-    return pos;
-}
+
+    G_LOCK(debug_levels);
+    ret = load_debug_levels();
+    if (ret == OK) {
+        p_level = g_hash_table_lookup(g_module_levels, module_type);
+        if (p_level && p_level->level)
+            *level = strdup(p_level->level);
+    }
+    G_UNLOCK(debug_levels);
+    if (ret != OK)
+        return ret;
+    if (*level == NULL) return ERROR;
+    return OK;
+}
+
+/*获取单个模块的状态：
+*
+* name：模块名；
+* cb：获取到状态后调用的回调函数，回调返回前状态中的字符串都是有效的；
+* userdata：传给回调函数的参数。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int config_module_get_state(const char *name, module_state_cb cb, void *userdata) {
+    module_cfg *mdle_cfg = NULL;
+    module_level *p_level = NULL;
+    module_state state;
+    int ret = OK;
+
+    assert(name && cb);
+    assert(g_module_cfgs);
+
+    mdle_cfg = g_hash_table_lookup(g_module_cfgs, name);
+    if (mdle_cfg == NULL)
+        return -ENOENT;
+
+    G_LOCK(debug_levels);
+    ret = load_debug_levels();
+    if (ret == OK) {
+        p_level = g_hash_table_lookup(g_module_levels, mdle_cfg->name);
+
+        memset(&state, 0, sizeof(state));
+        state.name = mdle_cfg->name;
+        state.type = mdle_cfg->type;
+        state.reboot = mdle_cfg->reboot;
+        if (p_level) {
+            state.level = p_level->level;
+            state.generation = p_level->generation;
+            state.last_changed = p_level->last_changed;
+        }
+        cb(&state, userdata);
+    }
+    G_UNLOCK(debug_levels);
+    return ret;
+}
+
+/*返回配置中保存的模块名，模块不存在时返回NULL。
+* 返回的字符串在deinit_module_cfgs()之前一直有效。*/
+const char *config_module_lookup_name(const char *name) {
+    module_cfg *mdle_cfg = NULL;
+
+    if (!g_module_cfgs || !name)
+        return NULL;
+
+    mdle_cfg = g_hash_table_lookup(g_module_cfgs, name);
+    return mdle_cfg ? mdle_cfg->name : NULL;
+}
+
+/*一次遍历获取所有模块的状态：
+*
+* since：只返回代数大于since的模块，包括调试等级被删除的模块，为0或大于当前代数
+*        （来自上一次开机）时返回所有模块；
+* cb：每个模块调用一次的回调函数；
+* userdata：传给回调函数的参数；
+* generation：返回当前的代数，可为NULL。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int config_modules_foreach_state(uint64_t since, module_state_cb cb, void *userdata, uint64_t *generation) {
+    GHashTableIter iter;
+    module_cfg *mdle_cfg = NULL;
+    module_level *p_level = NULL;
+    module_state state;
+    int ret = OK;
+
+    assert(cb);
+    assert(g_module_cfgs);
+
+    G_LOCK(debug_levels);
+    ret = load_debug_levels();
+    if (ret != OK)
+        goto out;
+    if (generation)
+        *generation = g_levels_generation;
+    if (since > g_levels_generation)
+        since = 0;
+    if (since > 0 && since == g_levels_generation)
+        goto out;
+
+    g_hash_table_iter_init(&iter, g_module_cfgs);
+    while (g_hash_table_iter_next(&iter, NULL, (void **)&mdle_cfg)) {
+        p_level = g_hash_table_lookup(g_module_levels, mdle_cfg->name);
+        if (since > 0 && (!p_level || p_level->generation <= since))
+            continue;
+
+        memset(&state, 0, sizeof(state));
+        state.name = mdle_cfg->name;
+        state.type = mdle_cfg->type;
+        state.reboot = mdle_cfg->reboot;
+        if (p_level) {
+            state.level = p_level->level;
+            state.generation = p_level->generation;
+            state.last_changed = p_level->last_changed;
+        }
+        cb(&state, userdata);
+    }
+out:
+    G_UNLOCK(debug_levels);
+    return ret;
+}
+
+/*获取调试等级的当前代数，不需要加载模块配置：
+*
+* generation：返回当前的代数。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int config_modules_get_generation(uint64_t *generation) {
+    int ret;
+
+    assert(generation);
+
+    G_LOCK(debug_levels);
+    ret = load_debug_levels();
+    if (ret == OK)
+        *generation = g_levels_generation;
+    G_UNLOCK(debug_levels);
+    return ret;
+}
+
+int config_module_check_debug_level_has_on(bool *level) {
+    int ret = OK;
+
+    assert(level);
+    *level = false;
+
+    G_LOCK(debug_levels);
+    ret = load_debug_levels();
+    if (ret == OK)
+        *level = g_debug_on_count > 0;
+    G_UNLOCK(debug_levels);
+    return ret;
+}
+
+/*是否有任意一个模块（包括all和coredump）处于debug或on的状态，
+* 只检查缓存中维护的计数，文件未变化时不需要读取文件。*/
+bool config_module_any_debug_enabled() {
+    bool level = false;
+
+    config_module_check_debug_level_has_on(&level);
+    return level;
+}
+
+// 判断一行是否读取完整
+static int newline_terminated(char *buf, size_t buflen)
+{
+    size_t len = strlen(buf);
+    if (len == buflen - 1 && buf[len - 1] != '\r' &&
+        buf[len - 1] != '\n')
+        return 0;
+    return 1;
+}
+
+// 去除字符数组（字符串）两端的空格和制表符，并返回新字符串的起始位置
+static char *trim_space(char *buf)
+{
+    char *pos = buf;
+    int len = strlen(buf);
+    if (len == 0)
+        return pos;
+
+    --len;
+    while (len && (buf[len] == ' ' || buf[len] == '\t'))
+    {
+        buf[len] = '\0';
+        --len;
+    }
+    while (*pos == ' ' || *pos == '\t')
+        ++pos;
+    return pos;
+}
 
 static int compare_config_item(const char *pos, config_item *items, int items_num)
 {
@@ -563,8 +1155,8 @@ fail_rw:
     return ret;
 }
 
-/*存储 模块类型为type的日志打开状态信息*/
-static int modify_debug_levels(const char *type, const char *level)
+/*一次写入多个模块的日志打开状态信息，items中的key_name不能重复，调用者需要持有debug_levels锁*/
+static int modify_debug_levels_items_locked(config_item *items, int items_num)
 {
     const char *conf_file = MODULES_DEBUG_LEVELS_PATH;
     if (access(conf_file, F_OK) == -1)
@@ -582,17 +1174,49 @@ static int modify_debug_levels(const char *type, const char *level)
         }
         fclose(fp);
     }
-    config_item items[1] = {
-        {type, level, CONFIG_OP_ADD},
-    };
-    int r = mod_config(conf_file, items, 1);
+    struct stat st = {0};
+    bool cached = g_module_levels && g_levels_stat.st_ino != 0 &&
+                  stat(conf_file, &st) == 0 && !levels_stat_changed(&st);
+    int r = mod_config(conf_file, items, items_num);
     if(r < 0)
         return r;
+
+    //缓存与文件一致时直接更新缓存，避免下次查询时重新读取整个文件
+    if (cached && stat(conf_file, &st) == 0) {
+        uint64_t now = now_realtime_usec();
+        bool bumped = false;
+        //同一次提交中的所有变化属于同一代
+        for (int i = 0; i < items_num; i++)
+            levels_cache_set(items[i].key_name, items[i].value, now, &bumped);
+        g_levels_stat = st;
+    } else {
+        load_debug_levels();
+    }
     return 0;
 }
 
+/*存储 模块类型为type的日志打开状态信息，调用者需要持有debug_levels锁*/
+static int modify_debug_levels_locked(const char *type, const char *level)
+{
+    config_item items[1] = {
+        {type, level, CONFIG_OP_ADD},
+    };
+
+    return modify_debug_levels_items_locked(items, 1);
+}
+
+static int modify_debug_levels(const char *type, const char *level)
+{
+    int r;
+
+    G_LOCK(debug_levels);
+    r = modify_debug_levels_locked(type, level);
+    G_UNLOCK(debug_levels);
+    return r;
+}
+
 //通过检查哈希算法值来判断要执行的脚本文件是否被允许执行
-static bool is_shell_cmd_allowed(const char* file_path)
+static bool check_shell_cmd_digest(const char* file_path)
 {
     unsigned char sha256Digest[SHA256_DIGEST_LENGTH];
     struct stat fileInfo;
@@ -623,7 +1247,37 @@ static bool is_shell_cmd_allowed(const char* file_path)
     return false;
 }
 
-int exec_debug_shell_cmd_internal(const char *filename,const char *level) {
+static bool is_shell_cmd_allowed(const char* file_path)
+{
+    uint64_t start_usec = metrics_now_usec();
+    bool allowed = check_shell_cmd_digest(file_path);
+
+    metrics_observe_since(METRICS_DIGEST, file_path, start_usec, !allowed);
+    return allowed;
+}
+
+//执行脚本并记录耗时，label为脚本文件名
+static int run_shell_cmd(const char *real_path, const char *args)
+{
+    uint64_t start_usec = metrics_now_usec();
+    int r = start_process(real_path, args, NULL);
+    int saved_errno = errno;
+
+    metrics_observe_since(METRICS_SCRIPT, Basename(real_path), start_usec, r != 0);
+    errno = saved_errno;
+    return r;
+}
+
+static bool is_module_shell_cmd_allowed(const char *filename)
+{
+    char real_path[PATH_MAX] = {0};
+
+    snprintf(real_path,PATH_MAX,"%s/%s",CONFIG_SHELL_PATH,filename);
+    return is_shell_cmd_allowed(real_path);
+}
+
+//verified为true时调用者已经检查过脚本的sha256值
+static int exec_debug_shell_cmd(const char *filename,const char *level,bool verified) {
     int r = 0;
     char real_level[PATH_MAX] = {0};
     char real_path[PATH_MAX] = {0};
@@ -632,14 +1286,14 @@ int exec_debug_shell_cmd_internal(const char *filename,const char *level) {
     snprintf(real_path,PATH_MAX,"%s/%s",CONFIG_SHELL_PATH,filename);
     snprintf(real_level, PATH_MAX, "debug=%s", level);
 
-    if(!is_shell_cmd_allowed(real_path))
+    if(!verified && !is_shell_cmd_allowed(real_path))
     {
         r = ERROR;
         fprintf(stderr, N_("Error: The sha256 digest of the shell file does not match, the shell file may be rewritten.\n"));
         return r;
     }
 
-    r = start_process(real_path, real_level,NULL);
+    r = run_shell_cmd(real_path, real_level);
     if(r != 0)
     {
         fprintf(stderr, N_("Error: Failed to exec %s %s ret=%d errno=%d\n"), real_path,real_level,r,errno);
@@ -648,6 +1302,10 @@ int exec_debug_shell_cmd_internal(const char *filename,const char *level) {
     return r;
 }
 
+int exec_debug_shell_cmd_internal(const char *filename,const char *level) {
+    return exec_debug_shell_cmd(filename, level, false);
+}
+
 // Define check_package_installed function to check if a package is installed
 // 0 is not installed, 1 is installed
 int check_package_installed(const char *package_name) {
@@ -671,12 +1329,13 @@ int check_package_installed(const char *package_name) {
     free(output);
     return result;
 }
-static int config_modules_set_debug_level_internal(const module_cfg *mdle_cfg,const char *level) {
+//依次执行模块的所有脚本，没有安装的子模块的脚本失败时忽略
+static int run_module_shell_cmds(const module_cfg *mdle_cfg,const char *level,bool verified) {
     assert(mdle_cfg&&level);
 
     int ret = OK,r = OK,i = 0;
     for (i=0;mdle_cfg->sub_modules[i];i++) {
-        r = exec_debug_shell_cmd_internal(mdle_cfg->sub_modules[i]->shell_cmd,level);
+        r = exec_debug_shell_cmd(mdle_cfg->sub_modules[i]->shell_cmd,level,verified);
         if (r != OK) {
             fprintf(stderr,"exec file %s level %s failed\n",mdle_cfg->sub_modules[i]->shell_cmd,level);
             fprintf(stderr, N_("Error: Failed to configure %s.\n"), mdle_cfg->name);
@@ -687,6 +1346,12 @@ static int config_modules_set_debug_level_internal(const module_cfg *mdle_cfg,co
         }
         if (ret == OK) ret = r;
     }
+    return ret;
+}
+
+static int config_modules_set_debug_level_internal(const module_cfg *mdle_cfg,const char *level) {
+    int ret = run_module_shell_cmds(mdle_cfg, level, false);
+
     if (ret == OK)
         modify_debug_levels(mdle_cfg->name,level);
     fprintf(stdout,"set %s debug level to %s %s\n",mdle_cfg->name,level,(ret==OK)?"ok":"fail");
@@ -864,8 +1529,151 @@ int config_module_get_property_reboot(const char *module_name,int *reboot) {
     return OK;
 }
 
+/*检查模块的所有脚本的sha256值是否都在允许执行的列表中：
+*
+* module_name：模块名
+* 函数返回值：
+*
+* 都允许执行：返回 1；
+* 有不允许执行的脚本：返回 0；
+* 失败：返回 ERR_RET。*/
+int config_module_check_scripts(const char *module_name)
+{
+    module_cfg *mdle_cfg = NULL;
+
+    assert(module_name);
+    assert(g_module_cfgs);
+
+    mdle_cfg = g_hash_table_lookup(g_module_cfgs, module_name);
+    if (mdle_cfg == NULL) {
+        fprintf(stderr,N_("Error: cann't find module %s.\n"),module_name);
+        return ERROR;
+    }
+    for (int i = 0; mdle_cfg->sub_modules[i]; i++) {
+        if (!is_module_shell_cmd_allowed(mdle_cfg->sub_modules[i]->shell_cmd))
+            return 0;
+    }
+    return 1;
+}
+
 bool check_can_install_dbg() {
-    return is_shell_cmd_allowed(INSTALL_DBGPKG_SHELL_PATH);
+    return access(APT_GET_PATH, X_OK) == 0;
+}
+
+/*把所有模块的调试包合并为一个去重的安装计划，只读取一次索引、只调用一次apt-get
+* （调试包源和系统apt源各一次）：
+*
+* module_names：模块名数组；
+* count：模块数目；
+* results：保存每个模块的结果，可以为NULL。
+* 函数返回值：
+*
+* 全部成功：返回 0；
+* 有失败：返回 ERR_RET。*/
+static int install_dbgpkgs(char **module_names, int count, int *results)
+{
+    dbgsym_index *idx = NULL;
+    dbgsym_plan plan = {0};
+    uint64_t start_usec = metrics_now_usec();
+    int r = OK, ret = OK;
+
+    for (int i = 0; i < count; i++) {
+        fprintf(stdout, "Start to install dbgsym packages for %s\n", module_names[i]);
+        if (results)
+            results[i] = OK;
+    }
+
+    idx = dbgsym_index_load();
+    if (!idx) {
+        ret = ERROR;
+        for (int i = 0; results && i < count; i++)
+            results[i] = ret;
+        goto out;
+    }
+
+    for (int i = 0; i < count; i++) {
+        r = dbgsym_resolve(idx, module_names[i], &plan);
+        if (r < 0) {
+            ret = r;
+            if (results)
+                results[i] = r;
+            fprintf(stderr, N_("Error: Failed to install dbg packages for %s\n"), module_names[i]);
+        }
+    }
+
+    r = dbgsym_plan_install(&plan);
+    if (r < 0) {
+        ret = r;
+        for (int i = 0; i < count; i++) {
+            if (results && results[i] == OK)
+                results[i] = r;
+        }
+        fprintf(stderr, N_("Error: Failed to install dbg packages for %s\n"), count == 1 ? module_names[0] : "modules");
+    }
+
+    //dpkg触发器也会更新build-id索引，这里再检查一次，返回时就能查到新安装的调试文件
+    if (plan.from_dbg_source_num + plan.from_main_source_num > 0)
+        (void) buildid_index_update(false);
+
+out:
+    metrics_observe_since(METRICS_SCRIPT, Basename(APT_GET_PATH), start_usec, ret != OK);
+    dbgsym_plan_clear(&plan);
+    dbgsym_index_free(idx);
+    return ret;
+}
+
+/*为多个模块安装调试包，最多更新一次调试包源的软件包列表，所有调试包在一次apt事务中安装：
+*
+* module_names：模块名数组；
+* count：模块数目；
+* results：保存每个模块的结果，可以为NULL。
+* 函数返回值：
+*
+* 全部成功：返回 0；
+* 有失败：返回 ERR_RET。*/
+int config_modules_install_dbgpkgs_list(char **module_names, int count, int *results)
+{
+    int r;
+
+    assert(module_names || count == 0);
+
+    if (count == 0)
+        return OK;
+
+    if(!check_can_install_dbg())
+    {
+        r = ERROR;
+        fprintf(stderr, N_("Error: %s: %m\n"), APT_GET_PATH);
+        for (int i = 0; results && i < count; i++)
+            results[i] = r;
+        return r;
+    }
+
+    //调试包源更新失败时仍然可以使用已有的列表和系统的apt源
+    (void) dbgsym_refresh_lists(false);
+
+    return install_dbgpkgs(module_names, count, results);
+}
+
+/*预先更新调试包源的软件包列表，之后安装调试包时就不用等待下载列表：
+*
+* force：忽略列表的有效期，总是向源请求更新。
+* 函数返回值：
+*
+* 成功或列表还没有过期：返回 0；
+* 失败：返回 ERR_RET。*/
+int config_refresh_dbg_sources(bool force)
+{
+    int r;
+
+    if(!check_can_install_dbg())
+    {
+        fprintf(stderr, N_("Error: %s: %m\n"), APT_GET_PATH);
+        return ERROR;
+    }
+
+    r = dbgsym_refresh_lists(force);
+    return r == DBG_LISTS_FRESH ? OK : r;
 }
 
 /*针对多个模块安装调试包：
@@ -891,37 +1699,171 @@ int config_modules_install_dbgpkgs(const char *module_names)
         return r;
     }
 
-    if(!is_shell_cmd_allowed(INSTALL_DBGPKG_SHELL_PATH))
-    {
-        r = ERROR;
-        fprintf(stdout, N_("Error: The sha256 digest of the shell file does not match, the shell file may be rewritten.\n"));
-        return r;
-    }
+    return config_modules_install_dbgpkgs_list(result, count, NULL);
+}
 
-    for (int i = 0; i < count; i++) {
-        r = config_module_install_dbgpkgs_internal(result[i]);
-        if(r < 0) return r;
-    }
+/*针对一个模块安装调试包，在内存中根据dpkg状态文件和apt的软件包列表算出
+要安装的调试包及版本，再交给apt-get一次安装：
+*
+* module_name：要安装调试包的模块名（即软件包名）
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int config_module_install_dbgpkgs_internal(const char *module_name)
+{
+    char *names[] = { (char *)module_name, NULL };
 
-    return 0;
+    return install_dbgpkgs(names, 1, NULL);
 }
 
-/*针对一个模块安装调试包：
+/*估算为多个模块安装调试包需要下载的大小和占用的空间，不安装。只使用已有的软件包列表，
+* 不更新调试包源，服务中不需要授权的调用者也会执行到这里：
 *
-* module_name：要安装调试包的模块名
+* module_names：模块名数组；
+* count：模块数目；
+* est：保存结果。
 * 函数返回值：
 *
 * 成功：返回 0；
 * 失败：返回 ERR_RET。*/
-int config_module_install_dbgpkgs_internal(const char *module_name)
+int config_modules_estimate_dbgpkgs(char **module_names, int count, dbgsym_estimate *est)
 {
-    int r = 0;
+    dbgsym_index *idx = NULL;
+    dbgsym_plan plan = {0};
+    int r = OK;
+
+    assert((module_names || count == 0) && est);
+
+    idx = dbgsym_index_load();
+    if (!idx)
+        return ERROR;
+
+    for (int i = 0; i < count && r == OK; i++)
+        r = dbgsym_resolve(idx, module_names[i], &plan);
+    if (r == OK)
+        r = dbgsym_plan_estimate(&plan, est);
+
+    dbgsym_plan_clear(&plan);
+    dbgsym_index_free(idx);
+    return r;
+}
+
+/*根据core中实际映射的ELF文件安装调试包，不需要gdb：从core的NT_FILE和build-id找到
+没有调试符号的文件，再通过dpkg文件列表找到它们所属的软件包，只安装这些软件包的调试包：
+*
+* core：core文件路径，或DEFAULT_CORE_PATH下的文件名
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int config_core_install_dbgpkgs(const char *core)
+{
+    _cleanup_free_ char *core_path = NULL;
+    core_module *modules = NULL;
+    char **paths = NULL, **owners = NULL;
+    GHashTable *seen = NULL;
+    dbgsym_index *idx = NULL;
+    dbgsym_plan plan = {0};
+    uint64_t start_usec = metrics_now_usec();
+    int n = 0, wanted = 0, r, ret = OK;
+
+    assert(core);
+
+    if(!check_can_install_dbg())
+    {
+        fprintf(stderr, N_("Error: %s: %m\n"), APT_GET_PATH);
+        return ERROR;
+    }
+
+    core_path = corefile_resolve_path(core);
+    if (!core_path)
+        return ERROR;
+
+    r = corefile_read_modules(core_path, &modules, &n);
+    if (r < 0) {
+        fprintf(stderr, N_("Error: Failed to read core file %s\n"), core_path);
+        return r;
+    }
+
+    //已经能通过build-id找到调试文件的不需要再安装
+    paths = g_new0(char *, n + 1);
+    owners = g_new0(char *, n + 1);
+    for (int i = 0; i < n; i++) {
+        _cleanup_free_ char *debug_path = NULL, *package = NULL;
 
-    r = start_process(INSTALL_DBGPKG_SHELL_PATH, module_name,NULL);
+        if (modules[i].build_id && buildid_lookup(modules[i].build_id, &debug_path, &package) == OK)
+            continue;
+        paths[wanted++] = modules[i].path;
+    }
+    fprintf(stdout, "Core %s maps %d ELF files, %d without debug symbols\n", core_path, n, wanted);
+    if (wanted == 0)
+        goto out;
+
+    r = dbgsym_find_owners(paths, wanted, owners);
+    if (r < 0) {
+        ret = r;
+        goto out;
+    }
+
+    //调试包源更新失败时仍然可以使用已有的列表和系统的apt源
+    (void) dbgsym_refresh_lists(false);
+
+    idx = dbgsym_index_load();
+    if (!idx) {
+        ret = ERROR;
+        goto out;
+    }
+
+    seen = g_hash_table_new(g_str_hash, g_str_equal);
+    for (int i = 0; i < wanted; i++) {
+        if (!owners[i]) {
+            fprintf(stderr, N_("Warning: %s does not belong to any package\n"), paths[i]);
+            continue;
+        }
+        if (!g_hash_table_add(seen, owners[i]))
+            continue;
+
+        fprintf(stdout, "Start to install dbgsym packages for %s\n", owners[i]);
+        r = dbgsym_resolve_package(idx, owners[i], &plan);
+        if (r < 0)
+            ret = r;
+    }
+
+    r = dbgsym_plan_install(&plan);
+    if (r < 0) {
+        ret = r;
+        fprintf(stderr, N_("Error: Failed to install dbg packages for %s\n"), core_path);
+    }
+
+    if (plan.from_dbg_source_num + plan.from_main_source_num > 0)
+        (void) buildid_index_update(false);
+
+out:
+    metrics_observe_since(METRICS_SCRIPT, Basename(APT_GET_PATH), start_usec, ret != OK);
+    if (seen)
+        g_hash_table_destroy(seen);
+    for (int i = 0; i < wanted; i++)
+        free(owners[i]);
+    g_free(owners);
+    g_free(paths);
+    dbgsym_plan_clear(&plan);
+    dbgsym_index_free(idx);
+    corefile_modules_free(modules, n);
+    return ret;
+}
+
+//写入coredump的drop-in，不再执行setting_coredump.sh
+static int run_coredump_cmd(bool open_coredump)
+{
+    uint64_t start_usec = metrics_now_usec();
+    int r = coredump_configure(open_coredump);
+
+    metrics_observe_since(METRICS_SCRIPT, Basename(COREDUMP_DROPIN_PATH), start_usec, r != OK);
     if(r != 0)
     {
         r = ERROR;
-        fprintf(stderr, N_("Error: Failed to install dbg packages for %s\n"), module_name);
+        fprintf(stderr, N_("Error: Failed to configure coredump\n"));
     }
     return r;
 }
@@ -936,27 +1878,478 @@ false表示关闭coredump
 * 失败：返回 ERR_RET。*/
 int config_system_coredump(bool open_coredump)
 {
-    int r = 0;
-    char cmd_args[PATH_MAX];
+    int r = run_coredump_cmd(open_coredump);
 
-    if(!is_shell_cmd_allowed(CONFIG_COREDUMP_SHELL_PATH))
-    {
-        r = ERROR;
-        fprintf(stdout, N_("Error: The sha256 digest of the shell file does not match, the shell file may be rewritten.\n"));
+    if (r != 0)
         return r;
-    }
-    snprintf(cmd_args, PATH_MAX, open_coredump ? "on" : "off");
-    r = start_process(CONFIG_COREDUMP_SHELL_PATH,cmd_args,NULL);
-    if(r != 0)
-    {
-        r = ERROR;
-        fprintf(stderr, N_("Error: Failed to configure coredump\n"));
-        return r;
-    }
     r = modify_debug_levels("coredump", open_coredump ? "on" : "off");
     return r;
 }
 
+/* 批量模式中同时执行脚本的最大线程数 */
+#define BATCH_MAX_THREADS 4
+
+//批量模式中一个模块最终要设置的等级，同一个模块出现多次时以最后一行为准
+typedef struct batch_module
+{
+    const module_cfg *mdle_cfg;
+    config_batch_op *op;
+    int result;
+} batch_module;
+
+static void batch_op_fail(config_batch_op *op, const char *message)
+{
+    if (op->result == OK) {
+        op->result = ERROR;
+        op->message = message;
+    }
+}
+
+static bool is_batch_level_valid(const char *level)
+{
+    if (!level || level[0] == '\0')
+        return false;
+    //等级会作为脚本参数，不能包含空白和start_process拒绝的字符
+    return strpbrk(level, " \t;|&<>") == NULL;
+}
+
+static int parse_batch_line(char *line, config_batch_op *op)
+{
+    char *target, *level, *end;
+
+    target = line;
+    while (*target == ' ' || *target == '\t')
+        target++;
+    end = target + strlen(target);
+    while (end > target && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r'))
+        *--end = '\0';
+
+    //空行和注释行
+    if (*target == '\0' || *target == '#')
+        return 0;
+
+    level = strchr(target, '=');
+    if (!level) {
+        op->result = ERROR;
+        op->message = "syntax error";
+        op->target = strdup(target);
+        return 1;
+    }
+    *level++ = '\0';
+    g_strstrip(target);
+    g_strstrip(level);
+
+    if (strncmp(target, "group:", strlen("group:")) == 0) {
+        op->kind = CONFIG_BATCH_GROUP;
+        target += strlen("group:");
+    } else if (strcmp(target, "coredump") == 0) {
+        op->kind = CONFIG_BATCH_COREDUMP;
+    } else {
+        op->kind = CONFIG_BATCH_MODULE;
+    }
+    op->target = strdup(target);
+    op->level = strdup(level);
+    op->result = OK;
+
+    if (op->target[0] == '\0')
+        batch_op_fail(op, "missing module name");
+    else if (!is_batch_level_valid(op->level))
+        batch_op_fail(op, "invalid level");
+    else if (op->kind == CONFIG_BATCH_COREDUMP && strcmp(op->level, "on") != 0 && strcmp(op->level, "off") != 0)
+        batch_op_fail(op, "coredump should be on or off");
+    return 1;
+}
+
+/*读取批量模式的输入，每行一个操作，格式为 module=level、group:name=level
+或 coredump=on|off，空行和以#开头的行被忽略：
+*
+* fp：输入文件；
+* ops：保存解析出的操作，需要用config_batch_free释放；
+* ops_num：操作的数目。
+* 函数返回值：
+*
+* 成功：返回 0，格式错误的行也会出现在ops中，result为ERR_RET；
+* 失败：返回 ERR_RET。*/
+int config_batch_parse(FILE *fp, config_batch_op **ops, int *ops_num)
+{
+    config_batch_op *l = NULL;
+    char *line = NULL;
+    size_t len = 0;
+    int n = 0, allocated = 0, line_no = 0;
+
+    assert(fp && ops && ops_num);
+
+    while (getline(&line, &len, fp) != -1) {
+        config_batch_op op = {0};
+
+        line_no++;
+        if (parse_batch_line(line, &op) == 0)
+            continue;
+        op.line = line_no;
+
+        if (n == allocated) {
+            config_batch_op *t;
+
+            allocated = allocated ? allocated * 2 : 16;
+            t = realloc(l, sizeof(config_batch_op) * allocated);
+            if (!t) {
+                free(op.target);
+                free(op.level);
+                goto fail;
+            }
+            l = t;
+        }
+        l[n++] = op;
+    }
+    if (ferror(fp))
+        goto fail;
+
+    free(line);
+    *ops = l;
+    *ops_num = n;
+    return OK;
+
+fail:
+    fprintf(stderr, N_("Error: Failed to read batch input: %m\n"));
+    free(line);
+    config_batch_free(l, n);
+    return ERROR;
+}
+
+void config_batch_free(config_batch_op *ops, int ops_num)
+{
+    if (!ops)
+        return;
+    for (int i = 0; i < ops_num; i++) {
+        free(ops[i].target);
+        free(ops[i].level);
+    }
+    free(ops);
+}
+
+static void batch_take_module(GHashTable *modules, const module_cfg *mdle_cfg, config_batch_op *op)
+{
+    batch_module *bm = g_hash_table_lookup(modules, mdle_cfg->name);
+
+    if (!bm) {
+        bm = g_new0(batch_module, 1);
+        bm->mdle_cfg = mdle_cfg;
+        g_hash_table_insert(modules, mdle_cfg->name, bm);
+    } else if (bm->op != op) {
+        bm->op->superseded_by = op->line;
+    }
+    bm->op = op;
+}
+
+//把一行操作展开为模块，返回匹配到的模块数目
+static int batch_expand_op(GHashTable *modules, config_batch_op *op)
+{
+    GHashTableIter iter;
+    module_cfg *mdle_cfg = NULL;
+    bool all = strcmp(op->target, "all") == 0;
+    int found = 0;
+
+    if (op->kind == CONFIG_BATCH_MODULE && !all) {
+        mdle_cfg = g_hash_table_lookup(g_module_cfgs, op->target);
+        if (!mdle_cfg)
+            return 0;
+        batch_take_module(modules, mdle_cfg, op);
+        return 1;
+    }
+
+    g_hash_table_iter_init(&iter, g_module_cfgs);
+    while (g_hash_table_iter_next(&iter, NULL, (void**)&mdle_cfg)) {
+        if (!all && g_strcmp0(mdle_cfg->type, op->target) != 0)
+            continue;
+        batch_take_module(modules, mdle_cfg, op);
+        found++;
+    }
+    return found;
+}
+
+//检查所有要执行的脚本，每个脚本只计算一次sha256，同时统计每个脚本被几个模块使用
+static bool batch_verify_scripts(GHashTable *modules, GHashTable *scripts)
+{
+    GHashTableIter iter;
+    batch_module *bm;
+    bool ok = true;
+
+    g_hash_table_iter_init(&iter, modules);
+    while (g_hash_table_iter_next(&iter, NULL, (void**)&bm)) {
+        for (int i = 0; bm->mdle_cfg->sub_modules[i]; i++) {
+            const char *shell_cmd = bm->mdle_cfg->sub_modules[i]->shell_cmd;
+            int users = GPOINTER_TO_INT(g_hash_table_lookup(scripts, shell_cmd));
+
+            if (users == 0 && !is_module_shell_cmd_allowed(shell_cmd)) {
+                fprintf(stderr, N_("Error: The sha256 digest of the shell file does not match, the shell file may be rewritten.\n"));
+                users = -1;
+            }
+            if (users < 0) {
+                batch_op_fail(bm->op, "script digest mismatch");
+                ok = false;
+            } else {
+                users++;
+            }
+            g_hash_table_insert(scripts, (char *)shell_cmd, GINT_TO_POINTER(users));
+        }
+    }
+    return ok;
+}
+
+//和其他模块共用脚本的模块不能同时执行
+static bool batch_module_is_shared(const batch_module *bm, GHashTable *scripts)
+{
+    for (int i = 0; bm->mdle_cfg->sub_modules[i]; i++) {
+        if (GPOINTER_TO_INT(g_hash_table_lookup(scripts, bm->mdle_cfg->sub_modules[i]->shell_cmd)) > 1)
+            return true;
+    }
+    return false;
+}
+
+static void batch_run_module(void *data, void *userdata)
+{
+    batch_module *bm = data;
+
+    bm->result = run_module_shell_cmds(bm->mdle_cfg, bm->op->level, true);
+}
+
+static int batch_compare_line(const void *a, const void *b)
+{
+    const batch_module *x = *(batch_module * const *)a;
+    const batch_module *y = *(batch_module * const *)b;
+
+    return x->op->line - y->op->line;
+}
+
+/*把配置方案展开为批量操作，已经是目标等级的模块标记为unchanged，不会被执行。
+* 从未配置过的模块按off处理：
+*
+* profile_name：配置方案名；
+* ops：保存展开的操作，需要用config_batch_free释放；
+* ops_num：操作的数目。
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+int config_profile_build_batch(const char *profile_name, config_batch_op **ops, int *ops_num)
+{
+    module_cfg *profile = NULL;
+    config_batch_op *l = NULL;
+    int n = 0, ret;
+
+    assert(profile_name && ops && ops_num);
+
+    profile = g_profile_cfgs ? g_hash_table_lookup(g_profile_cfgs, profile_name) : NULL;
+    if (!profile) {
+        fprintf(stderr, N_("Error: cann't find profile %s.\n"), profile_name);
+        return ERROR;
+    }
+
+    while (profile->profile_modules[n])
+        n++;
+    l = malloc(sizeof(config_batch_op) * n);
+    if (!l)
+        return -ENOMEM;
+    memset(l, 0, sizeof(config_batch_op) * n);
+
+    G_LOCK(debug_levels);
+    ret = load_debug_levels();
+    for (int i = 0; i < n; i++) {
+        module_level *p_level = NULL;
+
+        l[i].line = i + 1;
+        l[i].kind = CONFIG_BATCH_MODULE;
+        l[i].target = strdup(profile->profile_modules[i]);
+        l[i].level = strdup(profile->profile_levels[i]);
+        l[i].result = OK;
+        if (ret != OK)
+            continue;
+        p_level = g_hash_table_lookup(g_module_levels, l[i].target);
+        l[i].unchanged = g_strcmp0(p_level && p_level->level ? p_level->level : "off", l[i].level) == 0;
+    }
+    G_UNLOCK(debug_levels);
+
+    *ops = l;
+    *ops_num = n;
+    return OK;
+}
+
+/*把config_batch_parse解析出的操作作为一个事务执行：先检查所有行和所有脚本的sha256，
+* 有任何错误时不执行任何操作；然后执行脚本，不共用脚本的模块并行执行；最后把所有成功的
+* 模块的等级一次写入配置文件。每一行的结果保存在ops[i].result和ops[i].message中：
+*
+* ops：要执行的操作；
+* ops_num：操作的数目。
+* 函数返回值：
+*
+* 全部成功：返回 0；
+* 有失败：返回 ERR_RET。*/
+int config_batch_apply(config_batch_op *ops, int ops_num)
+{
+    GHashTable *modules = NULL, *scripts = NULL;
+    GPtrArray *serial = NULL;
+    GThreadPool *pool = NULL;
+    GHashTableIter iter;
+    config_item *items = NULL;
+    config_batch_op *coredump_op = NULL;
+    batch_module *bm;
+    int ret = OK, r, items_num = 0;
+    bool valid = true;
+
+    assert(g_module_cfgs);
+
+    modules = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+    scripts = g_hash_table_new(g_str_hash, g_str_equal);
+
+    //检查阶段：展开模块类型，后面的行覆盖前面的行
+    for (int i = 0; i < ops_num; i++) {
+        config_batch_op *op = &ops[i];
+
+        if (op->result != OK) {
+            valid = false;
+            continue;
+        }
+        if (op->unchanged)
+            continue;
+        if (op->kind == CONFIG_BATCH_COREDUMP) {
+            if (coredump_op)
+                coredump_op->superseded_by = op->line;
+            coredump_op = op;
+            continue;
+        }
+        if (batch_expand_op(modules, op) == 0) {
+            batch_op_fail(op, op->kind == CONFIG_BATCH_GROUP ? "unknown module type" : "unknown module");
+            valid = false;
+        }
+    }
+
+    //还有模块以这一行为准的，不算被覆盖
+    g_hash_table_iter_init(&iter, modules);
+    while (g_hash_table_iter_next(&iter, NULL, (void**)&bm))
+        bm->op->superseded_by = 0;
+
+    if (!batch_verify_scripts(modules, scripts))
+        valid = false;
+
+    if (!valid) {
+        for (int i = 0; i < ops_num; i++) {
+            if (!ops[i].unchanged)
+                batch_op_fail(&ops[i], "not applied");
+        }
+        ret = ERROR;
+        goto out;
+    }
+
+    //执行阶段：共用脚本的模块按行号顺序在当前线程执行，其他模块交给线程池
+    serial = g_ptr_array_new();
+    pool = g_thread_pool_new(batch_run_module, NULL, BATCH_MAX_THREADS, FALSE, NULL);
+    g_hash_table_iter_init(&iter, modules);
+    while (g_hash_table_iter_next(&iter, NULL, (void**)&bm)) {
+        if (!pool || batch_module_is_shared(bm, scripts))
+            g_ptr_array_add(serial, bm);
+        else
+            g_thread_pool_push(pool, bm, NULL);
+    }
+
+    g_ptr_array_sort(serial, batch_compare_line);
+    for (unsigned i = 0; i < serial->len; i++)
+        batch_run_module(g_ptr_array_index(serial, i), NULL);
+
+    if (coredump_op && run_coredump_cmd(strcmp(coredump_op->level, "on") == 0) != OK)
+        batch_op_fail(coredump_op, "failed to configure coredump");
+
+    if (pool)
+        g_thread_pool_free(pool, FALSE, TRUE);
+
+    //提交阶段：所有成功的模块一次写入配置文件
+    items = malloc(sizeof(config_item) * (g_hash_table_size(modules) + ops_num));
+    if (!items) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    g_hash_table_iter_init(&iter, modules);
+    while (g_hash_table_iter_next(&iter, NULL, (void**)&bm)) {
+        if (bm->result != OK) {
+            batch_op_fail(bm->op, "failed to configure module");
+            continue;
+        }
+        items[items_num++] = (config_item) {bm->mdle_cfg->name, bm->op->level, CONFIG_OP_ADD};
+    }
+    //"all"只记录最后一次对所有模块的设置
+    for (int i = ops_num - 1; i >= 0; i--) {
+        if (!ops[i].unchanged && ops[i].kind != CONFIG_BATCH_COREDUMP && strcmp(ops[i].target, "all") == 0) {
+            if (ops[i].result == OK && ops[i].superseded_by == 0)
+                items[items_num++] = (config_item) {"all", ops[i].level, CONFIG_OP_ADD};
+            break;
+        }
+    }
+    if (coredump_op && coredump_op->result == OK)
+        items[items_num++] = (config_item) {"coredump", coredump_op->level, CONFIG_OP_ADD};
+
+    if (items_num > 0) {
+        G_LOCK(debug_levels);
+        r = modify_debug_levels_items_locked(items, items_num);
+        G_UNLOCK(debug_levels);
+        if (r < 0) {
+            for (int i = 0; i < ops_num; i++) {
+                if (!ops[i].unchanged)
+                    batch_op_fail(&ops[i], "failed to save debug levels");
+            }
+        }
+    }
+
+    for (int i = 0; i < ops_num; i++) {
+        if (ops[i].result != OK)
+            ret = ERROR;
+    }
+
+out:
+    free(items);
+    if (serial)
+        g_ptr_array_free(serial, TRUE);
+    g_hash_table_destroy(scripts);
+    g_hash_table_destroy(modules);
+    return ret;
+}
+
+/*解析配置方案，"modules"对象的每个成员是一个模块名及其调试等级，例如：
+* {"name": "network", "type": "profile", "modules": {"NetworkManager": "on"}}
+* 函数返回值：
+*
+* 成功：返回 0；
+* 失败：返回 ERR_RET。*/
+static int parse_profile_json(cJSON *root, module_cfg *mdle_cfg, const char *filename)
+{
+    cJSON *modules = cJSON_GetObjectItem(root, "modules");
+    cJSON *module = NULL;
+    int n = 0, i = 0;
+
+    if (modules == NULL || !cJSON_IsObject(modules) || cJSON_GetArraySize(modules) == 0) {
+        fprintf(stderr, N_("Error: Error parse modules of profile in file %s\n"),filename);
+        return ERROR;
+    }
+
+    n = cJSON_GetArraySize(modules);
+    mdle_cfg->profile = true;
+    mdle_cfg->profile_modules = malloc(sizeof(char *) * (n + 1));
+    mdle_cfg->profile_levels = malloc(sizeof(char *) * (n + 1));
+    assert(mdle_cfg->profile_modules && mdle_cfg->profile_levels);
+    memset(mdle_cfg->profile_modules, 0, sizeof(char *) * (n + 1));
+    memset(mdle_cfg->profile_levels, 0, sizeof(char *) * (n + 1));
+
+    cJSON_ArrayForEach(module, modules) {
+        if (!cJSON_IsString(module) || !is_batch_level_valid(module->valuestring)) {
+            fprintf(stderr, N_("Error: Error parse level of %s in file %s\n"),module->string,filename);
+            return ERROR;
+        }
+        mdle_cfg->profile_modules[i] = strdup(module->string);
+        mdle_cfg->profile_levels[i] = strdup(module->valuestring);
+        i++;
+    }
+    return OK;
+}
+
 /*解析一个json文件：
 *
 * filename： json文件的路径
@@ -1016,6 +2409,15 @@ int parse_hook_json_file(char *filename, module_cfg* mdle_cfg)
     }
     mdle_cfg->name = strdup(module_name->valuestring);
 
+    cJSON *descriptor_type = cJSON_GetObjectItem(root, "type");
+    if (descriptor_type && cJSON_IsString(descriptor_type) &&
+        strcmp(descriptor_type->valuestring, "profile") == 0) {
+        if (parse_profile_json(root, mdle_cfg, filename) < 0)
+            goto ERRRET;
+        cJSON_Delete(root);
+        return 0;
+    }
+
     cJSON *module_type = cJSON_GetObjectItem(root, "group");
     if (module_type) {
         if (module_type->type != cJSON_String) {
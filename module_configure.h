@@ -6,7 +6,9 @@
 #include <stdio.h>
 #include<stdlib.h>
 #include <limits.h>
+#include <stdint.h>
 #include "common.h"
+#include "dbgsym.h"
 
 
 //读取一个配置文件所能获取到的一个module的信息
@@ -23,26 +25,80 @@ typedef struct module_cfg
   int reboot;
   int sub_modules_num;
   sub_module_cfg **sub_modules;
+  bool profile;           // "type"为"profile"的描述文件，没有sub_modules
+  char **profile_modules; // 配置方案中的模块名，以NULL结尾
+  char **profile_levels;  // 与profile_modules一一对应的调试等级
 } module_cfg;
 
+//一个模块当前的调试状态，用于批量查询
+typedef struct module_state
+{
+  const char *name;
+  const char *type;
+  const char *level;      // 从未配置过时为NULL
+  int reboot;
+  uint64_t generation;
+  uint64_t last_changed;  // 单位微秒(CLOCK_REALTIME)，从未配置过时为0
+} module_state;
+
+typedef void (*module_state_cb)(const module_state *state, void *userdata);
+
+//批量模式中一行操作的类型
+typedef enum config_batch_kind
+{
+  CONFIG_BATCH_MODULE,    // module=level
+  CONFIG_BATCH_GROUP,     // group:type=level
+  CONFIG_BATCH_COREDUMP,  // coredump=on|off
+} config_batch_kind;
+
+//批量模式中的一行操作及其结果
+typedef struct config_batch_op
+{
+  int line;               // 在输入中的行号
+  config_batch_kind kind;
+  char *target;           // 模块名或模块类型
+  char *level;
+  int result;             // OK或ERROR
+  int superseded_by;      // 所有模块都被后面的行重新设置时，为那一行的行号
+  bool unchanged;         // 模块已经是目标等级，不需要执行
+  const char *message;    // 失败的原因
+} config_batch_op;
+
 int config_modules_set_debug_level_by_type(const char* module_type, const char *level);
 int config_modules_set_debug_level_by_types(const char* module_types, const char *level);
 int config_module_set_debug_level_by_module_names(const char *module_names, const char *level);
 int config_modules_install_dbgpkgs(const char *module_names);
+int config_modules_install_dbgpkgs_list(char **module_names, int count, int *results);
+int config_refresh_dbg_sources(bool force);
 int config_module_set_debug_level_by_module_name(const char *module_name, const char *level);
 int config_module_install_dbgpkgs_internal(const char *module_name);
+int config_core_install_dbgpkgs(const char *core);
+int config_modules_estimate_dbgpkgs(char **module_names, int count, dbgsym_estimate *est);
 
 int config_module_get_debug_level_by_type(const char *module_type, char **level);
+int config_modules_foreach_state(uint64_t since, module_state_cb cb, void *userdata, uint64_t *generation);
+int config_modules_get_generation(uint64_t *generation);
+int config_module_get_state(const char *name, module_state_cb cb, void *userdata);
+const char *config_module_lookup_name(const char *name);
 int config_system_coredump(bool open_coredump);
 
+int config_batch_parse(FILE *fp, config_batch_op **ops, int *ops_num);
+int config_batch_apply(config_batch_op *ops, int ops_num);
+void config_batch_free(config_batch_op *ops, int ops_num);
+int config_profile_build_batch(const char *profile_name, config_batch_op **ops, int *ops_num);
+
 int config_module_get_property_reboot(const char *name,int *reboot);
 int config_module_check_log();
+bool config_module_any_debug_enabled();
 int init_module_cfgs(const char *dir_path);
+int reload_module_cfgs(const char *dir_path);
 void deinit_module_cfgs();
 
 char **get_module_names();
+char **get_profile_names();
 
 bool check_can_install_dbg();
+int config_module_check_scripts(const char *module_name);
 
 int parse_hook_json_file(char *filename, module_cfg* mdle_cfg);
 
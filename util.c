@@ -1,4 +1,5 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
+#define _GNU_SOURCE
 #include"util.h"
 #include "module_configure.h"
 #include <dirent.h>
@@ -7,6 +8,8 @@
 #include <sys/stat.h>
 #include <ctype.h>
 #include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <openssl/opensslv.h>
 
 #if OPENSSL_VERSION_NUMBER < 0x30000000L
@@ -126,10 +129,11 @@ char** parseString(const char* input, const char* delimiter, int* count) {
     void *tmp_result = NULL;
     char* str = strdup(input); // 复制输入字符串，以便修改
     char* token;
+    char* saveptr = NULL;
     int i = 0;
 
-    // 使用 strtok 函数将字符串分割为子串
-    token = strtok(str, delimiter);
+    // 使用 strtok_r 函数将字符串分割为子串，服务的多个线程会同时调用
+    token = strtok_r(str, delimiter, &saveptr);
     while (token != NULL) {
         // 分配内存来存储每个子串，并将它们存储在字符串数组中
         tmp_result = realloc(result, (i + 2) * sizeof(char*));
@@ -142,7 +146,7 @@ char** parseString(const char* input, const char* delimiter, int* count) {
         result[i] = strdup(token);
         i++;
         result[i] = NULL;
-        token = strtok(NULL, delimiter);
+        token = strtok_r(NULL, delimiter, &saveptr);
     }
 
     *count = i; // 子串的数量
@@ -485,6 +489,15 @@ int read_from_fd(int fd, char **output) {
     return OK;
 }
 
+/*在fork出的子进程中exec之前调用：服务屏蔽了SIGTERM/SIGINT，屏蔽的信号会被
+* 子进程继承，不恢复的话子进程无法被这些信号终止*/
+void reset_signal_mask(void) {
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    (void) sigprocmask(SIG_SETMASK, &mask, NULL);
+}
+
 int start_process(const char *cmd_path, const char *arg_string, char **output) {
     if (!cmd_path || !arg_string)
         return ERROR;
@@ -513,19 +526,20 @@ int start_process(const char *cmd_path, const char *arg_string, char **output) {
 
     // Use strtok to split the name string into tokens based on space
     char *name_copy = strdup(arg_string);  // Duplicate the arg_string string for safe splitting
-    char *token = strtok(name_copy, " ");
+    char *saveptr = NULL;                  // strtok_r, so that several threads may start processes
+    char *token = strtok_r(name_copy, " ", &saveptr);
     int i = 1;
     while (token != NULL) {
         args[i] = token;
-        token = strtok(NULL, " ");
+        token = strtok_r(NULL, " ", &saveptr);
         i++;
     }
 
     args[i] = NULL;  // execvp needs the last argument to be NULL
 
-    // Create a pipe
+    // Create a pipe, close-on-exec so that children started by other threads don't hold our write end
     int pipefd[2];
-    if (pipe(pipefd) == -1) {
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
         perror("pipe failed");
         free(args);
         free(name_copy);
@@ -551,6 +565,7 @@ int start_process(const char *cmd_path, const char *arg_string, char **output) {
             dup2(pipefd[1], STDOUT_FILENO);
         }
         close(pipefd[1]);
+        reset_signal_mask();
         if (execvp(args[0], args) == -1) {
             perror("execvp failed");
             exit(ERROR);
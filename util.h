@@ -70,5 +70,6 @@ int str_endsWith(const char *str, const char *suffix);
 char *trim_string(const char *str);
 char** parseString(const char* input, const char* delimiter, int* count);
 
+void reset_signal_mask(void);
 int start_process(const char *cmd_path, const char *arg_string, char **output);
 #endif
\ No newline at end of file